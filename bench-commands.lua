@@ -0,0 +1,58 @@
+#!/usr/bin/luajit
+
+--  Measures the command parser and compiler over a long generated script.
+--
+--      luajit bench-commands.lua [groups] [rounds]
+
+vandal = { }
+require "vandal/utils/stdlib_ext"
+vandal.log_level = -1   --  Quiets the self-tests of the module.
+
+local commands = require "vandal/commands"
+
+local groups = tonumber(arg[1]) or 1000
+local rounds = tonumber(arg[2]) or 20
+
+--  Each group declares a local and then uses it, so the whole script compiles.
+local group = [=[
+local v%d = [get_value some_key_%d 'quoted argument' "double\tquoted"];
+set v%d [+ 1 [* $v%d 4]];
+if [check $v%d] { do_thing arg\ with\ spaces %d; other } elif [another %d] { x } else { y };
+# A line comment %d
+#[ A block comment %d #] plain command with_many words and_numbers 0x%d;
+v%d = [~ prefix_ [format %d]];
+]=]
+
+local parts = { }
+
+for i = 1, groups do
+    parts[i] = group:gsub("%%d", tostring(i))
+end
+
+local script = table.concat(parts) .. "done"
+
+local function measure(name, fnc)
+    fnc()   --  Warms up.
+
+    local start = os.clock()
+
+    for _ = 1, rounds do
+        fnc()
+    end
+
+    local secs = (os.clock() - start) / rounds
+
+    print(string.format("  %-10s %9.3f ms  %7.2f MB/s", name, secs * 1000, #script / secs / 1e6))
+end
+
+print(string.format("%d groups of statements, %d bytes, %d rounds", groups, #script, rounds))
+
+local tree, _, err = commands.parse(script)
+
+if err or not commands.compile(tree) then
+    error("The benchmark script does not compile: " .. tostring(err or select(2, commands.compile(tree))))
+end
+
+measure("parse", function() commands.parse(script) end)
+measure("view", function() commands.view(tree) end)
+measure("compile", function() commands.compile(tree) end)
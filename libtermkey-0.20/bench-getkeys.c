@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime
+
+#include "termkey.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Measures decoding of a large unbracketed paste of mixed-script text, as
+ * termkey_getkeys() batches and as termkey_getkey() one key at a time, and
+ * checks that both give the same keys.
+ *
+ *   ./bench-getkeys [MiB] [chunk KiB]
+ */
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Words from several scripts, so the input has one- to four-byte sequences
+ * in varying proportions, separated by spaces and the odd line break */
+static const char *const words[] = {
+  "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "0123", "{x}",
+  "caf\xc3\xa9", "na\xc3\xafve", "stra\xc3\x9f" "e", "\xc3\xa5ngstr\xc3\xb6m",
+  "\xce\xb1\xce\xbb\xcf\x86\xce\xb1", "\xce\xbb\xcf\x8c\xce\xb3\xce\xbf\xcf\x82",
+  "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xd0\xbc\xd0\xb8\xd1\x80",
+  "\xe4\xb8\xad\xe6\x96\x87", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+  "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4", "\xe2\x82\xac\xe2\x86\x92",
+  "\xf0\x9f\x98\x80", "\xf0\x9f\x9a\x80\xf0\x9f\x8c\x8d",
+};
+
+static char *make_buffer(size_t len)
+{
+  char *buf = malloc(len);
+  if(!buf)
+    return NULL;
+
+  unsigned int seed = 1;
+  size_t i = 0;
+
+  while(1) {
+    seed = seed * 1103515245 + 12345;
+    const char *word = words[(seed >> 8) % (sizeof words / sizeof words[0])];
+    size_t wlen = strlen(word);
+
+    if(i + wlen + 1 > len)
+      break;
+
+    memcpy(buf + i, word, wlen);
+    i += wlen;
+    buf[i++] = (seed >> 20) % 12 ? ' ' : '\r';
+  }
+
+  /* Pad with plain text so every run decodes the same number of bytes */
+  while(i < len)
+    buf[i++] = 'z';
+
+  return buf;
+}
+
+static double run(const char *buf, size_t len, size_t chunk, int batched, size_t *countp)
+{
+  TermKey *tk = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+  TermKeyKey keys[256];
+  size_t count = 0;
+
+  double start = now();
+
+  for(size_t off = 0; off < len; off += chunk) {
+    size_t n = len - off < chunk ? len - off : chunk;
+    termkey_push_bytes(tk, buf + off, n);
+
+    if(batched) {
+      size_t nkeys;
+      while(termkey_getkeys(tk, keys, 256, &nkeys), nkeys)
+        count += nkeys;
+    }
+    else
+      while(termkey_getkey(tk, keys) == TERMKEY_RES_KEY)
+        count++;
+  }
+
+  double secs = now() - start;
+
+  termkey_destroy(tk);
+
+  *countp = count;
+  return secs;
+}
+
+static int check(const char *buf, size_t len, size_t chunk)
+{
+  TermKey *tk  = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+  TermKey *tk1 = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+  TermKeyKey keys[256], key;
+  size_t count = 0;
+  int same = 1;
+
+  for(size_t off = 0; off < len && same; off += chunk) {
+    size_t n = len - off < chunk ? len - off : chunk;
+    termkey_push_bytes(tk,  buf + off, n);
+    termkey_push_bytes(tk1, buf + off, n);
+
+    size_t nkeys;
+    while(same && (termkey_getkeys(tk, keys, 256, &nkeys), nkeys)) {
+      for(size_t i = 0; i < nkeys; i++, count++) {
+        if(termkey_getkey(tk1, &key) != TERMKEY_RES_KEY ||
+           termkey_keycmp(tk, &key, &keys[i]) != 0 ||
+           (key.type == TERMKEY_TYPE_UNICODE && strcmp(key.utf8, keys[i].utf8) != 0)) {
+          printf("  key %zu differs\n", count);
+          same = 0;
+          break;
+        }
+      }
+    }
+  }
+
+  termkey_destroy(tk);
+  termkey_destroy(tk1);
+
+  return same;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t mib   = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+  size_t chunk = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+
+  size_t len = mib << 20;
+  chunk <<= 10;
+
+  char *buf = make_buffer(len);
+  if(!buf || !chunk) {
+    fprintf(stderr, "Cannot allocate %zu MiB\n", mib);
+    return 1;
+  }
+
+  printf("%zu MiB of mixed-script text in %zu KiB chunks\n", mib, chunk >> 10);
+
+  size_t count1, countn;
+  double secs1 = run(buf, len, chunk, 0, &count1);
+  double secsn = run(buf, len, chunk, 1, &countn);
+
+  printf("  %-16s %8.2f ms  %7.2f MB/s  %zu keys\n", "termkey_getkey", secs1 * 1000, len / secs1 / 1e6, count1);
+  printf("  %-16s %8.2f ms  %7.2f MB/s  %zu keys\n", "termkey_getkeys", secsn * 1000, len / secsn / 1e6, countn);
+
+  int ok = count1 == countn && check(buf, len, chunk);
+  if(!ok)
+    printf("  getkeys and getkey disagree\n");
+
+  free(buf);
+
+  return !ok;
+}
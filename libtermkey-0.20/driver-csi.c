@@ -1,7 +1,9 @@
 #include "termkey.h"
 #include "termkey-internal.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // There are 64 codes 0x40 - 0x7F
@@ -13,10 +15,15 @@ typedef struct {
   TermKey *tk;
   int saved_string_id;
   char *saved_string;
+  size_t saved_string_len;
+
+  /* Body of a bracketed paste still being received */
+  char *paste;
+  size_t paste_len;
+  size_t paste_size;
 } TermKeyCsi;
 
 typedef TermKeyResult CsiHandler(TermKey *tk, TermKeyKey *key, int cmd, long *arg, int args);
-static CsiHandler *csi_handlers[64];
 
 /*
  * Handler for CSI/SS3 cmd keys
@@ -26,6 +33,9 @@ static struct keyinfo csi_ss3s[64];
 
 static TermKeyResult handle_csi_ss3_full(TermKey *tk, TermKeyKey *key, int cmd, long *arg, int args)
 {
+  // Any initial or intermediate byte is ignored
+  cmd &= 0xff;
+
   if(args > 1 && arg[1] != -1)
     key->modifiers = arg[1] - 1;
   else
@@ -52,8 +62,6 @@ static void register_csi_ss3_full(TermKeyType type, TermKeySym sym, int modifier
   csi_ss3s[cmd - 0x40].sym = sym;
   csi_ss3s[cmd - 0x40].modifier_set = modifier_set;
   csi_ss3s[cmd - 0x40].modifier_mask = modifier_mask;
-
-  csi_handlers[cmd - 0x40] = &handle_csi_ss3_full;
 }
 
 static void register_csi_ss3(TermKeyType type, TermKeySym sym, unsigned char cmd)
@@ -128,8 +136,6 @@ static void register_csifunc(TermKeyType type, TermKeySym sym, int number)
   csifuncs[number].sym = sym;
   csifuncs[number].modifier_set = 0;
   csifuncs[number].modifier_mask = 0;
-
-  csi_handlers['~' - 0x40] = &handle_csifunc;
 }
 
 /*
@@ -330,72 +336,133 @@ TermKeyResult termkey_interpret_modereport(TermKey *tk, const TermKeyKey *key, i
   return TERMKEY_RES_KEY;
 }
 
-#define CHARAT(i) (tk->buffer[tk->buffstart + (i)])
+#define CHARAT(i) termkey_buffer_at(tk, (i))
 
-static TermKeyResult parse_csi(TermKey *tk, size_t introlen, size_t *csi_len, long args[], size_t *nargs, unsigned long *commandp)
-{
-  size_t csi_end = introlen;
+/*
+ * Dispatch on the whole command - initial byte, intermediate byte and final
+ * byte, packed as in termkey_interpret_csi() - through a perfect hash over the
+ * known commands. The table is laid out by the compiler; CSI_HASH() was
+ * picked so that none of its entries collide, and csi_hash_check() below
+ * keeps it that way.
+ */
 
-  while(csi_end < tk->buffcount) {
-    if(CHARAT(csi_end) >= 0x40 && CHARAT(csi_end) < 0x80)
-      break;
-    csi_end++;
-  }
+#define CSI_CMD(initial, intermediate, final) ((intermediate) << 16 | (initial) << 8 | (final))
+#define CSI_HASH(cmd) ((((cmd) & 0xff) + ((((cmd) >> 8) & 0xff) << 2) + (((cmd) >> 16) & 0xff) * 3) & 63)
+
+#define CSI_COMMANDS(X) \
+  X('A', &handle_csi_ss3_full) \
+  X('B', &handle_csi_ss3_full) \
+  X('C', &handle_csi_ss3_full) \
+  X('D', &handle_csi_ss3_full) \
+  X('E', &handle_csi_ss3_full) \
+  X('F', &handle_csi_ss3_full) \
+  X('H', &handle_csi_ss3_full) \
+  X('P', &handle_csi_ss3_full) \
+  X('Q', &handle_csi_ss3_full) \
+  X('R', &handle_csi_ss3_full) \
+  X('S', &handle_csi_ss3_full) \
+  X('Z', &handle_csi_ss3_full) \
+                                                 \
+  X('~', &handle_csifunc) \
+  X('u', &handle_csi_u) \
+                                                 \
+  X('M',                    &handle_csi_m) \
+  X('m',                    &handle_csi_m) \
+  X(CSI_CMD('<', 0, 'M'),   &handle_csi_m) \
+  X(CSI_CMD('<', 0, 'm'),   &handle_csi_m) \
+                                                 \
+  X(CSI_CMD('?', 0, 'R'),   &handle_csi_R) \
+                                                 \
+  X(CSI_CMD(0, '$', 'y'),   &handle_csi_y) \
+  X(CSI_CMD('?', '$', 'y'), &handle_csi_y)
+
+static const struct {
+  unsigned long cmd;
+  CsiHandler *handler;
+} csi_dispatch[64] = {
+#define CSI_ENTRY(cmd, handler) [CSI_HASH(cmd)] = { cmd, handler },
+  CSI_COMMANDS(CSI_ENTRY)
+#undef CSI_ENTRY
+};
 
-  if(csi_end >= tk->buffcount)
-    return TERMKEY_RES_AGAIN;
+/* Never called. Two commands that hash alike would make two designated
+ * initializers above name the same slot, and the later would silently win;
+ * here they make two equal case labels instead, which does not compile.
+ */
+static inline void csi_hash_check(unsigned long cmd)
+{
+  switch(CSI_HASH(cmd)) {
+#define CSI_CASE(cmd, handler) case CSI_HASH(cmd):
+  CSI_COMMANDS(CSI_CASE)
+#undef CSI_CASE
+    break;
+  }
+}
 
-  unsigned char cmd = CHARAT(csi_end);
-  *commandp = cmd;
+static CsiHandler *lookup_csi_handler(unsigned long cmd)
+{
+  if(csi_dispatch[CSI_HASH(cmd)].cmd == cmd)
+    return csi_dispatch[CSI_HASH(cmd)].handler;
 
-  char present = 0;
-  int argi = 0;
+  /* Unknown initial or intermediate bytes go to whatever handles the final
+   * byte alone, which can still decline them */
+  cmd &= 0xff;
+  if(csi_dispatch[CSI_HASH(cmd)].cmd == cmd)
+    return csi_dispatch[CSI_HASH(cmd)].handler;
 
-  size_t p = introlen;
+  return NULL;
+}
 
-  // See if there is an initial byte
-  if(CHARAT(p) >= '<' && CHARAT(p) <= '?') {
-    *commandp |= (CHARAT(p) << 8);
-    p++;
-  }
+/* Parses the arguments in the same pass that looks for the final byte.
+ * *nargs gives the size of args[] on entry; any more arguments are dropped.
+ */
+static TermKeyResult parse_csi(TermKey *tk, size_t introlen, size_t *csi_len, long args[], size_t *nargs, unsigned long *commandp)
+{
+  size_t maxargs = *nargs;
+  size_t argi = 0;
+  int present = 0;
+  int in_args = 1;
+  unsigned long cmd = 0;
 
-  // Now attempt to parse out up number;number;... separated values
-  while(p < csi_end) {
+  for(size_t p = introlen; p < tk->buffcount; p++) {
     unsigned char c = CHARAT(p);
 
+    if(c >= 0x40 && c < 0x80) {
+      if(present)
+        argi++;
+
+      *commandp = cmd | c;
+      *nargs = argi < maxargs ? argi : maxargs;
+      *csi_len = p + 1;
+      return TERMKEY_RES_KEY;
+    }
+
+    // Digits after an intermediate byte are not arguments
+    if(!in_args)
+      continue;
+
     if(c >= '0' && c <= '9') {
-      if(!present) {
-        args[argi] = c - '0';
-        present = 1;
-      }
-      else {
-        args[argi] = (args[argi] * 10) + c - '0';
-      }
+      if(argi < maxargs)
+        args[argi] = present ? (args[argi] * 10) + c - '0' : c - '0';
+      present = 1;
     }
     else if(c == ';') {
-      if(!present)
+      if(!present && argi < maxargs)
         args[argi] = -1;
       present = 0;
       argi++;
-
-      if(argi > 16)
-        break;
+    }
+    else if(c >= '<' && c <= '?' && p == introlen) {
+      // Initial byte
+      cmd |= c << 8;
     }
     else if(c >= 0x20 && c <= 0x2f) {
-      *commandp |= c << 16;
-      break;
+      cmd |= c << 16;
+      in_args = 0;
     }
-
-    p++;
   }
 
-  if(present)
-    argi++;
-
-  *nargs = argi;
-  *csi_len = csi_end + 1;
-
-  return TERMKEY_RES_KEY;
+  return TERMKEY_RES_AGAIN;
 }
 
 TermKeyResult termkey_interpret_csi(TermKey *tk, const TermKeyKey *key, long args[], size_t *nargs, unsigned long *cmd)
@@ -486,15 +553,6 @@ static int register_keys(void)
   register_csifunc(TERMKEY_TYPE_FUNCTION, 19, 33);
   register_csifunc(TERMKEY_TYPE_FUNCTION, 20, 34);
 
-  csi_handlers['u' - 0x40] = &handle_csi_u;
-
-  csi_handlers['M' - 0x40] = &handle_csi_m;
-  csi_handlers['m' - 0x40] = &handle_csi_m;
-
-  csi_handlers['R' - 0x40] = &handle_csi_R;
-
-  csi_handlers['y' - 0x40] = &handle_csi_y;
-
   keyinfo_initialised = 1;
   return 1;
 }
@@ -512,6 +570,11 @@ static void *new_driver(TermKey *tk, const char *term)
   csi->tk = tk;
   csi->saved_string_id = 0;
   csi->saved_string = NULL;
+  csi->saved_string_len = 0;
+
+  csi->paste = NULL;
+  csi->paste_len = 0;
+  csi->paste_size = 0;
 
   return csi;
 }
@@ -523,9 +586,107 @@ static void free_driver(void *info)
   if(csi->saved_string)
     free(csi->saved_string);
 
+  if(csi->paste)
+    free(csi->paste);
+
+  if(csi->tk->capture == csi)
+    csi->tk->capture = NULL;
+
   free(csi);
 }
 
+/*
+ * Bracketed paste: CSI 200 ~ body CSI 201 ~
+ * The body can be far larger than the input buffer, so it is moved out into
+ * its own buffer as it arrives. Until the end marker, this driver captures all
+ * input so no other driver sees pasted bytes as keys.
+ */
+
+static const char paste_end[] = "\x1b[201~";
+#define PASTE_END_LEN (sizeof(paste_end) - 1)
+
+/* Moves the first len bytes of the input buffer onto the paste */
+static int paste_append(TermKey *tk, TermKeyCsi *csi, size_t len)
+{
+  /* Always leave room for the terminating NUL */
+  if(csi->paste_len + len >= csi->paste_size) {
+    size_t newsize = csi->paste_size ? csi->paste_size : 4096;
+    while(csi->paste_len + len >= newsize)
+      newsize *= 2;
+
+    char *newpaste = realloc(csi->paste, newsize);
+    if(!newpaste)
+      return 0;
+
+    csi->paste = newpaste;
+    csi->paste_size = newsize;
+  }
+
+  termkey_buffer_copy(tk, 0, csi->paste + csi->paste_len, len);
+  csi->paste_len += len;
+
+  return 1;
+}
+
+static TermKeyResult peekkey_paste(TermKey *tk, TermKeyCsi *csi, TermKeyKey *key, int force, size_t *nbytep)
+{
+  size_t body_len = tk->buffcount;
+  int found = 0;
+
+  for(size_t i = 0; (i = termkey_buffer_find(tk, i, 0x1b)) < tk->buffcount; i++) {
+    size_t avail = tk->buffcount - i;
+    size_t j;
+
+    for(j = 1; j < PASTE_END_LEN && j < avail; j++)
+      if(CHARAT(i + j) != (unsigned char)paste_end[j])
+        break;
+
+    if(j == PASTE_END_LEN || j == avail) {
+      /* A partial marker at the very end is held back until more arrives */
+      body_len = i;
+      found = j == PASTE_END_LEN;
+      break;
+    }
+  }
+
+  if(!found && tk->is_closed)
+    body_len = tk->buffcount;
+
+  if(!paste_append(tk, csi, body_len)) {
+    errno = ENOMEM;
+    return TERMKEY_RES_ERROR;
+  }
+
+  termkey_buffer_skip(tk, body_len);
+
+  if(!found && !tk->is_closed)
+    return TERMKEY_RES_AGAIN;
+
+  csi->paste[csi->paste_len] = 0;
+
+  if(csi->saved_string)
+    free(csi->saved_string);
+
+  /* Hand the buffer over rather than copying it */
+  csi->saved_string_id++;
+  csi->saved_string = csi->paste;
+  csi->saved_string_len = csi->paste_len;
+
+  csi->paste = NULL;
+  csi->paste_len = 0;
+  csi->paste_size = 0;
+
+  tk->capture = NULL;
+
+  key->type = TERMKEY_TYPE_PASTE;
+  key->code.number = csi->saved_string_id;
+  key->modifiers = 0;
+
+  *nbytep = found ? PASTE_END_LEN : 0;
+
+  return TERMKEY_RES_KEY;
+}
+
 static TermKeyResult peekkey_csi(TermKey *tk, TermKeyCsi *csi, size_t introlen, TermKeyKey *key, int force, size_t *nbytep)
 {
   size_t csi_len;
@@ -546,13 +707,11 @@ static TermKeyResult peekkey_csi(TermKey *tk, TermKeyCsi *csi, size_t introlen,
   }
 
   if(cmd == 'M' && args < 3) { // Mouse in X10 encoding consumes the next 3 bytes also
-    tk->buffstart += csi_len;
-    tk->buffcount -= csi_len;
+    termkey_buffer_skip(tk, csi_len);
 
     TermKeyResult mouse_result = (*tk->method.peekkey_mouse)(tk, key, nbytep);
 
-    tk->buffstart -= csi_len;
-    tk->buffcount += csi_len;
+    termkey_buffer_unskip(tk, csi_len);
 
     if(mouse_result == TERMKEY_RES_KEY)
       *nbytep += csi_len;
@@ -560,11 +719,20 @@ static TermKeyResult peekkey_csi(TermKey *tk, TermKeyCsi *csi, size_t introlen,
     return mouse_result;
   }
 
+  if(cmd == '~' && args == 1 && arg[0] == 200) {
+    /* The start marker is eaten right away; from here on the body belongs
+     * to the paste */
+    termkey_buffer_skip(tk, csi_len);
+
+    tk->capture = csi;
+    return peekkey_paste(tk, csi, key, force, nbytep);
+  }
+
   TermKeyResult result = TERMKEY_RES_NONE;
 
-  // We know from the logic above that cmd must be >= 0x40 and < 0x80
-  if(csi_handlers[(cmd & 0xff) - 0x40])
-    result = (*csi_handlers[(cmd & 0xff) - 0x40])(tk, key, cmd, arg, args);
+  CsiHandler *handler = lookup_csi_handler(cmd);
+  if(handler)
+    result = (*handler)(tk, key, cmd, arg, args);
 
   if(result == TERMKEY_RES_NONE) {
 #ifdef DEBUG
@@ -662,11 +830,6 @@ static TermKeyResult peekkey_ctrlstring(TermKey *tk, TermKeyCsi *csi, size_t int
   if(str_end >= tk->buffcount)
     return TERMKEY_RES_AGAIN;
 
-#ifdef DEBUG
-  fprintf(stderr, "Found a control string: %*s",
-      str_end - introlen, tk->buffer + tk->buffstart + introlen);
-#endif
-
   *nbytep = str_end + 1;
   if(CHARAT(str_end) == 0x1b)
     (*nbytep)++;
@@ -678,10 +841,15 @@ static TermKeyResult peekkey_ctrlstring(TermKey *tk, TermKeyCsi *csi, size_t int
 
   csi->saved_string_id++;
   csi->saved_string = malloc(len + 1);
+  csi->saved_string_len = len;
 
-  strncpy(csi->saved_string, (char *)tk->buffer + tk->buffstart + introlen, len);
+  termkey_buffer_copy(tk, introlen, csi->saved_string, len);
   csi->saved_string[len] = 0;
 
+#ifdef DEBUG
+  fprintf(stderr, "Found a control string: %s", csi->saved_string);
+#endif
+
   key->type = (CHARAT(introlen-1) & 0x1f) == 0x10 ?
     TERMKEY_TYPE_DCS : TERMKEY_TYPE_OSC;
   key->code.number = csi->saved_string_id;
@@ -692,11 +860,14 @@ static TermKeyResult peekkey_ctrlstring(TermKey *tk, TermKeyCsi *csi, size_t int
 
 static TermKeyResult peekkey(TermKey *tk, void *info, TermKeyKey *key, int force, size_t *nbytep)
 {
+  TermKeyCsi *csi = info;
+
+  if(tk->capture == csi)
+    return peekkey_paste(tk, csi, key, force, nbytep);
+
   if(tk->buffcount == 0)
     return tk->is_closed ? TERMKEY_RES_EOF : TERMKEY_RES_NONE;
 
-  TermKeyCsi *csi = info;
-
   switch(CHARAT(0)) {
     case 0x1b:
       if(tk->buffcount < 2)
@@ -740,6 +911,11 @@ struct TermKeyDriver termkey_driver_csi = {
 };
 
 TermKeyResult termkey_interpret_string(TermKey *tk, const TermKeyKey *key, const char **strp)
+{
+  return termkey_interpret_string_len(tk, key, strp, NULL);
+}
+
+TermKeyResult termkey_interpret_string_len(TermKey *tk, const TermKeyKey *key, const char **strp, size_t *lenp)
 {
   struct TermKeyDriverNode *p;
   for(p = tk->drivers; p; p = p->next)
@@ -750,7 +926,8 @@ TermKeyResult termkey_interpret_string(TermKey *tk, const TermKeyKey *key, const
     return TERMKEY_RES_NONE;
 
   if(key->type != TERMKEY_TYPE_DCS &&
-     key->type != TERMKEY_TYPE_OSC)
+     key->type != TERMKEY_TYPE_OSC &&
+     key->type != TERMKEY_TYPE_PASTE)
     return TERMKEY_RES_NONE;
 
   TermKeyCsi *csi = p->info;
@@ -759,6 +936,8 @@ TermKeyResult termkey_interpret_string(TermKey *tk, const TermKeyKey *key, const
     return TERMKEY_RES_NONE;
 
   *strp = csi->saved_string;
+  if(lenp)
+    *lenp = csi->saved_string_len;
 
   return TERMKEY_RES_KEY;
 }
@@ -1,5 +1,5 @@
-// we want strdup()
-#define _XOPEN_SOURCE 600
+// we want strdup() and st_mtim
+#define _XOPEN_SOURCE 700
 
 #include "termkey.h"
 #include "termkey-internal.h"
@@ -15,16 +15,21 @@
 #endif
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 /* To be efficient at lookups, we store the byte sequence => keyinfo mapping
  * in a trie. This avoids a slow linear search through a flat list of
- * sequences. Because it is likely most nodes will be very sparse, we optimise
- * vector to store an extent map after the database is loaded.
+ * sequences. The trie is built out of separately allocated nodes, then once
+ * the database is loaded it is flattened; see below.
  */
 
 typedef enum {
@@ -52,19 +57,25 @@ typedef struct {
   TermKey *tk;
 
 #ifdef HAVE_UNIBILIUM
-  unibi_term *unibi;  /* only valid until first 'start' call */
+  unibi_term *unibi;  /* only valid until first 'start' call; NULL if cached */
+  char *term;         /* in case the cache can't be used after all */
+
+  char *ti_path;      /* terminfo file keying the cache, or NULL */
+  struct stat ti_stat;
+  void *cache_map;    /* mapped cache file holding trie, if any */
+  size_t cache_len;
 #else
   char *term; /* only valid until first 'start' call */
 #endif
 
-  struct trie_node *root;
+  uint32_t *trie; /* flattened; see flatten_trie() */
 
   char *start_string;
   char *stop_string;
 } TermKeyTI;
 
 static int funcname2keysym(const char *funcname, TermKeyType *typep, TermKeySym *symp, int *modmask, int *modsetp);
-static int insert_seq(TermKeyTI *ti, const char *seq, struct trie_node *node);
+static int insert_seq(struct trie_node *root, const char *seq, struct trie_node *node);
 
 static struct trie_node *new_node_key(TermKeyType type, TermKeySym sym, int modmask, int modset)
 {
@@ -98,7 +109,7 @@ static struct trie_node *new_node_arr(unsigned char min, unsigned char max)
   return (struct trie_node*)n;
 }
 
-static struct trie_node *lookup_next(struct trie_node *n, unsigned char b)
+static struct trie_node *lookup_next_node(struct trie_node *n, unsigned char b)
 {
   switch(n->type) {
   case TYPE_KEY:
@@ -137,36 +148,443 @@ static void free_trie(struct trie_node *n)
   free(n);
 }
 
-static struct trie_node *compress_trie(struct trie_node *n)
+/* The flattened trie is one array of 32-bit words. Every node comes after
+ * its parent, which finds it by its offset from the parent, so there are no
+ * pointers and the whole image may be copied or written out and used as is.
+ *
+ *   word 0      TRIE_MAGIC
+ *   word 1      total number of words
+ *   word 2...   the root node
+ *
+ * Every node starts with a word holding its type in the low 8 bits; a
+ * TYPE_ARR node also holds its min and max bytes in the next two. That is
+ * followed by max-min+1 child offsets for TYPE_ARR (0 where there is none),
+ * the four fields of struct keyinfo for TYPE_KEY, or nothing for TYPE_MOUSE.
+ * Nodes are laid out depth first, so a sequence is usually walked within a
+ * cache line or two.
+ */
+
+#define TRIE_MAGIC 0x31544b54 /* "TKT1" when little-endian */
+#define TRIE_ROOT  2
+
+#define TRIE_TYPE(w) ((w) & 0xff)
+#define TRIE_MIN(w)  (((w) >> 8) & 0xff)
+#define TRIE_MAX(w)  (((w) >> 16) & 0xff)
+
+/* Real extent of an array node; an empty one gets min > max */
+static void trie_arr_bounds(struct trie_node_arr *nar, int *minp, int *maxp)
 {
-  if(!n)
-    return NULL;
+  int min = nar->min, max = nar->max;
+
+  while(min <= max && !nar->arr[min - nar->min])
+    min++;
+  while(max >= min && !nar->arr[max - nar->min])
+    max--;
+
+  if(min > max) {
+    min = 1;
+    max = 0;
+  }
+
+  *minp = min;
+  *maxp = max;
+}
 
+static size_t flat_node_size(struct trie_node *n)
+{
   switch(n->type) {
   case TYPE_KEY:
+    return 5;
   case TYPE_MOUSE:
-    return n;
+    return 1;
   case TYPE_ARR:
     {
       struct trie_node_arr *nar = (struct trie_node_arr*)n;
-      unsigned char min, max;
-      // Find the real bounds
-      for(min = 0; !nar->arr[min]; min++)
-        ;
-      for(max = 0xff; !nar->arr[max]; max--)
-        ;
-
-      struct trie_node_arr *new = (struct trie_node_arr*)new_node_arr(min, max);
+      int min, max;
+      trie_arr_bounds(nar, &min, &max);
+
+      size_t size = 1 + (max - min + 1);
       int i;
       for(i = min; i <= max; i++)
-        new->arr[i - min] = compress_trie(nar->arr[i]);
+        if(nar->arr[i - nar->min])
+          size += flat_node_size(nar->arr[i - nar->min]);
+      return size;
+    }
+  }
+
+  return 0;
+}
+
+/* Writes the node at words[at], returning the index just past it and all of
+ * its children */
+static size_t flatten_node(struct trie_node *n, uint32_t *words, size_t at)
+{
+  switch(n->type) {
+  case TYPE_KEY:
+    {
+      struct trie_node_key *nk = (struct trie_node_key*)n;
+      words[at]   = TYPE_KEY;
+      words[at+1] = nk->key.type;
+      words[at+2] = nk->key.sym;
+      words[at+3] = nk->key.modifier_mask;
+      words[at+4] = nk->key.modifier_set;
+      return at + 5;
+    }
+  case TYPE_MOUSE:
+    words[at] = TYPE_MOUSE;
+    return at + 1;
+  case TYPE_ARR:
+    {
+      struct trie_node_arr *nar = (struct trie_node_arr*)n;
+      int min, max;
+      trie_arr_bounds(nar, &min, &max);
+
+      words[at] = TYPE_ARR | min << 8 | max << 16;
+
+      size_t next = at + 1 + (max - min + 1);
+      int i;
+      for(i = min; i <= max; i++) {
+        struct trie_node *child = nar->arr[i - nar->min];
+        if(!child) {
+          words[at + 1 + i - min] = 0;
+          continue;
+        }
+
+        words[at + 1 + i - min] = next - at;
+        next = flatten_node(child, words, next);
+      }
+      return next;
+    }
+  }
+
+  return at;
+}
+
+static uint32_t *flatten_trie(struct trie_node *root)
+{
+  size_t nwords = TRIE_ROOT + flat_node_size(root);
+
+  uint32_t *words = malloc(nwords * sizeof(words[0]));
+  if(!words)
+    return NULL;
+
+  words[0] = TRIE_MAGIC;
+  words[1] = nwords;
+  flatten_node(root, words, TRIE_ROOT);
+
+  return words;
+}
+
+/* Index of the child of node n for byte b, or 0 if there isn't one */
+static inline size_t lookup_next(const uint32_t *trie, size_t n, unsigned char b)
+{
+  uint32_t head = trie[n];
+  if(b < TRIE_MIN(head) || b > TRIE_MAX(head))
+    return 0;
+
+  uint32_t offset = trie[n + 1 + b - TRIE_MIN(head)];
+  return offset ? n + offset : 0;
+}
+
+#ifdef HAVE_UNIBILIUM
+/* If $TERMKEY_TI_CACHE names a directory, the flattened trie and the keypad
+ * strings are cached there, keyed by the terminfo file's path, mtime (to the
+ * nanosecond), size and inode, so that later instances can map them instead
+ * of parsing terminfo. Nothing is cached unless the variable is set. Only
+ * termkey's own tables are kept; output capabilities are up to the caller.
+ * A cache file is
+ *
+ *   struct ti_cache_header
+ *   path            path_len bytes
+ *   start string    start_len bytes + NUL, absent if start_len is NO_STRING
+ *   stop string     likewise
+ *   padding to a multiple of 4
+ *   trie            trie_words words
+ *
+ * in native byte order. Files are only ever replaced by rename(), so a mapping
+ * stays valid however the cache changes later.
+ */
+
+#define TI_CACHE_MAGIC 0x32434b54 /* "TKC2" when little-endian */
+#define NO_STRING      0xffffffff
+
+struct ti_cache_header {
+  uint32_t magic;
+  uint32_t header_size; /* catches any change to this struct */
+  int64_t  mtime;
+  int64_t  mtime_nsec;
+  int64_t  size;
+  uint64_t ino;
+  uint32_t path_len;
+  uint32_t start_len;
+  uint32_t stop_len;
+  uint32_t trie_words;
+};
+
+/* The cache directory, or NULL if caching is not enabled */
+static const char *cache_dir(void)
+{
+  const char *dir = getenv("TERMKEY_TI_CACHE");
+  return dir && dir[0] ? dir : NULL;
+}
+
+/* Returns a malloc()ed filename for the cache of the given terminfo file, or
+ * NULL if there is nowhere to put it. The directory is created if create is
+ * set. */
+static char *cache_filename(const char *ti_path, int create)
+{
+  const char *dir = cache_dir();
+  if(!dir)
+    return NULL;
+
+  if(create && mkdir(dir, 0700) == -1 && errno != EEXIST)
+    return NULL;
+
+  // FNV-1a; the header holds the full path to rule out collisions
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for(const char *c = ti_path; *c; c++)
+    hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+
+  char *filename = malloc(strlen(dir) + 21);
+  if(!filename)
+    return NULL;
+
+  sprintf(filename, "%s/ti-%016llx", dir, (unsigned long long)hash);
+  return filename;
+}
+
+/* A mapped trie must not send lookups outside the mapping, so check every
+ * offset lands on the start of a node */
+static int trie_valid(const uint32_t *trie, size_t nwords)
+{
+  if(nwords <= TRIE_ROOT || trie[0] != TRIE_MAGIC || trie[1] != nwords)
+    return 0;
+
+  unsigned char *starts = calloc(nwords, 1);
+  if(!starts)
+    return 0;
+
+  size_t at;
+  int valid = 1;
+  for(at = TRIE_ROOT; valid && at < nwords; ) {
+    uint32_t head = trie[at];
+    size_t size;
+
+    starts[at] = 1;
+
+    switch(TRIE_TYPE(head)) {
+    case TYPE_KEY:
+      size = 5;
+      break;
+    case TYPE_MOUSE:
+      size = 1;
+      break;
+    case TYPE_ARR:
+      size = TRIE_MAX(head) >= TRIE_MIN(head) ? 2 + TRIE_MAX(head) - TRIE_MIN(head) : 1;
+      break;
+    default:
+      size = 0;
+    }
+
+    if(!size || size > nwords - at)
+      valid = 0;
+
+    at += size;
+  }
+
+  // Children come after their parents, so all the node starts are known
+  for(at = TRIE_ROOT; valid && at < nwords; at++) {
+    if(!starts[at] || TRIE_TYPE(trie[at]) != TYPE_ARR || TRIE_MAX(trie[at]) < TRIE_MIN(trie[at]))
+      continue;
 
-      free(nar);
-      return (struct trie_node*)new;
+    size_t i;
+    for(i = 0; i <= TRIE_MAX(trie[at]) - TRIE_MIN(trie[at]); i++) {
+      uint32_t offset = trie[at + 1 + i];
+      if(offset && (offset >= nwords - at || !starts[at + offset]))
+        valid = 0;
     }
   }
 
-  return n;
+  free(starts);
+  return valid;
+}
+
+static const char *cache_string(const char *p, uint32_t len, const char *end)
+{
+  if(len == NO_STRING)
+    return NULL;
+
+  if(len >= (size_t)(end - p) || p[len] != 0)
+    return (const char *)-1;
+
+  return p;
+}
+
+/* Maps a valid cache for ti->ti_path, setting the trie and keypad strings */
+static int map_cache(TermKeyTI *ti)
+{
+  char *filename = cache_filename(ti->ti_path, 0);
+  if(!filename)
+    return 0;
+
+  int fd = open(filename, O_RDONLY);
+  free(filename);
+  if(fd == -1)
+    return 0;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if(fstat(fd, &st) == 0 && st.st_size >= sizeof(struct ti_cache_header))
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(map == MAP_FAILED)
+    return 0;
+
+  const struct ti_cache_header *hdr = map;
+  const char *p   = (const char *)(hdr + 1);
+  const char *end = (const char *)map + st.st_size;
+  const char *start = NULL, *stop = NULL;
+
+  if(hdr->magic != TI_CACHE_MAGIC || hdr->header_size != sizeof(*hdr) ||
+     hdr->mtime != ti->ti_stat.st_mtim.tv_sec || hdr->mtime_nsec != ti->ti_stat.st_mtim.tv_nsec ||
+     hdr->size != ti->ti_stat.st_size ||
+     hdr->ino != ti->ti_stat.st_ino)
+    goto stale;
+
+  if(hdr->path_len != strlen(ti->ti_path) || hdr->path_len > (size_t)(end - p) ||
+     memcmp(p, ti->ti_path, hdr->path_len) != 0)
+    goto stale;
+  p += hdr->path_len;
+
+  if((start = cache_string(p, hdr->start_len, end)) == (const char *)-1)
+    goto stale;
+  if(start)
+    p += hdr->start_len + 1;
+
+  if((stop = cache_string(p, hdr->stop_len, end)) == (const char *)-1)
+    goto stale;
+  if(stop)
+    p += hdr->stop_len + 1;
+
+  p = (const char *)map + (((p - (const char *)map) + 3) & ~(size_t)3);
+  if(p > end || hdr->trie_words != (size_t)(end - p) / sizeof(uint32_t) ||
+     !trie_valid((const uint32_t *)p, hdr->trie_words))
+    goto stale;
+
+  ti->start_string = start ? strdup(start) : NULL;
+  ti->stop_string  = stop  ? strdup(stop)  : NULL;
+
+  ti->trie = (uint32_t *)p;
+  ti->cache_map = map;
+  ti->cache_len = st.st_size;
+
+  return 1;
+
+stale:
+  munmap(map, st.st_size);
+  return 0;
+}
+
+static void unmap_cache(TermKeyTI *ti)
+{
+  munmap(ti->cache_map, ti->cache_len);
+  ti->cache_map = NULL;
+  ti->trie = NULL;
+
+  free(ti->start_string); ti->start_string = NULL;
+  free(ti->stop_string);  ti->stop_string = NULL;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+  while(len) {
+    ssize_t written = write(fd, buf, len);
+    if(written == -1) {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    buf = (const char *)buf + written;
+    len -= written;
+  }
+  return 1;
+}
+
+/* Saves the freshly loaded trie for next time; failure is not an error */
+static void write_cache(TermKeyTI *ti)
+{
+  char *filename = cache_filename(ti->ti_path, 1);
+  if(!filename)
+    return;
+
+  char *tmpname = malloc(strlen(filename) + 8);
+  if(!tmpname) {
+    free(filename);
+    return;
+  }
+  sprintf(tmpname, "%s.XXXXXX", filename);
+
+  int fd = mkstemp(tmpname);
+  if(fd == -1)
+    goto out;
+
+  struct ti_cache_header hdr = {
+    .magic       = TI_CACHE_MAGIC,
+    .header_size = sizeof(hdr),
+    .mtime       = ti->ti_stat.st_mtim.tv_sec,
+    .mtime_nsec  = ti->ti_stat.st_mtim.tv_nsec,
+    .size        = ti->ti_stat.st_size,
+    .ino         = ti->ti_stat.st_ino,
+    .path_len    = strlen(ti->ti_path),
+    .start_len   = ti->start_string ? strlen(ti->start_string) : NO_STRING,
+    .stop_len    = ti->stop_string  ? strlen(ti->stop_string)  : NO_STRING,
+    .trie_words  = ti->trie[1],
+  };
+
+  size_t len = sizeof(hdr) + hdr.path_len;
+  int ok = write_all(fd, &hdr, sizeof(hdr)) &&
+           write_all(fd, ti->ti_path, hdr.path_len);
+
+  if(ok && ti->start_string) {
+    ok = write_all(fd, ti->start_string, hdr.start_len + 1);
+    len += hdr.start_len + 1;
+  }
+  if(ok && ti->stop_string) {
+    ok = write_all(fd, ti->stop_string, hdr.stop_len + 1);
+    len += hdr.stop_len + 1;
+  }
+
+  static const char zeroes[3];
+  ok = ok && write_all(fd, zeroes, (4 - (len & 3)) & 3) &&
+             write_all(fd, ti->trie, hdr.trie_words * sizeof(uint32_t));
+
+  if(close(fd) == -1)
+    ok = 0;
+
+  if(!ok || rename(tmpname, filename) == -1)
+    unlink(tmpname);
+
+out:
+  free(tmpname);
+  free(filename);
+}
+#endif
+
+/* termkey_getkeys() assumes plain text never starts a key; tell it if some
+ * (probably overridden) sequence here does */
+static void check_text_keys(TermKeyTI *ti)
+{
+  uint32_t head = ti->trie[TRIE_ROOT];
+  int b;
+
+  for(b = TRIE_MIN(head); b <= TRIE_MAX(head); b++) {
+    if(!lookup_next(ti->trie, TRIE_ROOT, b))
+      continue;
+
+    if((b >= 0x20 && b < 0x7f) || b >= 0xc0)
+      ti->tk->text_keys = 1;
+  }
 }
 
 static int load_terminfo(TermKeyTI *ti)
@@ -174,7 +592,12 @@ static int load_terminfo(TermKeyTI *ti)
   int i;
 
 #ifdef HAVE_UNIBILIUM
+  if(!ti->unibi)
+    ti->unibi = unibi_from_term_cached(ti->term);
+
   unibi_term *unibi = ti->unibi;
+  if(!unibi)
+    return 0;
 #else
   {
     int err;
@@ -186,8 +609,8 @@ static int load_terminfo(TermKeyTI *ti)
   }
 #endif
 
-  ti->root = new_node_arr(0, 0xff);
-  if(!ti->root)
+  struct trie_node *root = new_node_arr(0, 0xff);
+  if(!root)
     return 0;
 
 #ifdef HAVE_UNIBILIUM
@@ -221,8 +644,10 @@ static int load_terminfo(TermKeyTI *ti)
 
     if(strcmp(name + 4, "mouse") == 0) {
       node = malloc(sizeof(*node));
-      if(!node)
+      if(!node) {
+        free_trie(root);
         return 0;
+      }
 
       node->type = TYPE_MOUSE;
     }
@@ -242,8 +667,9 @@ static int load_terminfo(TermKeyTI *ti)
     }
 
     if(node)
-      if(!insert_seq(ti, value, node)) {
+      if(!insert_seq(root, value, node)) {
         free(node);
+        free_trie(root);
         return 0;
       }
   }
@@ -272,11 +698,23 @@ static int load_terminfo(TermKeyTI *ti)
 
 #ifdef HAVE_UNIBILIUM
   unibi_destroy(unibi);
+  ti->unibi = NULL;
 #else
   free(ti->term);
+  ti->term = NULL;
 #endif
 
-  ti->root = compress_trie(ti->root);
+  ti->trie = flatten_trie(root);
+  free_trie(root);
+
+  if(!ti->trie)
+    return 0;
+
+#ifdef HAVE_UNIBILIUM
+  /* An overridden table is specific to this instance */
+  if(ti->ti_path && !ti->tk->ti_getstr_hook)
+    write_cache(ti);
+#endif
 
   return 1;
 }
@@ -288,12 +726,32 @@ static void *new_driver(TermKey *tk, const char *term)
     return NULL;
 
   ti->tk = tk;
-  ti->root = NULL;
+  ti->trie = NULL;
+  ti->start_string = NULL;
+  ti->stop_string = NULL;
 
 #ifdef HAVE_UNIBILIUM
-  ti->unibi = unibi_from_term(term);
-  if(!ti->unibi)
+  ti->unibi = NULL;
+  ti->cache_map = NULL;
+
+  ti->term = strdup(term);
+  if(!ti->term)
     goto abort_free;
+
+  ti->ti_path = cache_dir() ? unibi_find_term(term) : NULL;
+  if(ti->ti_path && stat(ti->ti_path, &ti->ti_stat) == -1) {
+    free(ti->ti_path);
+    ti->ti_path = NULL;
+  }
+
+  if(!ti->ti_path || !map_cache(ti)) {
+    ti->unibi = unibi_from_term_cached(term);
+    if(!ti->unibi) {
+      free(ti->ti_path);
+      free(ti->term);
+      goto abort_free;
+    }
+  }
 #else
   {
     int err;
@@ -322,9 +780,18 @@ static int start_driver(TermKey *tk, void *info)
   char *start_string;
   size_t len;
 
-  if(!ti->root)
+#ifdef HAVE_UNIBILIUM
+  /* The cache holds the table without any overrides */
+  if(ti->cache_map && tk->ti_getstr_hook)
+    unmap_cache(ti);
+#endif
+
+  if(!ti->trie)
     load_terminfo(ti);
 
+  if(ti->trie)
+    check_text_keys(ti);
+
   start_string = ti->start_string;
 
   if(tk->fd == -1 || !start_string)
@@ -390,7 +857,21 @@ static void free_driver(void *info)
 {
   TermKeyTI *ti = info;
 
-  free_trie(ti->root);
+#ifdef HAVE_UNIBILIUM
+  if(ti->cache_map)
+    munmap(ti->cache_map, ti->cache_len);
+  else
+    free(ti->trie);
+
+  if(ti->unibi)
+    unibi_destroy(ti->unibi);
+
+  free(ti->term);
+  free(ti->ti_path);
+#else
+  free(ti->trie);
+  free(ti->term);
+#endif
 
   if(ti->start_string)
     free(ti->start_string);
@@ -401,7 +882,7 @@ static void free_driver(void *info)
   free(ti);
 }
 
-#define CHARAT(i) (tk->buffer[tk->buffstart + (i)])
+#define CHARAT(i) termkey_buffer_at(tk, (i))
 
 static TermKeyResult peekkey(TermKey *tk, void *info, TermKeyKey *key, int force, size_t *nbytep)
 {
@@ -410,32 +891,33 @@ static TermKeyResult peekkey(TermKey *tk, void *info, TermKeyKey *key, int force
   if(tk->buffcount == 0)
     return tk->is_closed ? TERMKEY_RES_EOF : TERMKEY_RES_NONE;
 
-  struct trie_node *p = ti->root;
+  const uint32_t *trie = ti->trie;
+  if(!trie)
+    return TERMKEY_RES_NONE;
+
+  size_t p = TRIE_ROOT;
 
   unsigned int pos = 0;
   while(pos < tk->buffcount) {
-    p = lookup_next(p, CHARAT(pos));
+    p = lookup_next(trie, p, CHARAT(pos));
     if(!p)
       break;
 
     pos++;
 
-    if(p->type == TYPE_KEY) {
-      struct trie_node_key *nk = (struct trie_node_key*)p;
-      key->type      = nk->key.type;
-      key->code.sym  = nk->key.sym;
-      key->modifiers = nk->key.modifier_set;
+    if(TRIE_TYPE(trie[p]) == TYPE_KEY) {
+      key->type      = (TermKeyType)trie[p+1];
+      key->code.sym  = (TermKeySym)trie[p+2];
+      key->modifiers = trie[p+4];
       *nbytep = pos;
       return TERMKEY_RES_KEY;
     }
-    else if(p->type == TYPE_MOUSE) {
-      tk->buffstart += pos;
-      tk->buffcount -= pos;
+    else if(TRIE_TYPE(trie[p]) == TYPE_MOUSE) {
+      termkey_buffer_skip(tk, pos);
 
       TermKeyResult mouse_result = (*tk->method.peekkey_mouse)(tk, key, nbytep);
 
-      tk->buffstart -= pos;
-      tk->buffcount += pos;
+      termkey_buffer_unskip(tk, pos);
 
       if(mouse_result == TERMKEY_RES_KEY)
         *nbytep += pos;
@@ -552,16 +1034,16 @@ static int funcname2keysym(const char *funcname, TermKeyType *typep, TermKeySym
   return 0;
 }
 
-static int insert_seq(TermKeyTI *ti, const char *seq, struct trie_node *node)
+static int insert_seq(struct trie_node *root, const char *seq, struct trie_node *node)
 {
   int pos = 0;
-  struct trie_node *p = ti->root;
+  struct trie_node *p = root;
 
   // Unsigned because we'll be using it as an array subscript
   unsigned char b;
 
   while((b = seq[pos])) {
-    struct trie_node *next = lookup_next(p, b);
+    struct trie_node *next = lookup_next_node(p, b);
     if(!next)
       break;
     p = next;
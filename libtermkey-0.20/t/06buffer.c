@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "../termkey.h"
 #include "taplib.h"
 
@@ -7,7 +8,7 @@ int main(int argc, char *argv[])
   TermKey   *tk;
   TermKeyKey key;
 
-  plan_tests(9);
+  plan_tests(19);
 
   tk = termkey_new_abstract("vt100", 0);
 
@@ -26,6 +27,56 @@ int main(int argc, char *argv[])
 
   is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "buffered key still useable after resize");
 
+  termkey_push_bytes(tk, "abc", 3);
+  ok(!termkey_set_buffer_size(tk, 2), "buffer set size smaller than pending fails");
+  is_int(termkey_get_buffer_size(tk), 512, "buffer size unchanged after failed resize");
+  while(termkey_getkey(tk, &key) == TERMKEY_RES_KEY)
+    ;
+
+  // Sequences that straddle the end of the ring still parse
+  termkey_set_buffer_size(tk, 8);
+  termkey_set_flags(tk, termkey_get_flags(tk) | TERMKEY_FLAG_UTF8);
+
+  termkey_push_bytes(tk, "xxxxxx", 6);
+  for(int i = 0; i < 5; i++)
+    termkey_getkey(tk, &key);
+
+  termkey_push_bytes(tk, "\e[A", 3);
+  termkey_getkey(tk, &key);
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "key from wrapped CSI sequence");
+  is_int(key.code.sym, TERMKEY_SYM_UP, "key.code.sym from wrapped CSI sequence");
+
+  termkey_push_bytes(tk, "xxxxx", 5);
+  for(int i = 0; i < 4; i++)
+    termkey_getkey(tk, &key);
+
+  termkey_push_bytes(tk, "xx\xc3\xa9", 4);
+  for(int i = 0; i < 3; i++)
+    termkey_getkey(tk, &key);
+  termkey_getkey(tk, &key);
+  is_int(key.code.codepoint, 0xe9, "codepoint from wrapped UTF-8 sequence");
+
+  // More input than fits grows the buffer rather than dropping any
+  {
+    char bytes[1000];
+    memset(bytes, 'y', sizeof bytes);
+    bytes[sizeof bytes - 1] = 'z';
+
+    termkey_push_bytes(tk, "ab", 2);
+    termkey_getkey(tk, &key);
+
+    is_int(termkey_push_bytes(tk, bytes, sizeof bytes), sizeof bytes, "push_bytes takes everything");
+    ok(termkey_get_buffer_size(tk) >= sizeof bytes + 1, "buffer grew to fit");
+
+    is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "key after growing");
+    is_int(key.code.codepoint, 'b', "bytes pending before growing come first");
+
+    int count = 0;
+    while(termkey_getkey(tk, &key) == TERMKEY_RES_KEY)
+      count++;
+    ok(count == sizeof bytes && key.code.codepoint == 'z', "every pushed byte yields a key");
+  }
+
   termkey_destroy(tk);
 
   return exit_status();
@@ -0,0 +1,152 @@
+#include <string.h>
+#include "../termkey.h"
+#include "taplib.h"
+
+/* Whether getkeys in batches of up to n gives the same keys as getkey */
+static int agrees(const char *input, size_t len, size_t n, int canonflags)
+{
+  TermKey *tk  = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+  TermKey *tk1 = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+  TermKeyKey keys[128], key;
+  size_t nkeys;
+  int same = 1;
+
+  termkey_set_canonflags(tk,  canonflags);
+  termkey_set_canonflags(tk1, canonflags);
+
+  termkey_push_bytes(tk,  input, len);
+  termkey_push_bytes(tk1, input, len);
+
+  while(termkey_getkeys(tk, keys, n, &nkeys), nkeys)
+    for(size_t i = 0; i < nkeys; i++)
+      if(termkey_getkey(tk1, &key) != TERMKEY_RES_KEY ||
+         termkey_keycmp(tk, &key, &keys[i]) != 0 ||
+         (key.type == TERMKEY_TYPE_UNICODE && strcmp(key.utf8, keys[i].utf8) != 0))
+        same = 0;
+
+  if(termkey_getkey(tk1, &key) == TERMKEY_RES_KEY)
+    same = 0;
+
+  termkey_destroy(tk);
+  termkey_destroy(tk1);
+
+  return same;
+}
+
+int main(int argc, char *argv[])
+{
+  TermKey   *tk, *tk1;
+  TermKeyKey keys[8], key;
+  size_t nkeys;
+
+  plan_tests(23);
+
+  tk = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+
+  is_int(termkey_getkeys(tk, keys, 8, &nkeys), TERMKEY_RES_NONE, "getkeys yields RES_NONE when empty");
+  is_int(nkeys, 0, "no keys when empty");
+
+  termkey_push_bytes(tk, "ab \xc3\xa9", 5);
+
+  is_int(termkey_getkeys(tk, keys, 8, &nkeys), TERMKEY_RES_NONE, "getkeys yields RES_NONE after draining text");
+  is_int(nkeys, 4, "four keys from text");
+
+  is_int(keys[0].type,           TERMKEY_TYPE_UNICODE, "keys[0].type");
+  is_int(keys[0].code.codepoint, 'a',                  "keys[0].code.codepoint");
+  is_str(keys[0].utf8,           "a",                  "keys[0].utf8");
+  is_int(keys[2].code.codepoint, ' ',                  "keys[2].code.codepoint for space");
+  is_int(keys[3].code.codepoint, 0xe9,                 "keys[3].code.codepoint for UTF-8");
+  is_str(keys[3].utf8,           "\xc3\xa9",           "keys[3].utf8 for UTF-8");
+
+  termkey_push_bytes(tk, "abcdef", 6);
+
+  is_int(termkey_getkeys(tk, keys, 4, &nkeys), TERMKEY_RES_KEY, "getkeys yields RES_KEY when array fills");
+  is_int(nkeys, 4, "array filled");
+  is_int(termkey_getkeys(tk, keys, 4, &nkeys), TERMKEY_RES_NONE, "getkeys yields RES_NONE for the rest");
+  is_int(keys[1].code.codepoint, 'f', "rest follows on in order");
+
+  termkey_push_bytes(tk, "x\e[A\e", 5);
+
+  is_int(termkey_getkeys(tk, keys, 8, &nkeys), TERMKEY_RES_AGAIN, "getkeys yields RES_AGAIN for partial escape");
+  is_int(nkeys, 2, "complete keys before a partial escape");
+  is_int(keys[1].code.sym, TERMKEY_SYM_UP, "keys[1].code.sym from CSI");
+
+  termkey_push_bytes(tk, "[200~p\e[201~q", 12);
+
+  is_int(termkey_getkeys(tk, keys, 8, &nkeys), TERMKEY_RES_KEY, "getkeys yields RES_KEY after paste");
+  is_int(keys[nkeys-1].type, TERMKEY_TYPE_PASTE, "paste ends the batch");
+
+  // Same keys as getkey one at a time, for a mix of everything
+  {
+    const char *input = "Hello\x01\e[1;5B\e[M !!\xe2\x82\xac\x7f\tw\eOA\e[15~ z"
+      "The quick brown fox jumps over the lazy dog~{|}\x80\xc0\xaf\xf0\x9f\x98\x80\xed\xa0\x80"
+      "\xce\xb1\xce\xb2\xce\xb3 0123456789abcdefghijklmnopqrstuvwxyz!";
+    size_t len = strlen(input);
+    int same = 1, count = 0;
+
+    tk1 = termkey_new_abstract("xterm", TERMKEY_FLAG_UTF8);
+
+    termkey_getkeys(tk, keys, 8, &nkeys);
+
+    termkey_push_bytes(tk,  input, len);
+    termkey_push_bytes(tk1, input, len);
+
+    while(termkey_getkeys(tk, keys, 3, &nkeys), nkeys) {
+      for(size_t i = 0; i < nkeys; i++, count++) {
+        if(termkey_getkey(tk1, &key) != TERMKEY_RES_KEY ||
+           termkey_keycmp(tk, &key, &keys[i]) != 0 ||
+           (key.type == TERMKEY_TYPE_UNICODE && strcmp(key.utf8, keys[i].utf8) != 0))
+          same = 0;
+      }
+    }
+
+    ok(same && count > 0, "getkeys agrees with getkey");
+    is_int(termkey_getkey(tk1, &key), TERMKEY_RES_NONE, "getkey has no more keys either");
+
+    termkey_destroy(tk1);
+  }
+
+  // Long runs of text are validated many bytes at a time; put each kind of
+  // byte or sequence that has to be left to the drivers at various places
+  // inside one, across the blocks that get validated together
+  {
+    static const char *const odd[] = {
+      "\x01", " ", "\x7f", "\xc2\x85", "\xc2\xa0", "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80",
+      "\xef\xbf\xbd", "\xef\xbf\xbe", "\xef\xbf\xbf", "\xf4\x8f\xbf\xbf", "\xf4\x90\x80\x80",
+      "\xf5\x80\x80\x80", "\xf8\x88\x80\x80\x80", "\xe4\xb8", "\xb8", "\xfe",
+    };
+    const char *text = "ab\xc3\xa9\xce\xb1\xe4\xb8\xad\xf0\x9f\x98\x80yz";
+    size_t textlen = strlen(text);
+    int same = 1, samecanon = 1;
+
+    for(size_t o = 0; o < sizeof odd / sizeof odd[0]; o++)
+      for(size_t shift = 0; shift < 4; shift++)
+        for(size_t before = 0; before < 5; before++) {
+          char input[256];
+          size_t len = 0;
+
+          memset(input, 'q', shift);
+          len += shift;
+          for(size_t i = 0; i < before; i++, len += textlen)
+            memcpy(input + len, text, textlen);
+
+          memcpy(input + len, odd[o], strlen(odd[o]));
+          len += strlen(odd[o]);
+          for(size_t i = 0; i < 4; i++, len += textlen)
+            memcpy(input + len, text, textlen);
+
+          same      &= agrees(input, len, 128, 0);
+          samecanon &= agrees(input, len, 128, TERMKEY_CANON_SPACESYMBOL);
+
+          /* And cut off in the middle of that same sequence */
+          same &= agrees(input, shift + before * textlen + 1, 128, 0);
+        }
+
+    ok(same,      "getkeys agrees with getkey around odd sequences in long text");
+    ok(samecanon, "getkeys agrees with getkey when space is a keysym");
+  }
+
+  termkey_destroy(tk);
+
+  return exit_status();
+}
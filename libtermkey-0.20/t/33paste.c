@@ -0,0 +1,102 @@
+#include <string.h>
+#include "../termkey.h"
+#include "taplib.h"
+
+int main(int argc, char *argv[])
+{
+  TermKey   *tk;
+  TermKeyKey key;
+  const char *str;
+
+  plan_tests(28);
+
+  tk = termkey_new_abstract("xterm", 0);
+
+  // Whole paste in one go
+  termkey_push_bytes(tk, "\e[200~hello\rworld\e[201~", 23);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for paste");
+
+  is_int(key.type,        TERMKEY_TYPE_PASTE, "key.type for paste");
+  is_int(key.modifiers,   0,                  "key.modifiers for paste");
+
+  is_int(termkey_interpret_string(tk, &key, &str), TERMKEY_RES_KEY, "termkey_interpret_string() gives paste");
+  is_str(str, "hello\rworld", "termkey_interpret_string() yields pasted text");
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_NONE, "getkey again yields RES_NONE");
+
+  // Paste split across reads, including the end marker
+  termkey_push_bytes(tk, "\e[200~ab\e", 9);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_AGAIN, "getkey yields RES_AGAIN for partial paste");
+  is_int(termkey_getkey_force(tk, &key), TERMKEY_RES_NONE, "getkey_force does not split a paste");
+
+  termkey_push_bytes(tk, "[A\e[20", 6);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_AGAIN, "getkey yields RES_AGAIN for partial end marker");
+
+  termkey_push_bytes(tk, "1~x", 3);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY once paste ends");
+  is_int(key.type, TERMKEY_TYPE_PASTE, "key.type for split paste");
+
+  is_int(termkey_interpret_string(tk, &key, &str), TERMKEY_RES_KEY, "termkey_interpret_string() gives split paste");
+  is_str(str, "ab\e[A", "pasted escape sequences are kept as text");
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY after paste");
+  is_int(key.type,           TERMKEY_TYPE_UNICODE, "key.type after paste");
+  is_int(key.code.codepoint, 'x',                  "key.code.codepoint after paste");
+
+  // Paste much larger than the input buffer
+  {
+    char chunk[128];
+    memset(chunk, 'z', sizeof chunk);
+
+    termkey_push_bytes(tk, "\e[200~", 6);
+
+    int i;
+    for(i = 0; i < 100; i++) {
+      termkey_push_bytes(tk, chunk, sizeof chunk);
+      if(termkey_getkey(tk, &key) != TERMKEY_RES_AGAIN)
+        break;
+    }
+    is_int(i, 100, "large paste is collected without producing keys");
+
+    termkey_push_bytes(tk, "\e[201~", 6);
+
+    is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for large paste");
+    is_int(key.type, TERMKEY_TYPE_PASTE, "key.type for large paste");
+
+    termkey_interpret_string(tk, &key, &str);
+    is_int(strlen(str), 100 * sizeof chunk, "large paste has every byte");
+    ok(str[0] == 'z' && str[100 * sizeof chunk - 1] == 'z', "large paste content");
+  }
+
+  // Pasted NUL bytes are kept, and counted in the length
+  {
+    size_t len;
+
+    termkey_push_bytes(tk, "\e[200~a\0b\e[201~", 15);
+
+    is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for paste with NUL");
+    is_int(termkey_interpret_string_len(tk, &key, &str, &len), TERMKEY_RES_KEY, "termkey_interpret_string_len() gives paste");
+    ok(len == 3 && memcmp(str, "a\0b", 3) == 0, "paste with NUL has every byte");
+  }
+
+  // Strings from earlier keys are no longer available
+  {
+    TermKeyKey old = key;
+
+    termkey_push_bytes(tk, "\e[200~\e[201~", 12);
+
+    is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for empty paste");
+    is_int(termkey_interpret_string(tk, &key, &str), TERMKEY_RES_KEY, "termkey_interpret_string() gives empty paste");
+    is_str(str, "", "empty paste is empty");
+
+    is_int(termkey_interpret_string(tk, &old, &str), TERMKEY_RES_NONE, "termkey_interpret_string() rejects a stale paste");
+  }
+
+  termkey_destroy(tk);
+
+  return exit_status();
+}
@@ -9,7 +9,7 @@ int main(int argc, char *argv[])
   size_t     nargs = 16;
   unsigned long command;
 
-  plan_tests(15);
+  plan_tests(21);
 
   tk = termkey_new_abstract("vt100", 0);
 
@@ -40,6 +40,20 @@ int main(int argc, char *argv[])
   is_int(termkey_interpret_csi(tk, &key, args, &nargs, &command), TERMKEY_RES_KEY, "interpret_csi yields RES_KEY");
   is_int(command, '$'<<16 | '?'<<8 | 'x', "command for unknown CSI");
 
+  termkey_push_bytes(tk, "\e[1;;3;4;5x", 11);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for CSI x with many args");
+  nargs = 3;
+  termkey_interpret_csi(tk, &key, args, &nargs, &command);
+  is_int(nargs,    3, "nargs limited to the size of args");
+  is_int(args[1], -1, "args[1] for missing argument");
+  is_int(args[2],  3, "args[2] for unknown CSI");
+
+  termkey_push_bytes(tk, "\e[>1;5A", 8);
+
+  is_int(termkey_getkey(tk, &key), TERMKEY_RES_KEY, "getkey yields RES_KEY for CSI > A");
+  is_int(key.code.sym, TERMKEY_SYM_UP, "unknown initial byte still dispatches on the final byte");
+
   termkey_destroy(tk);
 
   return exit_status();
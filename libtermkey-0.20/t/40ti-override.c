@@ -17,14 +17,21 @@ static const char *backspace_is_X(const char *name, const char *val, void *_)
 
 int main(int argc, char *argv[])
 {
-  TermKey    *tk;
+  TermKey    *tk, *tk2;
   TermKeyKey  key;
+  TermKeyKey  keys[4];
+  size_t      nkeys;
 
-  plan_tests(3);
+  plan_tests(7);
 
   tk = termkey_new_abstract("vt100", TERMKEY_FLAG_NOSTART);
   termkey_hook_terminfo_getstr(tk, &backspace_is_X, NULL);
+
+  // Both instances share one terminfo entry; the hook only affects the first
+  tk2 = termkey_new_abstract("vt100", TERMKEY_FLAG_NOSTART);
+
   termkey_start(tk);
+  termkey_start(tk2);
 
   termkey_push_bytes(tk, "X", 1);
 
@@ -33,6 +40,18 @@ int main(int argc, char *argv[])
   is_int(key.type,     TERMKEY_TYPE_KEYSYM,   "key.type after X");
   is_int(key.code.sym, TERMKEY_SYM_BACKSPACE, "key.code.sym after X");
 
+  termkey_push_bytes(tk, "aX", 2);
+
+  termkey_getkeys(tk, keys, 4, &nkeys);
+  is_int(nkeys, 2, "getkeys yields two keys after aX");
+  is_int(keys[1].code.sym, TERMKEY_SYM_BACKSPACE, "getkeys still sees overridden X");
+
+  termkey_push_bytes(tk2, "X", 1);
+
+  is_int(termkey_getkey(tk2, &key), TERMKEY_RES_KEY, "getkey on second instance yields RES_KEY after X");
+  is_int(key.type, TERMKEY_TYPE_UNICODE, "second instance is unaffected by the hook");
+
+  termkey_destroy(tk2);
   termkey_destroy(tk);
 
   return exit_status();
@@ -0,0 +1,205 @@
+#define _XOPEN_SOURCE 700  // mkdtemp(), setenv(), utimensat()
+
+#include "../termkey.h"
+#include "taplib.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define streq(a,b) (!strcmp(a,b))
+
+static char tmpdir[64];
+static char cachedir[128];
+static char tipath[128];
+
+/* Number of entries in dir, with the path of the last one */
+static int list_dir(const char *dir, char *path, size_t len)
+{
+  DIR *d = opendir(dir);
+  if(!d)
+    return 0;
+
+  int count = 0;
+  struct dirent *ent;
+  while((ent = readdir(d))) {
+    if(ent->d_name[0] == '.')
+      continue;
+    snprintf(path, len, "%s/%s", dir, ent->d_name);
+    count++;
+  }
+  closedir(d);
+
+  return count;
+}
+
+/* Path of the only cache file, if there is exactly one */
+static int find_cache(char *path, size_t len)
+{
+  return list_dir(cachedir, path, len) == 1;
+}
+
+/* Copies the system's vt100 entry to a private terminfo directory, so its
+ * mtime can be changed */
+static int copy_terminfo(void)
+{
+  static const char *const dirs[] = { "/etc/terminfo", "/lib/terminfo", "/usr/share/terminfo" };
+  char buf[8192];
+  size_t len = 0;
+
+  for(size_t i = 0; i < sizeof dirs / sizeof dirs[0] && !len; i++) {
+    snprintf(buf, sizeof buf, "%s/v/vt100", dirs[i]);
+    FILE *f = fopen(buf, "rb");
+    if(!f)
+      continue;
+    len = fread(buf, 1, sizeof buf, f);
+    fclose(f);
+  }
+
+  snprintf(tipath, sizeof tipath, "%s/terminfo", tmpdir);
+  setenv("TERMINFO", tipath, 1);
+  mkdir(tipath, 0700);
+  strcat(tipath, "/v");
+  mkdir(tipath, 0700);
+  strcat(tipath, "/vt100");
+
+  FILE *f = fopen(tipath, "wb");
+  if(!f)
+    return 0;
+  int ok = len && fwrite(buf, 1, len, f) == len;
+  return fclose(f) == 0 && ok;
+}
+
+static int up_works(TermKey *tk)
+{
+  TermKeyKey key;
+
+  termkey_push_bytes(tk, "\eOA", 3);
+  return termkey_getkey(tk, &key) == TERMKEY_RES_KEY &&
+         key.type == TERMKEY_TYPE_KEYSYM && key.code.sym == TERMKEY_SYM_UP;
+}
+
+static const char *backspace_is_X(const char *name, const char *val, void *_)
+{
+  if(streq(name, "key_backspace"))
+    return "X";
+
+  return val;
+}
+
+int main(int argc, char *argv[])
+{
+  TermKey    *tk;
+  TermKeyKey  key;
+  char        path[512];
+  struct stat st;
+
+  plan_tests(13);
+
+  strcpy(tmpdir, "/tmp/termkey-cache-XXXXXX");
+  mkdtemp(tmpdir);
+  ok(copy_terminfo(), "terminfo entry copied");
+
+  // Nothing is cached, anywhere, unless asked for
+  setenv("HOME", tmpdir, 1);
+  setenv("XDG_CACHE_HOME", tmpdir, 1);
+  unsetenv("TERMKEY_TI_CACHE");
+
+  tk = termkey_new_abstract("vt100", 0);
+  ok(up_works(tk) && list_dir(tmpdir, path, sizeof path) == 1, "no cache file without TERMKEY_TI_CACHE");
+  termkey_destroy(tk);
+
+  snprintf(cachedir, sizeof cachedir, "%s/cache", tmpdir);
+  setenv("TERMKEY_TI_CACHE", cachedir, 1);
+
+  tk = termkey_new_abstract("vt100", 0);
+  ok(find_cache(path, sizeof path), "first instance writes a cache file");
+  ok(up_works(tk), "first instance works");
+  termkey_destroy(tk);
+
+  stat(path, &st);
+  off_t size = st.st_size;
+
+  tk = termkey_new_abstract("vt100", 0);
+  ok(up_works(tk), "instance from the cache works");
+  termkey_destroy(tk);
+
+  // Overrides apply on top of a cached table, and are not cached themselves
+  tk = termkey_new_abstract("vt100", TERMKEY_FLAG_NOSTART);
+  termkey_hook_terminfo_getstr(tk, &backspace_is_X, NULL);
+  termkey_start(tk);
+
+  termkey_push_bytes(tk, "X", 1);
+  termkey_getkey(tk, &key);
+  is_int(key.code.sym, TERMKEY_SYM_BACKSPACE, "override applies with a cache present");
+  termkey_destroy(tk);
+
+  tk = termkey_new_abstract("vt100", 0);
+  termkey_push_bytes(tk, "X", 1);
+  termkey_getkey(tk, &key);
+  is_int(key.code.codepoint, 'X', "override did not go into the cache");
+  termkey_destroy(tk);
+
+  // A damaged cache is ignored and replaced
+  {
+    FILE *f = fopen(path, "r+");
+    fwrite("XXXX", 4, 1, f);
+    fclose(f);
+  }
+
+  tk = termkey_new_abstract("vt100", 0);
+  ok(up_works(tk), "instance with a damaged cache works");
+  termkey_destroy(tk);
+
+  {
+    char magic[4] = "";
+    FILE *f = fopen(path, "r");
+    fread(magic, 4, 1, f);
+    fclose(f);
+
+    stat(path, &st);
+    ok(memcmp(magic, "XXXX", 4) != 0 && st.st_size == size, "damaged cache rewritten");
+  }
+
+  tk = termkey_new_abstract("vt100", 0);
+  ok(up_works(tk), "instance from the rewritten cache works");
+  termkey_destroy(tk);
+
+  // A terminfo file changed within the same second is still noticed
+  {
+    stat(path, &st);
+    ino_t ino = st.st_ino;
+
+    tk = termkey_new_abstract("vt100", 0);
+    termkey_destroy(tk);
+
+    stat(path, &st);
+    ok(st.st_ino == ino, "valid cache is not rewritten");
+
+    stat(tipath, &st);
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000;
+    utimensat(AT_FDCWD, tipath, times, 0);
+
+    tk = termkey_new_abstract("vt100", 0);
+    ok(up_works(tk), "instance after a sub-second terminfo change works");
+    termkey_destroy(tk);
+
+    stat(path, &st);
+    ok(st.st_ino != ino, "cache rewritten after a sub-second terminfo change");
+  }
+
+  remove(path);
+  remove(cachedir);
+  remove(tipath);
+  snprintf(path, sizeof path, "%s/terminfo/v", tmpdir);
+  remove(path);
+  snprintf(path, sizeof path, "%s/terminfo", tmpdir);
+  remove(path);
+  remove(tmpdir);
+
+  return exit_status();
+}
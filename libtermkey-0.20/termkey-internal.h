@@ -4,6 +4,7 @@
 #include "termkey.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <termios.h>
 
 struct TermKeyDriver
@@ -34,10 +35,10 @@ struct TermKey {
   int    fd;
   int    flags;
   int    canonflags;
-  unsigned char *buffer;
+  unsigned char *buffer; // a ring; see termkey_buffer_at()
   size_t buffstart; // First offset in buffer
   size_t buffcount; // NUMBER of entires valid in buffer
-  size_t buffsize; // Total malloc'ed size
+  size_t buffsize; // Total malloc'ed size; grows on demand
   size_t hightide; /* Position beyond buffstart at which peekkey() should next start
                     * normally 0, but see also termkey_interpret_csi */
 
@@ -59,6 +60,8 @@ struct TermKey {
   struct keyinfo c0[32];
 
   struct TermKeyDriverNode *drivers;
+  void *capture; /* info of a driver that must see all input first, e.g. mid-paste */
+  int text_keys; /* some driver has keys starting with plain text; see termkey_getkeys() */
 
   // Now some "protected" methods for the driver to call but which we don't
   // want exported as real symbols in the library
@@ -69,6 +72,66 @@ struct TermKey {
   } method;
 };
 
+/* tk->buffer is a ring; the buffcount valid bytes begin at buffstart and may
+ * wrap around past the end of the allocation. Drivers should only look at it
+ * through these.
+ */
+static inline size_t termkey_buffer_index(const TermKey *tk, size_t i)
+{
+  size_t idx = tk->buffstart + i;
+  return idx < tk->buffsize ? idx : idx - tk->buffsize;
+}
+
+static inline unsigned char termkey_buffer_at(const TermKey *tk, size_t i)
+{
+  return tk->buffer[termkey_buffer_index(tk, i)];
+}
+
+/* Copy len bytes starting at offset i out of the ring */
+static inline void termkey_buffer_copy(const TermKey *tk, size_t i, void *dst, size_t len)
+{
+  size_t idx = termkey_buffer_index(tk, i);
+  size_t first = tk->buffsize - idx;
+  if(first > len)
+    first = len;
+
+  memcpy(dst, tk->buffer + idx, first);
+  memcpy((unsigned char *)dst + first, tk->buffer, len - first);
+}
+
+/* Offset of the first byte equal to c at or after offset i, or buffcount */
+static inline size_t termkey_buffer_find(const TermKey *tk, size_t i, unsigned char c)
+{
+  while(i < tk->buffcount) {
+    size_t idx = termkey_buffer_index(tk, i);
+    size_t seglen = tk->buffsize - idx;
+    if(seglen > tk->buffcount - i)
+      seglen = tk->buffcount - i;
+
+    const unsigned char *hit = memchr(tk->buffer + idx, c, seglen);
+    if(hit)
+      return i + (hit - (tk->buffer + idx));
+
+    i += seglen;
+  }
+
+  return tk->buffcount;
+}
+
+/* Hide the first n bytes, e.g. to hand what follows a prefix to another
+ * parser; termkey_buffer_unskip() puts them back */
+static inline void termkey_buffer_skip(TermKey *tk, size_t n)
+{
+  tk->buffstart = termkey_buffer_index(tk, n);
+  tk->buffcount -= n;
+}
+
+static inline void termkey_buffer_unskip(TermKey *tk, size_t n)
+{
+  tk->buffstart = tk->buffstart >= n ? tk->buffstart - n : tk->buffstart + tk->buffsize - n;
+  tk->buffcount += n;
+}
+
 static inline void termkey_key_get_linecol(const TermKeyKey *key, int *line, int *col)
 {
   if(col)
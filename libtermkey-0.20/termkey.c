@@ -7,9 +7,19 @@
 #include <unistd.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/uio.h>
 
 #include <stdio.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_AVX2_DISPATCH
+#endif
+
 #define strcaseeq(a,b) (strcasecmp(a,b) == 0)
 
 void termkey_check_version(int major, int minor)
@@ -111,7 +121,7 @@ static struct {
   { 0, NULL },
 };
 
-#define CHARAT(i) (tk->buffer[tk->buffstart + (i)])
+#define CHARAT(i) termkey_buffer_at(tk, (i))
 
 #ifdef DEBUG
 /* Some internal deubgging functions */
@@ -165,6 +175,9 @@ static void print_key(TermKey *tk, TermKeyKey *key)
   case TERMKEY_TYPE_OSC:
     fprintf(stderr, "Operating System Control");
     break;
+  case TERMKEY_TYPE_PASTE:
+    fprintf(stderr, "Bracketed paste");
+    break;
   case TERMKEY_TYPE_UNKNOWN_CSI:
     fprintf(stderr, "unknown CSI\n");
     break;
@@ -299,6 +312,8 @@ static TermKey *termkey_alloc(void)
     tk->c0[i].sym = TERMKEY_SYM_NONE;
 
   tk->drivers = NULL;
+  tk->capture = NULL;
+  tk->text_keys = 0;
 
   tk->method.emit_codepoint = &emit_codepoint;
   tk->method.peekkey_simple = &peekkey_simple;
@@ -605,18 +620,47 @@ size_t termkey_get_buffer_size(TermKey *tk)
   return tk->buffsize;
 }
 
-int termkey_set_buffer_size(TermKey *tk, size_t size)
+/* Moves the buffered bytes to the start of a new allocation of the given size,
+ * undoing any wrap-around */
+static int resize_buffer(TermKey *tk, size_t size)
 {
-  unsigned char *buffer = realloc(tk->buffer, size);
+  unsigned char *buffer = malloc(size);
   if(!buffer)
     return 0;
 
+  termkey_buffer_copy(tk, 0, buffer, tk->buffcount);
+
+  free(tk->buffer);
   tk->buffer = buffer;
+  tk->buffstart = 0;
   tk->buffsize = size;
 
   return 1;
 }
 
+/* Make room for at least len more bytes */
+static int reserve_buffer(TermKey *tk, size_t len)
+{
+  if(tk->buffsize - tk->buffcount >= len)
+    return 1;
+
+  size_t size = tk->buffsize ? tk->buffsize : 256;
+  while(size - tk->buffcount < len)
+    size *= 2;
+
+  return resize_buffer(tk, size);
+}
+
+int termkey_set_buffer_size(TermKey *tk, size_t size)
+{
+  if(size < tk->buffcount) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  return resize_buffer(tk, size);
+}
+
 size_t termkey_get_buffer_remaining(TermKey *tk)
 {
   /* Return the total number of free bytes in the buffer, because that's what
@@ -632,8 +676,7 @@ static void eat_bytes(TermKey *tk, size_t count)
     return;
   }
 
-  tk->buffstart += count;
-  tk->buffcount -= count;
+  termkey_buffer_skip(tk, count);
 }
 
 static inline unsigned int utf8_seqlen(long codepoint)
@@ -747,6 +790,24 @@ static TermKeyResult parse_utf8(const unsigned char *bytes, size_t len, long *cp
   return TERMKEY_RES_KEY;
 }
 
+/* parse_utf8() on the buffered bytes from offset pos, which may wrap around
+ * the end of the ring */
+static TermKeyResult parse_utf8_at(TermKey *tk, size_t pos, long *cp, size_t *nbytep)
+{
+  size_t idx = termkey_buffer_index(tk, pos);
+  size_t avail = tk->buffcount - pos;
+
+  if(idx + avail <= tk->buffsize)
+    return parse_utf8(tk->buffer + idx, avail, cp, nbytep);
+
+  // No sequence exceeds 6 bytes
+  unsigned char seq[6];
+  if(avail > sizeof seq)
+    avail = sizeof seq;
+  termkey_buffer_copy(tk, pos, seq, avail);
+  return parse_utf8(seq, avail, cp, nbytep);
+}
+
 static void emit_codepoint(TermKey *tk, long codepoint, TermKeyKey *key)
 {
   if(codepoint == 0) {
@@ -855,14 +916,16 @@ static TermKeyResult peekkey(TermKey *tk, TermKeyKey *key, int force, size_t *nb
 #endif
 
   if(tk->hightide) {
-    tk->buffstart += tk->hightide;
-    tk->buffcount -= tk->hightide;
+    termkey_buffer_skip(tk, tk->hightide);
     tk->hightide = 0;
   }
 
   TermKeyResult ret;
   struct TermKeyDriverNode *p;
   for(p = tk->drivers; p; p = p->next) {
+    if(tk->capture && p->info != tk->capture)
+      continue;
+
     ret = (p->driver->peekkey)(tk, p->info, key, force, nbytep);
 
 #ifdef DEBUG
@@ -874,16 +937,6 @@ static TermKeyResult peekkey(TermKey *tk, TermKeyKey *key, int force, size_t *nb
 #ifdef DEBUG
       print_key(tk, key); fprintf(stderr, "\n");
 #endif
-      // Slide the data down to stop it running away
-      {
-        size_t halfsize = tk->buffsize / 2;
-
-        if(tk->buffstart > halfsize) {
-          memcpy(tk->buffer, tk->buffer + halfsize, halfsize);
-          tk->buffstart -= halfsize;
-        }
-      }
-
       /* fallthrough */
     case TERMKEY_RES_EOF:
     case TERMKEY_RES_ERROR:
@@ -902,6 +955,10 @@ static TermKeyResult peekkey(TermKey *tk, TermKeyKey *key, int force, size_t *nb
   if(again)
     return TERMKEY_RES_AGAIN;
 
+  /* The capturing driver owns any bytes left over, even when forced */
+  if(tk->capture)
+    return TERMKEY_RES_NONE;
+
   ret = peekkey_simple(tk, key, force, nbytep);
 
 #ifdef DEBUG
@@ -935,14 +992,12 @@ static TermKeyResult peekkey_simple(TermKey *tk, TermKeyKey *key, int force, siz
     }
 
     // Try another key there
-    tk->buffstart++;
-    tk->buffcount--;
+    termkey_buffer_skip(tk, 1);
 
     // Run the full driver
     TermKeyResult metakey_result = peekkey(tk, key, force, nbytep);
 
-    tk->buffstart--;
-    tk->buffcount++;
+    termkey_buffer_unskip(tk, 1);
 
     switch(metakey_result) {
       case TERMKEY_RES_KEY:
@@ -968,7 +1023,7 @@ static TermKeyResult peekkey_simple(TermKey *tk, TermKeyKey *key, int force, siz
   else if(tk->flags & TERMKEY_FLAG_UTF8) {
     // Some UTF-8
     long codepoint;
-    TermKeyResult res = parse_utf8(tk->buffer + tk->buffstart, tk->buffcount, &codepoint, nbytep);
+    TermKeyResult res = parse_utf8_at(tk, 0, &codepoint, nbytep);
 
     if(res == TERMKEY_RES_AGAIN && force) {
       /* There weren't enough bytes for a complete UTF-8 sequence but caller
@@ -1035,6 +1090,407 @@ TermKeyResult termkey_getkey(TermKey *tk, TermKeyKey *key)
   return ret;
 }
 
+/* Length of the leading run of printable ASCII in bytes. Space is included
+ * only if first is 0x20; it is 0x21 when space may canonicalise to a keysym */
+static size_t ascii_run(const unsigned char *bytes, size_t len, unsigned char first)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i lo = _mm_set1_epi8(first - 1);
+  const __m128i hi = _mm_set1_epi8(0x7f);
+
+  /* Signed compares, so bytes with the top bit set fail the first test */
+  for(; len - i >= 16; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi)));
+    if(mask != 0xffff)
+      return i + __builtin_ctz(~mask);
+  }
+#endif
+
+  while(i < len && bytes[i] >= first && bytes[i] < 0x7f)
+    i++;
+
+  return i;
+}
+
+/* Length of the complete multibyte UTF-8 sequence at bytes if it is one that
+ * decodes to a plain character; that is, well-formed and shortest-form, and
+ * neither a C1 control, a surrogate, U+FFFE or U+FFFF, nor beyond U+10FFFF.
+ * 0 for anything else, which is left to parse_utf8().
+ */
+static size_t plain_utf8(const unsigned char *bytes, size_t len)
+{
+  unsigned char b0 = bytes[0];
+  unsigned char lo = 0x80, hi = 0xbf;
+  size_t nbytes;
+
+  if(b0 < 0xc2)
+    return 0;
+  else if(b0 < 0xe0) {
+    nbytes = 2;
+    if(b0 == 0xc2)
+      lo = 0xa0;
+  }
+  else if(b0 < 0xf0) {
+    nbytes = 3;
+    if(b0 == 0xe0)
+      lo = 0xa0;
+    else if(b0 == 0xed)
+      hi = 0x9f;
+  }
+  else if(b0 < 0xf5) {
+    nbytes = 4;
+    if(b0 == 0xf0)
+      lo = 0x90;
+    else if(b0 == 0xf4)
+      hi = 0x8f;
+  }
+  else
+    return 0;
+
+  if(len < nbytes || bytes[1] < lo || bytes[1] > hi)
+    return 0;
+
+  for(size_t b = 2; b < nbytes; b++)
+    if((bytes[b] & 0xc0) != 0x80)
+      return 0;
+
+  if(b0 == 0xef && bytes[1] == 0xbf && bytes[2] >= 0xbe)
+    return 0;
+
+  return nbytes;
+}
+
+static size_t text_run_generic(const unsigned char *bytes, size_t len, unsigned char first)
+{
+  size_t i = 0;
+
+  while(1) {
+    i += ascii_run(bytes + i, len - i, first);
+    if(i == len)
+      return i;
+
+    size_t nbytes = plain_utf8(bytes + i, len - i);
+    if(!nbytes)
+      return i;
+
+    i += nbytes;
+  }
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+/* UTF-8 validation by table lookups on nibbles of each byte and the one
+ * before it, after Keiser and Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte" (2021). Each bit in the tables stands for one kind of
+ * error; a pair of bytes is wrong when all three lookups agree on some bit.
+ */
+#define U8_TOO_SHORT      (1 << 0)  /* a lead, then ASCII or another lead */
+#define U8_TOO_LONG       (1 << 1)  /* ASCII, then a continuation */
+#define U8_OVERLONG_3     (1 << 2)  /* E0 80..9F */
+#define U8_TOO_LARGE      (1 << 3)  /* F4 90..BF, F5..FF 90..BF */
+#define U8_SURROGATE      (1 << 4)  /* ED A0..BF */
+#define U8_OVERLONG_2     (1 << 5)  /* C0..C1, then a continuation */
+#define U8_TOO_LARGE_1000 (1 << 6)  /* F5..FF 80..8F */
+#define U8_OVERLONG_4     (1 << 6)  /* F0 80..8F */
+#define U8_TWO_CONTS      (1 << 7)  /* a continuation after a continuation */
+#define U8_CARRY (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+#define U8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+__attribute__((target("avx2")))
+static size_t text_run_avx2(const unsigned char *bytes, size_t len, unsigned char first)
+{
+  const __m256i byte_1_high = U8_TABLE(
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+    U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+    U8_TOO_SHORT | U8_OVERLONG_2,
+    U8_TOO_SHORT,
+    U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+    U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+
+  const __m256i byte_1_low = U8_TABLE(
+    U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+    U8_CARRY | U8_OVERLONG_2,
+    U8_CARRY,
+    U8_CARRY,
+    U8_CARRY | U8_TOO_LARGE,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000);
+
+  const __m256i byte_2_high = U8_TABLE(
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE  | U8_TOO_LARGE,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE  | U8_TOO_LARGE,
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i top    = _mm256_set1_epi8((char)0x80);
+
+  __m256i prev_input = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for(; len - i >= 32; i += 32) {
+    __m256i input = _mm256_loadu_si256((const __m256i *)(bytes + i));
+
+    /* Control characters and DEL go through the drivers, and so may space */
+    __m256i error = _mm256_andnot_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8(first - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), input)),
+        _mm256_cmpgt_epi8(input, _mm256_set1_epi8(-1)));
+
+    /* The bytes one, two and three before each of input's */
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+
+    if(!_mm256_movemask_epi8(_mm256_or_si256(input, prev1))) {
+      /* Plain ASCII, and nothing left unfinished before it */
+      if(!_mm256_testz_si256(error, error))
+        break;
+      prev_input = input;
+      continue;
+    }
+
+    __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+          _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+          _mm256_shuffle_epi8(byte_1_low,  _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+    /* The third and fourth bytes of a sequence must be continuations, which
+     * the lookups above cannot see */
+    __m256i must23 = _mm256_and_si256(
+        _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))),
+                        _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)))),
+        top);
+
+    error = _mm256_or_si256(error, _mm256_xor_si256(special, must23));
+
+    /* C1 controls: C2 80..9F */
+    error = _mm256_or_si256(error, _mm256_and_si256(
+        _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8((char)0xc2)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8((char)0xa0), input)));
+
+    /* Noncharacters U+FFFE and U+FFFF: EF BF BE..BF */
+    error = _mm256_or_si256(error, _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi8(prev2, _mm256_set1_epi8((char)0xef)),
+                         _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8((char)0xbf))),
+        _mm256_cmpeq_epi8(_mm256_or_si256(input, _mm256_set1_epi8(1)), _mm256_set1_epi8((char)0xbf))));
+
+    if(!_mm256_testz_si256(error, error))
+      break;
+
+    prev_input = input;
+  }
+
+  /* GCC leaves this out of functions that only have AVX as their target, and
+   * the SSE code that runs next would pay for it on every instruction
+   */
+  _mm256_zeroupper();
+
+  /* Everything before i is valid, but the last sequence may still continue
+   * past it; if so, go back to its lead byte and let the generic code decide
+   */
+  for(size_t back = 1; back <= 3 && back <= i; back++) {
+    unsigned char b = bytes[i - back];
+    if(b < 0x80)
+      break;
+    if(b >= 0xc0) {
+      i -= back;
+      break;
+    }
+  }
+
+  return i + text_run_generic(bytes + i, len - i, first);
+}
+
+static int have_avx2(void)
+{
+  static int supported = -1;
+
+  if(supported < 0) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+
+  return supported;
+}
+#endif
+
+/* Length of the leading run of bytes that getkeys_text() can decode without
+ * any further checks: printable ASCII as ascii_run() takes it, and plain
+ * UTF-8 characters as plain_utf8() describes them
+ */
+static size_t text_run(const unsigned char *bytes, size_t len, unsigned char first)
+{
+#ifdef HAVE_AVX2_DISPATCH
+  if(len >= 32 && have_avx2())
+    return text_run_avx2(bytes, len, first);
+#endif
+
+  return text_run_generic(bytes, len, first);
+}
+
+/* Decodes a run of plain text straight out of the buffer without asking the
+ * drivers. Normally no driver sequence starts with a printable ASCII byte or a
+ * UTF-8 lead byte, so the run stops at the first byte that isn't one of
+ * those; a driver that does have such keys sets tk->text_keys to turn this off.
+ */
+static size_t getkeys_text(TermKey *tk, TermKeyKey *keys, size_t n)
+{
+  int utf8 = tk->flags & TERMKEY_FLAG_UTF8;
+  /* Space stays text unless it canonicalises to a keysym */
+  unsigned char first = tk->canonflags & TERMKEY_CANON_SPACESYMBOL ? 0x21 : 0x20;
+  size_t count = 0;
+  size_t pos = 0;
+
+  while(count < n && pos < tk->buffcount) {
+    size_t idx = termkey_buffer_index(tk, pos);
+    size_t seglen = tk->buffsize - idx;
+    if(seglen > tk->buffcount - pos)
+      seglen = tk->buffcount - pos;
+    if(seglen > n - count)
+      seglen = n - count;
+
+    const unsigned char *bytes = tk->buffer + idx;
+    size_t run = utf8 ? text_run(bytes, seglen, first) : ascii_run(bytes, seglen, first);
+
+    for(size_t i = 0; i < run; count++) {
+      TermKeyKey *key = keys + count;
+      unsigned char b = bytes[i];
+
+      key->type = TERMKEY_TYPE_UNICODE;
+      key->modifiers = 0;
+
+      if(b < 0x80) {
+        key->code.codepoint = b;
+        key->utf8[0] = b;
+        key->utf8[1] = 0;
+        i++;
+        continue;
+      }
+
+      /* Already validated, so the lead byte alone gives the length; the
+       * bytes are kept as they came rather than encoding the codepoint again */
+      size_t nbytes = b < 0xe0 ? 2 : b < 0xf0 ? 3 : 4;
+      long codepoint = b & (0x7f >> nbytes);
+      for(size_t j = 1; j < nbytes; j++)
+        codepoint = (codepoint << 6) | (bytes[i + j] & 0x3f);
+
+      key->code.codepoint = codepoint;
+      memcpy(key->utf8, bytes + i, nbytes);
+      key->utf8[nbytes] = 0;
+      i += nbytes;
+    }
+
+    pos += run;
+    if(run == seglen)
+      continue;
+
+    unsigned char b = CHARAT(pos);
+    TermKeyKey *key = keys + count;
+
+    if(b == 0x20) {
+      // Space may canonicalise to a keysym
+      (*tk->method.emit_codepoint)(tk, b, key);
+      pos++;
+    }
+    else if(b >= 0xc0 && utf8) {
+      long codepoint;
+      size_t nbytes;
+      if(parse_utf8_at(tk, pos, &codepoint, &nbytes) != TERMKEY_RES_KEY)
+        break;
+
+      if(codepoint >= 0xa0 && codepoint != UTF8_INVALID) {
+        /* Nothing to canonicalise; keep the bytes as they came rather than
+         * encoding the codepoint again */
+        key->type = TERMKEY_TYPE_UNICODE;
+        key->code.codepoint = codepoint;
+        key->modifiers = 0;
+        termkey_buffer_copy(tk, pos, key->utf8, nbytes);
+        key->utf8[nbytes] = 0;
+      }
+      else
+        (*tk->method.emit_codepoint)(tk, codepoint, key);
+      pos += nbytes;
+    }
+    else
+      break;
+
+    count++;
+  }
+
+  eat_bytes(tk, pos);
+  return count;
+}
+
+TermKeyResult termkey_getkeys(TermKey *tk, TermKeyKey *keys, size_t n, size_t *nkeysp)
+{
+  TermKeyResult ret;
+  size_t count = 0;
+
+  if(!tk->is_started) {
+    errno = EINVAL;
+    ret = TERMKEY_RES_ERROR;
+    goto done;
+  }
+
+  while(1) {
+    if(tk->hightide) {
+      termkey_buffer_skip(tk, tk->hightide);
+      tk->hightide = 0;
+    }
+
+    if(!tk->capture && !tk->text_keys)
+      count += getkeys_text(tk, keys + count, n - count);
+
+    if(count == n) {
+      ret = n ? TERMKEY_RES_KEY : TERMKEY_RES_NONE;
+      break;
+    }
+
+    size_t nbytes = 0;
+    ret = peekkey(tk, keys + count, 0, &nbytes);
+    if(ret != TERMKEY_RES_KEY)
+      break;
+
+    eat_bytes(tk, nbytes);
+
+    /* These keys refer to state that the next key would overwrite, so the
+     * caller has to see them before anything else is decoded */
+    switch(keys[count++].type) {
+      case TERMKEY_TYPE_UNKNOWN_CSI:
+      case TERMKEY_TYPE_DCS:
+      case TERMKEY_TYPE_OSC:
+      case TERMKEY_TYPE_PASTE:
+        goto done;
+      default:
+        break;
+    }
+  }
+
+done:
+  *nkeysp = count;
+  return ret;
+}
+
 TermKeyResult termkey_getkey_force(TermKey *tk, TermKeyKey *key)
 {
   size_t nbytes = 0;
@@ -1115,19 +1571,33 @@ TermKeyResult termkey_advisereadable(TermKey *tk)
     return TERMKEY_RES_ERROR;
   }
 
-  if(tk->buffstart) {
-    memmove(tk->buffer, tk->buffer + tk->buffstart, tk->buffcount);
-    tk->buffstart = 0;
-  }
-
-  /* Not expecting it ever to be greater but doesn't hurt to handle that */
-  if(tk->buffcount >= tk->buffsize) {
+  /* Grow rather than refuse to read when the buffer is full */
+  if(!reserve_buffer(tk, 1)) {
     errno = ENOMEM;
     return TERMKEY_RES_ERROR;
   }
 
+  /* The free space is at most two runs: from the end of the data up to the
+   * end of the ring (or up to buffstart), then from the start of the ring up
+   * to buffstart */
+  struct iovec iov[2];
+  int iovcnt = 1;
+  size_t tail = termkey_buffer_index(tk, tk->buffcount);
+
+  iov[0].iov_base = tk->buffer + tail;
+  if(tail < tk->buffstart)
+    iov[0].iov_len = tk->buffstart - tail;
+  else {
+    iov[0].iov_len = tk->buffsize - tail;
+    if(tk->buffstart) {
+      iov[1].iov_base = tk->buffer;
+      iov[1].iov_len  = tk->buffstart;
+      iovcnt = 2;
+    }
+  }
+
 retry:
-  len = read(tk->fd, tk->buffer + tk->buffcount, tk->buffsize - tk->buffcount);
+  len = readv(tk->fd, iov, iovcnt);
 
   if(len == -1) {
     if(errno == EAGAIN)
@@ -1149,22 +1619,19 @@ retry:
 
 size_t termkey_push_bytes(TermKey *tk, const char *bytes, size_t len)
 {
-  if(tk->buffstart) {
-    memmove(tk->buffer, tk->buffer + tk->buffstart, tk->buffcount);
-    tk->buffstart = 0;
-  }
-
-  /* Not expecting it ever to be greater but doesn't hurt to handle that */
-  if(tk->buffcount >= tk->buffsize) {
+  if(!reserve_buffer(tk, len)) {
     errno = ENOMEM;
     return (size_t)-1;
   }
 
-  if(len > tk->buffsize - tk->buffcount)
-    len = tk->buffsize - tk->buffcount;
+  size_t tail = termkey_buffer_index(tk, tk->buffcount);
+  size_t first = tk->buffsize - tail;
+  if(first > len)
+    first = len;
 
   // memcpy(), not strncpy() in case of null bytes in input
-  memcpy(tk->buffer + tk->buffcount, bytes, len);
+  memcpy(tk->buffer + tail, bytes, first);
+  memcpy(tk->buffer, bytes + first, len - first);
   tk->buffcount += len;
 
   return len;
@@ -1404,6 +1871,9 @@ size_t termkey_strfkey(TermKey *tk, char *buffer, size_t len, TermKeyKey *key, T
   case TERMKEY_TYPE_OSC:
     l = snprintf(buffer + pos, len - pos, "OSC");
     break;
+  case TERMKEY_TYPE_PASTE:
+    l = snprintf(buffer + pos, len - pos, "Paste");
+    break;
   case TERMKEY_TYPE_UNKNOWN_CSI:
     l = snprintf(buffer + pos, len - pos, "CSI %c", key->code.number & 0xff);
     break;
@@ -1534,6 +2004,7 @@ int termkey_keycmp(TermKey *tk, const TermKeyKey *key1p, const TermKeyKey *key2p
       break;
     case TERMKEY_TYPE_DCS:
     case TERMKEY_TYPE_OSC:
+    case TERMKEY_TYPE_PASTE:
       return key1p - key2p;
     case TERMKEY_TYPE_MODEREPORT:
       {
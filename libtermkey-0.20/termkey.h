@@ -100,6 +100,7 @@ typedef enum {
   TERMKEY_TYPE_MODEREPORT,
   TERMKEY_TYPE_DCS,
   TERMKEY_TYPE_OSC,
+  TERMKEY_TYPE_PASTE,
   /* add other recognised types here */
 
   TERMKEY_TYPE_UNKNOWN_CSI = -1
@@ -197,6 +198,7 @@ void termkey_canonicalise(TermKey *tk, TermKeyKey *key);
 
 TermKeyResult termkey_getkey(TermKey *tk, TermKeyKey *key);
 TermKeyResult termkey_getkey_force(TermKey *tk, TermKeyKey *key);
+TermKeyResult termkey_getkeys(TermKey *tk, TermKeyKey *keys, size_t n, size_t *nkeysp);
 TermKeyResult termkey_waitkey(TermKey *tk, TermKeyKey *key);
 
 TermKeyResult termkey_advisereadable(TermKey *tk);
@@ -218,6 +220,7 @@ TermKeyResult termkey_interpret_modereport(TermKey *tk, const TermKeyKey *key, i
 TermKeyResult termkey_interpret_csi(TermKey *tk, const TermKeyKey *key, long args[], size_t *nargs, unsigned long *cmd);
 
 TermKeyResult termkey_interpret_string(TermKey *tk, const TermKeyKey *key, const char **strp);
+TermKeyResult termkey_interpret_string_len(TermKey *tk, const TermKeyKey *key, const char **strp, size_t *lenp);
 
 typedef enum {
   TERMKEY_FORMAT_LONGMOD     = 1 << 0, /* Shift-... instead of S-... */
@@ -17,6 +17,7 @@ extern "C" {
  * Top-level object / structure types
  */
 
+typedef struct TickitLoop TickitLoop;
 typedef struct TickitPen TickitPen;
 typedef struct TickitRectSet TickitRectSet;
 typedef struct TickitRenderBuffer TickitRenderBuffer;
@@ -94,6 +95,7 @@ typedef enum {
   TICKIT_TERMCTL_ICONTITLE_TEXT,
   TICKIT_TERMCTL_KEYPAD_APP,
   TICKIT_TERMCTL_COLORS, // read-only
+  TICKIT_TERMCTL_BRACKETED_PASTE,
 } TickitTermCtl;
 
 typedef enum {
@@ -143,6 +145,7 @@ typedef enum {
   TICKIT_EV_GEOMCHANGE = 0x10,
   TICKIT_EV_EXPOSE     = 0x20,
   TICKIT_EV_FOCUS      = 0x40,
+  TICKIT_EV_PASTE      = 0x80,
 
   TICKIT_EV_DESTROY = 0x40000000, // object is being destroyed
   TICKIT_EV_UNBIND  = 0x80000000, // event handler is being unbound
@@ -190,6 +193,28 @@ typedef struct {
   int line, col;
 } TickitMouseEventInfo;
 
+/* TICKIT_EV_PASTE */
+typedef struct {
+  const char *str;
+  size_t len;
+} TickitPasteEventInfo;
+
+/* A queued terminal event; see tickit_term_set_event_queue() */
+typedef struct {
+  TickitEventType ev; // one of TICKIT_EV_KEY, TICKIT_EV_MOUSE, TICKIT_EV_PASTE or TICKIT_EV_RESIZE
+  union {
+    TickitResizeEventInfo resize;
+    TickitMouseEventInfo  mouse;
+    TickitPasteEventInfo  paste; // str stays valid until the next tickit_term_get_events()
+    struct {
+      TickitKeyEventType type;
+      int mod;
+      long codepoint; // TICKIT_KEYEV_TEXT only
+      char str[32];   // inline copy of what TickitKeyEventInfo.str points at
+    } key;
+  } info;
+} TickitTermEvent;
+
 /* TICKIT_EV_GEOMCHANGE */
 typedef struct {
   TickitRect rect;
@@ -222,6 +247,18 @@ typedef int TickitTermEventFn(TickitTerm *tt, TickitEventType ev, void *info, vo
 
 typedef int TickitWindowEventFn(TickitWindow *win, TickitEventType ev, void *info, void *user);
 
+typedef enum {
+  TICKIT_LOOP_FIRE   = 0x01, // the watch has triggered
+  TICKIT_LOOP_UNBIND = 0x02, // the watch is being removed; last call for it
+
+  /* I/O conditions; both requested when watching and reported on firing */
+  TICKIT_LOOP_IN  = 0x10,
+  TICKIT_LOOP_OUT = 0x20,
+  TICKIT_LOOP_HUP = 0x40,
+} TickitLoopFlags;
+
+typedef int TickitLoopWatchFn(TickitLoop *loop, TickitLoopFlags flags, void *user);
+
 /*
  * Functions
  */
@@ -374,6 +411,9 @@ bool tickit_term_setctl_str(TickitTerm *tt, TickitTermCtl ctl, const char *value
 void tickit_term_emit_key(TickitTerm *tt, TickitKeyEventInfo *info);
 void tickit_term_emit_mouse(TickitTerm *tt, TickitMouseEventInfo *info);
 
+void   tickit_term_set_event_queue(TickitTerm *tt, bool queue);
+size_t tickit_term_get_events(TickitTerm *tt, TickitTermEvent *events, size_t n);
+
 /* String handling utilities */
 
 int tickit_string_seqlen(long codepoint);
@@ -572,6 +612,25 @@ void tickit_window_take_focus(TickitWindow *win);
 bool tickit_window_is_focused(const TickitWindow *win);
 void tickit_window_set_focus_child_notify(TickitWindow *win, bool notify);
 
+/* TickitLoop */
+
+TickitLoop *tickit_loop_new(void);
+void tickit_loop_destroy(TickitLoop *loop);
+
+void tickit_loop_set_term(TickitLoop *loop, TickitTerm *tt);
+void tickit_loop_set_root_window(TickitLoop *loop, TickitWindow *root);
+
+int  tickit_loop_watch_io(TickitLoop *loop, int fd, TickitLoopFlags cond,
+    TickitLoopWatchFn *fn, void *user);
+int  tickit_loop_watch_timer_msec(TickitLoop *loop, long msec,
+    TickitLoopWatchFn *fn, void *user);
+int  tickit_loop_watch_later(TickitLoop *loop, TickitLoopWatchFn *fn, void *user);
+void tickit_loop_cancel(TickitLoop *loop, int id);
+
+void tickit_loop_run_once(TickitLoop *loop, long msec);
+void tickit_loop_run(TickitLoop *loop);
+void tickit_loop_stop(TickitLoop *loop);
+
 /* Debug support */
 
 void tickit_debug_init(void);
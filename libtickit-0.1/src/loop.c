@@ -0,0 +1,572 @@
+/* We need epoll_pwait and clock_gettime */
+#define _GNU_SOURCE
+
+#include "tickit.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+
+/* Timers live on a hierarchical wheel of WHEEL_LEVELS levels of WHEEL_SLOTS
+ * slots each. Level 0 slots are one millisecond wide; every slot of a higher
+ * level spans an entire revolution of the level below it, and its timers get
+ * cascaded down when the wheel reaches it. Timers further away than the whole
+ * wheel spans are parked in the outermost level and cascaded until they fit.
+ */
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN   ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* Watch IDs carry a generation count above the table index, so a stale ID of
+ * a watch that has already gone cannot cancel whatever reused its slot
+ */
+#define ID_INDEX_BITS 20
+#define ID_INDEX_MASK ((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK   0x7FF
+
+#define MAX_EVENTS 32
+
+typedef enum {
+  WATCH_IO,
+  WATCH_TIMER,
+  WATCH_LATER,
+} WatchType;
+
+struct Watch {
+  int       id;
+  WatchType type;
+
+  /* Links in the timer slot or the later queue */
+  struct Watch  *next;
+  struct Watch **pprev;
+
+  int      fd;       /* WATCH_IO */
+  uint64_t expires;  /* WATCH_TIMER; absolute msec on the loop clock */
+
+  TickitLoopWatchFn *fn;
+  void              *user;
+};
+
+struct TickitLoop {
+  int epfd;
+
+  struct Watch **watches;  /* indexed by the low bits of the ID, minus one */
+  size_t        *freeidx;
+  size_t         nwatches;
+  size_t         nfree;
+  size_t         size;
+  int            generation;
+
+  struct Watch  *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+  size_t         ntimers;
+  uint64_t       now;  /* last tick processed by the wheel */
+
+  struct Watch  *later;
+  struct Watch **later_tail;
+
+  TickitTerm   *tt;
+  int           term_watch;
+  TickitWindow *root;
+
+  bool still_running;
+};
+
+static uint64_t clock_msec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void link_watch(struct Watch **headp, struct Watch *w)
+{
+  w->next = *headp;
+  if(w->next)
+    w->next->pprev = &w->next;
+
+  *headp = w;
+  w->pprev = headp;
+}
+
+static void unlink_watch(struct Watch *w)
+{
+  *w->pprev = w->next;
+  if(w->next)
+    w->next->pprev = w->pprev;
+
+  w->next  = NULL;
+  w->pprev = NULL;
+}
+
+static struct Watch *new_watch(TickitLoop *loop, WatchType type, TickitLoopWatchFn *fn, void *user)
+{
+  size_t index;
+
+  if(loop->nfree)
+    index = loop->freeidx[--loop->nfree];
+  else {
+    if(loop->nwatches == loop->size) {
+      size_t newsize = loop->size ? loop->size * 2 : 16;
+      if(newsize > ID_INDEX_MASK)
+        newsize = ID_INDEX_MASK;
+      if(newsize == loop->size) {
+        errno = ENOMEM;
+        return NULL;
+      }
+
+      struct Watch **watches = realloc(loop->watches, newsize * sizeof(loop->watches[0]));
+      if(!watches)
+        return NULL;
+      loop->watches = watches;
+
+      size_t *freeidx = realloc(loop->freeidx, newsize * sizeof(loop->freeidx[0]));
+      if(!freeidx)
+        return NULL;
+      loop->freeidx = freeidx;
+
+      loop->size = newsize;
+    }
+
+    index = loop->nwatches++;
+  }
+
+  struct Watch *w = malloc(sizeof(struct Watch));
+  if(!w) {
+    loop->freeidx[loop->nfree++] = index;
+    return NULL;
+  }
+
+  loop->generation = (loop->generation + 1) & ID_GEN_MASK;
+  if(!loop->generation)
+    loop->generation = 1;
+
+  w->id    = (loop->generation << ID_INDEX_BITS) | (int)(index + 1);
+  w->type  = type;
+  w->next  = NULL;
+  w->pprev = NULL;
+  w->fn    = fn;
+  w->user  = user;
+
+  loop->watches[index] = w;
+
+  return w;
+}
+
+static struct Watch *find_watch(TickitLoop *loop, int id)
+{
+  size_t index = (id & ID_INDEX_MASK) - 1;
+  if(id <= 0 || index >= loop->nwatches)
+    return NULL;
+
+  struct Watch *w = loop->watches[index];
+  if(!w || w->id != id)
+    return NULL;
+
+  return w;
+}
+
+/* Forgets the watch's ID; the memory itself is the caller's to free, which
+ * lets it still run the final callback with the ID already invalid
+ */
+static void release_watch(TickitLoop *loop, struct Watch *w)
+{
+  size_t index = (w->id & ID_INDEX_MASK) - 1;
+
+  loop->watches[index] = NULL;
+  loop->freeidx[loop->nfree++] = index;
+}
+
+static void wheel_insert(TickitLoop *loop, struct Watch *w)
+{
+  uint64_t when = w->expires;
+  if(when < loop->now)
+    when = loop->now;
+
+  uint64_t delta = when - loop->now;
+  if(delta >= WHEEL_SPAN) {
+    when  = loop->now + WHEEL_SPAN - 1;
+    delta = WHEEL_SPAN - 1;
+  }
+
+  int level = 0;
+  while(level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+    level++;
+
+  link_watch(&loop->wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK], w);
+}
+
+/* Returns the earliest tick at which the wheel has anything to do; either
+ * timers to fire or a slot to cascade
+ */
+static uint64_t wheel_next(TickitLoop *loop)
+{
+  uint64_t best = UINT64_MAX;
+
+  if(!loop->ntimers)
+    return best;
+
+  for(int level = 0; level < WHEEL_LEVELS; level++) {
+    int shift = WHEEL_BITS * level;
+    uint64_t pos = loop->now >> shift;
+
+    for(int i = 1; i <= WHEEL_SLOTS; i++) {
+      if(!loop->wheel[level][(pos + i) & WHEEL_MASK])
+        continue;
+
+      uint64_t at = (pos + i) << shift;
+      if(at < best)
+        best = at;
+      break;
+    }
+  }
+
+  return best;
+}
+
+static void wheel_step(TickitLoop *loop)
+{
+  uint64_t t = ++loop->now;
+
+  /* Cascade outermost first, so timers landing in a lower level's current
+   * slot are still found by that level's own cascade below
+   */
+  int top = 0;
+  while(top < WHEEL_LEVELS - 1 &&
+        !(t & (((uint64_t)1 << (WHEEL_BITS * (top + 1))) - 1)))
+    top++;
+
+  for(int level = top; level > 0; level--) {
+    struct Watch **slot = &loop->wheel[level][(t >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    struct Watch *w = *slot;
+    *slot = NULL;
+
+    while(w) {
+      struct Watch *next = w->next;
+      wheel_insert(loop, w);
+      w = next;
+    }
+  }
+
+  struct Watch **slot = &loop->wheel[0][t & WHEEL_MASK];
+  while(*slot) {
+    struct Watch *w = *slot;
+    unlink_watch(w);
+    loop->ntimers--;
+
+    release_watch(loop, w);
+    (*w->fn)(loop, TICKIT_LOOP_FIRE|TICKIT_LOOP_UNBIND, w->user);
+    free(w);
+  }
+}
+
+static void wheel_advance(TickitLoop *loop, uint64_t to)
+{
+  while(loop->now < to) {
+    uint64_t next = wheel_next(loop);
+    if(next > to) {
+      /* Nothing happens in between, so it's safe to skip straight there */
+      loop->now = to;
+      return;
+    }
+
+    loop->now = next - 1;
+    wheel_step(loop);
+  }
+}
+
+static void run_laters(TickitLoop *loop)
+{
+  /* Anything queued while these run waits for the next turn */
+  struct Watch *later = loop->later;
+  if(!later)
+    return;
+
+  later->pprev = &later;
+  loop->later = NULL;
+  loop->later_tail = &loop->later;
+
+  while(later) {
+    struct Watch *w = later;
+    unlink_watch(w);
+
+    release_watch(loop, w);
+    (*w->fn)(loop, TICKIT_LOOP_FIRE|TICKIT_LOOP_UNBIND, w->user);
+    free(w);
+  }
+}
+
+TickitLoop *tickit_loop_new(void)
+{
+  TickitLoop *loop = malloc(sizeof(TickitLoop));
+  if(!loop)
+    return NULL;
+
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(loop->epfd == -1)
+    goto abort_free;
+
+  loop->watches    = NULL;
+  loop->freeidx    = NULL;
+  loop->nwatches   = 0;
+  loop->nfree      = 0;
+  loop->size       = 0;
+  loop->generation = 0;
+
+  memset(loop->wheel, 0, sizeof(loop->wheel));
+  loop->ntimers = 0;
+  loop->now     = clock_msec();
+
+  loop->later      = NULL;
+  loop->later_tail = &loop->later;
+
+  loop->tt         = NULL;
+  loop->term_watch = 0;
+  loop->root       = NULL;
+
+  loop->still_running = false;
+
+  return loop;
+
+abort_free:
+  free(loop);
+  return NULL;
+}
+
+void tickit_loop_destroy(TickitLoop *loop)
+{
+  if(loop->root)
+    tickit_window_unref(loop->root);
+  if(loop->tt)
+    tickit_term_unref(loop->tt);
+
+  /* The internal terminal watch ignores UNBIND, so it needs no special case */
+  for(size_t i = 0; i < loop->nwatches; i++) {
+    struct Watch *w = loop->watches[i];
+    if(!w)
+      continue;
+
+    loop->watches[i] = NULL;
+    (*w->fn)(loop, TICKIT_LOOP_UNBIND, w->user);
+    free(w);
+  }
+
+  free(loop->watches);
+  free(loop->freeidx);
+
+  close(loop->epfd);
+
+  free(loop);
+}
+
+static int on_term_readable(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(!(flags & TICKIT_LOOP_FIRE))
+    return 0;
+
+  tickit_term_input_readable(loop->tt);
+
+  /* Stop polling a terminal that went away, rather than spin on it */
+  if(flags & TICKIT_LOOP_HUP) {
+    tickit_loop_cancel(loop, loop->term_watch);
+    loop->term_watch = 0;
+  }
+
+  return 1;
+}
+
+void tickit_loop_set_term(TickitLoop *loop, TickitTerm *tt)
+{
+  if(loop->term_watch) {
+    tickit_loop_cancel(loop, loop->term_watch);
+    loop->term_watch = 0;
+  }
+
+  if(loop->tt)
+    tickit_term_unref(loop->tt);
+
+  loop->tt = tt ? tickit_term_ref(tt) : NULL;
+
+  if(loop->tt && tickit_term_get_input_fd(tt) != -1) {
+    int id = tickit_loop_watch_io(loop, tickit_term_get_input_fd(tt), TICKIT_LOOP_IN, &on_term_readable, NULL);
+    loop->term_watch = id > 0 ? id : 0;
+  }
+}
+
+void tickit_loop_set_root_window(TickitLoop *loop, TickitWindow *root)
+{
+  if(loop->root)
+    tickit_window_unref(loop->root);
+
+  loop->root = root ? tickit_window_ref(root) : NULL;
+}
+
+int tickit_loop_watch_io(TickitLoop *loop, int fd, TickitLoopFlags cond,
+    TickitLoopWatchFn *fn, void *user)
+{
+  struct Watch *w = new_watch(loop, WATCH_IO, fn, user);
+  if(!w)
+    return -1;
+
+  w->fd = fd;
+
+  struct epoll_event ev = {
+    .events = ((cond & TICKIT_LOOP_IN)  ? EPOLLIN  : 0) |
+              ((cond & TICKIT_LOOP_OUT) ? EPOLLOUT : 0),
+    .data.u32 = w->id,
+  };
+
+  if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    int saved_errno = errno;
+    release_watch(loop, w);
+    free(w);
+    errno = saved_errno;
+    return -1;
+  }
+
+  return w->id;
+}
+
+int tickit_loop_watch_timer_msec(TickitLoop *loop, long msec,
+    TickitLoopWatchFn *fn, void *user)
+{
+  struct Watch *w = new_watch(loop, WATCH_TIMER, fn, user);
+  if(!w)
+    return -1;
+
+  w->expires = clock_msec() + (msec > 0 ? msec : 0);
+
+  /* The wheel may lag the clock, but must never be asked for the past */
+  if(w->expires <= loop->now)
+    w->expires = loop->now + 1;
+
+  wheel_insert(loop, w);
+  loop->ntimers++;
+
+  return w->id;
+}
+
+int tickit_loop_watch_later(TickitLoop *loop, TickitLoopWatchFn *fn, void *user)
+{
+  struct Watch *w = new_watch(loop, WATCH_LATER, fn, user);
+  if(!w)
+    return -1;
+
+  w->pprev = loop->later_tail;
+  *loop->later_tail = w;
+  loop->later_tail = &w->next;
+
+  return w->id;
+}
+
+void tickit_loop_cancel(TickitLoop *loop, int id)
+{
+  struct Watch *w = find_watch(loop, id);
+  if(!w)
+    return;
+
+  switch(w->type) {
+  case WATCH_IO:
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+    break;
+  case WATCH_TIMER:
+    unlink_watch(w);
+    loop->ntimers--;
+    break;
+  case WATCH_LATER:
+    if(loop->later_tail == &w->next)
+      loop->later_tail = w->pprev;
+    unlink_watch(w);
+    break;
+  }
+
+  release_watch(loop, w);
+  (*w->fn)(loop, TICKIT_LOOP_UNBIND, w->user);
+  free(w);
+}
+
+void tickit_loop_run_once(TickitLoop *loop, long msec)
+{
+  /* Whatever the previous turn damaged gets drawn exactly once, here */
+  if(loop->root)
+    tickit_window_flush(loop->root);
+  if(loop->tt)
+    tickit_term_flush(loop->tt);
+
+  /* SIGWINCH stays blocked everywhere but inside the wait itself, so a resize
+   * can never slip in between checking for it and going to sleep
+   */
+  sigset_t winch, oldmask;
+  sigemptyset(&winch);
+  sigaddset(&winch, SIGWINCH);
+  sigprocmask(SIG_BLOCK, &winch, &oldmask);
+
+  long timeout = msec;
+
+  if(loop->later)
+    timeout = 0;
+
+  if(loop->tt) {
+    int termwait = tickit_term_input_check_timeout_msec(loop->tt);
+    if(termwait > -1 && (timeout == -1 || termwait < timeout))
+      timeout = termwait;
+  }
+
+  if(loop->ntimers && timeout != 0) {
+    uint64_t now  = clock_msec();
+    uint64_t next = wheel_next(loop);
+    long wait = next > now ? (long)(next - now) : 0;
+    if(timeout == -1 || wait < timeout)
+      timeout = wait;
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  int n = epoll_pwait(loop->epfd, events, MAX_EVENTS, timeout > INT32_MAX ? -1 : (int)timeout, &oldmask);
+
+  sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+  for(int i = 0; i < n; i++) {
+    /* An earlier callback in this batch may have cancelled it */
+    struct Watch *w = find_watch(loop, events[i].data.u32);
+    if(!w)
+      continue;
+
+    TickitLoopFlags flags = TICKIT_LOOP_FIRE;
+    if(events[i].events & EPOLLIN)
+      flags |= TICKIT_LOOP_IN;
+    if(events[i].events & EPOLLOUT)
+      flags |= TICKIT_LOOP_OUT;
+    if(events[i].events & (EPOLLHUP|EPOLLERR))
+      flags |= TICKIT_LOOP_HUP;
+
+    (*w->fn)(loop, flags, w->user);
+  }
+
+  /* Fires any termkey timeout that has expired, and notices resizes */
+  if(loop->tt)
+    tickit_term_input_check_timeout_msec(loop->tt);
+
+  wheel_advance(loop, clock_msec());
+
+  run_laters(loop);
+}
+
+void tickit_loop_run(TickitLoop *loop)
+{
+  loop->still_running = true;
+
+  while(loop->still_running)
+    tickit_loop_run_once(loop, -1);
+}
+
+void tickit_loop_stop(TickitLoop *loop)
+{
+  loop->still_running = false;
+}
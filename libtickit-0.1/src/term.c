@@ -74,12 +74,62 @@ struct TickitTerm {
   int colors;
   TickitPen *pen;
 
+  /* Ring of events held back for tickit_term_get_events() */
+  bool queue_events;
+  TickitTermEvent *evqueue;
+  size_t evqueue_size; /* power of two, or 0 */
+  size_t evqueue_head;
+  size_t evqueue_count;
+
+  /* Paste bodies handed out by the last tickit_term_get_events() */
+  char **lent_pastes;
+  size_t lent_pastes_count;
+  size_t lent_pastes_size;
+
   int refcount;
   struct TickitHooklist hooks;
 };
 
 DEFINE_HOOKLIST_FUNCS(term,TickitTerm,TickitTermEventFn)
 
+static void free_lent_pastes(TickitTerm *tt)
+{
+  for(size_t i = 0; i < tt->lent_pastes_count; i++)
+    free(tt->lent_pastes[i]);
+
+  tt->lent_pastes_count = 0;
+}
+
+/* Returns a fresh slot at the tail of the event queue, or NULL if it could
+ * not be grown; the event is dropped in that case
+ */
+static TickitTermEvent *push_event(TickitTerm *tt, TickitEventType ev)
+{
+  if(tt->evqueue_count == tt->evqueue_size) {
+    size_t newsize = tt->evqueue_size ? tt->evqueue_size * 2 : 64;
+    TickitTermEvent *newqueue = malloc(newsize * sizeof(TickitTermEvent));
+    if(!newqueue)
+      return NULL;
+
+    /* Unwrap into the new buffer so the head restarts at 0 */
+    size_t first = tt->evqueue_size - tt->evqueue_head;
+    if(tt->evqueue_count) {
+      memcpy(newqueue, tt->evqueue + tt->evqueue_head, first * sizeof(TickitTermEvent));
+      memcpy(newqueue + first, tt->evqueue, tt->evqueue_head * sizeof(TickitTermEvent));
+    }
+
+    free(tt->evqueue);
+    tt->evqueue = newqueue;
+    tt->evqueue_size = newsize;
+    tt->evqueue_head = 0;
+  }
+
+  TickitTermEvent *qev =
+    &tt->evqueue[(tt->evqueue_head + tt->evqueue_count++) & (tt->evqueue_size - 1)];
+  qev->ev = ev;
+  return qev;
+}
+
 static TermKey *get_termkey(TickitTerm *tt)
 {
   if(!tt->termkey) {
@@ -158,6 +208,16 @@ TickitTerm *tickit_term_new_for_driver(TickitTermDriver *ttd)
   tt->next_sigwinch_observer = NULL;
   tt->window_changed = false;
 
+  tt->queue_events = false;
+  tt->evqueue = NULL;
+  tt->evqueue_size = 0;
+  tt->evqueue_head = 0;
+  tt->evqueue_count = 0;
+
+  tt->lent_pastes = NULL;
+  tt->lent_pastes_count = 0;
+  tt->lent_pastes_size = 0;
+
   tt->refcount = 1;
   tt->hooks = (struct TickitHooklist){ NULL };
 
@@ -227,6 +287,20 @@ void tickit_term_destroy(TickitTerm *tt)
   if(tt->termtype)
     free(tt->termtype);
 
+  if(tt->evqueue) {
+    for(size_t i = 0; i < tt->evqueue_count; i++) {
+      TickitTermEvent *qev = &tt->evqueue[(tt->evqueue_head + i) & (tt->evqueue_size - 1)];
+      if(qev->ev == TICKIT_EV_PASTE)
+        free((char *)qev->info.paste.str);
+    }
+
+    free(tt->evqueue);
+  }
+
+  free_lent_pastes(tt);
+  if(tt->lent_pastes)
+    free(tt->lent_pastes);
+
   free(tt);
 }
 
@@ -290,6 +364,14 @@ void tickit_term_set_size(TickitTerm *tt, int lines, int cols)
     tt->cols  = cols;
 
     TickitResizeEventInfo info = { .lines = lines, .cols = cols };
+
+    /* Windows track the terminal size through their own handlers, so a
+     * queued resize is still run through the chain as well
+     */
+    TickitTermEvent *qev;
+    if(tt->queue_events && (qev = push_event(tt, TICKIT_EV_RESIZE)))
+      qev->info.resize = info;
+
     run_events(tt, TICKIT_EV_RESIZE, &info);
   }
 }
@@ -498,6 +580,60 @@ void tickit_term_await_started_tv(TickitTerm *tt, const struct timeval *timeout)
   tt->state = STARTED;
 }
 
+static void emit_key(TickitTerm *tt, TickitKeyEventInfo *info, long codepoint)
+{
+  TickitTermEvent *qev;
+  if(!tt->queue_events) {
+    run_events_whilefalse(tt, TICKIT_EV_KEY, info);
+    return;
+  }
+
+  if(!(qev = push_event(tt, TICKIT_EV_KEY)))
+    return;
+
+  qev->info.key.type      = info->type;
+  qev->info.key.mod       = info->mod;
+  qev->info.key.codepoint = codepoint;
+  strncpy(qev->info.key.str, info->str, sizeof(qev->info.key.str) - 1);
+  qev->info.key.str[sizeof(qev->info.key.str) - 1] = 0;
+}
+
+static void emit_mouse(TickitTerm *tt, TickitMouseEventInfo *info)
+{
+  TickitTermEvent *qev;
+  if(!tt->queue_events)
+    run_events_whilefalse(tt, TICKIT_EV_MOUSE, info);
+  else if((qev = push_event(tt, TICKIT_EV_MOUSE)))
+    qev->info.mouse = *info;
+}
+
+static void emit_paste(TickitTerm *tt, const char *str, size_t len)
+{
+  TickitPasteEventInfo info = { .str = str, .len = len };
+
+  if(!tt->queue_events) {
+    run_events_whilefalse(tt, TICKIT_EV_PASTE, &info);
+    return;
+  }
+
+  /* termkey's copy only lasts until the next key, so the queue needs its own */
+  char *copy = malloc(len + 1);
+  if(!copy)
+    return;
+
+  memcpy(copy, str, len);
+  copy[len] = 0;
+
+  TickitTermEvent *qev = push_event(tt, TICKIT_EV_PASTE);
+  if(!qev) {
+    free(copy);
+    return;
+  }
+
+  qev->info.paste.str = copy;
+  qev->info.paste.len = len;
+}
+
 static void got_key(TickitTerm *tt, TermKey *tk, TermKeyKey *key)
 {
   if(tt->driver->vtable->gotkey &&
@@ -525,7 +661,13 @@ static void got_key(TickitTerm *tt, TermKey *tk, TermKeyKey *key)
 
     info.mod = key->modifiers;
 
-    run_events_whilefalse(tt, TICKIT_EV_MOUSE, &info);
+    emit_mouse(tt, &info);
+  }
+  else if(key->type == TERMKEY_TYPE_PASTE) {
+    const char *str;
+    size_t len;
+    if(termkey_interpret_string_len(tk, key, &str, &len) == TERMKEY_RES_KEY)
+      emit_paste(tt, str, len);
   }
   else if(key->type == TERMKEY_TYPE_UNICODE && !key->modifiers) {
     /* Unmodified unicode */
@@ -535,7 +677,7 @@ static void got_key(TickitTerm *tt, TermKey *tk, TermKeyKey *key)
       .mod  = key->modifiers,
     };
 
-    run_events_whilefalse(tt, TICKIT_EV_KEY, &info);
+    emit_key(tt, &info, key->code.codepoint);
   }
   else if(key->type == TERMKEY_TYPE_UNICODE ||
           key->type == TERMKEY_TYPE_FUNCTION ||
@@ -549,27 +691,78 @@ static void got_key(TickitTerm *tt, TermKey *tk, TermKeyKey *key)
       .mod  = key->modifiers,
     };
 
-    run_events_whilefalse(tt, TICKIT_EV_KEY, &info);
+    emit_key(tt, &info, -1);
   }
 }
 
 void tickit_term_emit_key(TickitTerm *tt, TickitKeyEventInfo *info)
 {
-  run_events_whilefalse(tt, TICKIT_EV_KEY, info);
+  emit_key(tt, info, -1);
 }
 
 void tickit_term_emit_mouse(TickitTerm *tt, TickitMouseEventInfo *info)
 {
-  run_events_whilefalse(tt, TICKIT_EV_MOUSE, info);
+  emit_mouse(tt, info);
+}
+
+void tickit_term_set_event_queue(TickitTerm *tt, bool queue)
+{
+  tt->queue_events = queue;
+}
+
+size_t tickit_term_get_events(TickitTerm *tt, TickitTermEvent *events, size_t n)
+{
+  free_lent_pastes(tt);
+
+  if(n > tt->evqueue_count)
+    n = tt->evqueue_count;
+  if(!n)
+    return 0;
+
+  size_t first = tt->evqueue_size - tt->evqueue_head;
+  if(first > n)
+    first = n;
+
+  memcpy(events, tt->evqueue + tt->evqueue_head, first * sizeof(TickitTermEvent));
+  if(n > first)
+    memcpy(events + first, tt->evqueue, (n - first) * sizeof(TickitTermEvent));
+
+  tt->evqueue_head   = (tt->evqueue_head + n) & (tt->evqueue_size - 1);
+  tt->evqueue_count -= n;
+
+  /* The caller may keep reading paste bodies until it asks for more events */
+  for(size_t i = 0; i < n; i++) {
+    if(events[i].ev != TICKIT_EV_PASTE)
+      continue;
+
+    if(tt->lent_pastes_count == tt->lent_pastes_size) {
+      size_t newsize = tt->lent_pastes_size ? tt->lent_pastes_size * 2 : 4;
+      char **newlent = realloc(tt->lent_pastes, newsize * sizeof(char *));
+      if(!newlent) {
+        /* Better to leak it than to free it from under the caller */
+        continue;
+      }
+
+      tt->lent_pastes = newlent;
+      tt->lent_pastes_size = newsize;
+    }
+
+    tt->lent_pastes[tt->lent_pastes_count++] = (char *)events[i].info.paste.str;
+  }
+
+  return n;
 }
 
 static void get_keys(TickitTerm *tt, TermKey *tk)
 {
   TermKeyResult res;
-  TermKeyKey key;
-  while((res = termkey_getkey(tk, &key)) == TERMKEY_RES_KEY) {
-    got_key(tt, tk, &key);
-  }
+  TermKeyKey keys[64];
+  size_t nkeys;
+  do {
+    res = termkey_getkeys(tk, keys, sizeof(keys)/sizeof(keys[0]), &nkeys);
+    for(size_t i = 0; i < nkeys; i++)
+      got_key(tt, tk, &keys[i]);
+  } while(res == TERMKEY_RES_KEY);
 
   if(res == TERMKEY_RES_AGAIN) {
     struct timeval tv;
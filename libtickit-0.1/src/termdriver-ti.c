@@ -16,6 +16,9 @@ struct TermInfoExtraStrings {
 
   const char *enter_mouse_mode;
   const char *exit_mouse_mode;
+
+  const char *enter_paste_mode;
+  const char *exit_paste_mode;
 };
 
 static const struct TermInfoExtraStrings extra_strings_default = {
@@ -33,6 +36,10 @@ static const struct TermInfoExtraStrings extra_strings_vt200_mouse = {
   // Also speculatively enable SGR protocol
   .enter_mouse_mode = "\e[?1002h\e[?1006h",
   .exit_mouse_mode  = "\e[?1002l\e[?1006l",
+
+  // Bracketed paste
+  .enter_paste_mode = "\e[?2004h",
+  .exit_paste_mode  = "\e[?2004l",
 };
 
 /* Also, some terminfo databases are incomplete. Lets provide some fallbacks
@@ -71,6 +78,153 @@ static const char *require_ti_string(unibi_term *ut, const char *termtype, enum
   abort();
 }
 
+/* Each capability is compiled once. Strings with one of the common simple
+ * shapes
+ *   lit0                        e.g. "\e[C"
+ *   lit0 %p1%d lit1             e.g. "\e[%p1%dA"
+ *   lit0 %p1%d lit1 %p2%d lit2  e.g. "\e[%i%p1%d;%p2%dH"
+ * (optionally with a %i before the first %p1) are then written directly;
+ * anything else runs through the compiled unibilium program.
+ */
+struct TICap {
+  unibi_prog *prog;
+
+  int nparams; // -1 if the string has no simple shape
+  bool incr;   // %i
+  const char *lit[3];
+  size_t litlen[3];
+};
+
+// Longest output of a simple shape must fit run_ti's buffer
+#define TICAP_MAXLIT 32
+
+static const char *scan_ti_literal(const char *s)
+{
+  while(*s && *s != '%' && *s != '$')
+    s++;
+  return s;
+}
+
+static void specialise_ti_cap(struct TICap *cap, const char *str)
+{
+  const char *s = str;
+
+  cap->nparams = -1;
+  cap->incr = false;
+
+  if(strncmp(s, "%i", 2) == 0) {
+    cap->incr = true;
+    s += 2;
+  }
+
+  size_t total = 0;
+  for(int i = 0; i < 3; i++) {
+    const char *end = scan_ti_literal(s);
+    cap->lit[i] = s;
+    cap->litlen[i] = end - s;
+    total += end - s;
+    s = end;
+
+    if(!*s) {
+      if(total <= TICAP_MAXLIT)
+        cap->nparams = i;
+      return;
+    }
+
+    if(i == 0 && !cap->incr && strncmp(s, "%i%p1%d", 7) == 0) {
+      cap->incr = true;
+      s += 2;
+    }
+
+    if(i == 2 || s[0] != '%' || s[1] != 'p' || s[2] != '1' + i || strncmp(s + 3, "%d", 2) != 0)
+      return;
+    s += 5;
+  }
+}
+
+static struct TICap *compile_ti(const char *str)
+{
+  if(!str)
+    return NULL;
+
+  struct TICap *cap = malloc(sizeof(struct TICap));
+  if(!cap)
+    return NULL;
+
+  if(!(cap->prog = unibi_compile(str))) {
+    free(cap);
+    return NULL;
+  }
+
+  specialise_ti_cap(cap, str);
+
+  return cap;
+}
+
+static void free_ti(struct TICap *cap)
+{
+  if(!cap)
+    return;
+
+  unibi_destroy_prog(cap->prog);
+  free(cap);
+}
+
+static struct TICap *lookup_ti_cap(unibi_term *ut, const char *termtype, enum unibi_string s)
+{
+  return compile_ti(lookup_ti_string(ut, termtype, s));
+}
+
+static struct TICap *require_ti_cap(unibi_term *ut, const char *termtype, enum unibi_string s, const char *name)
+{
+  return compile_ti(require_ti_string(ut, termtype, s, name));
+}
+
+/* Every capability the driver uses: its field in struct TIDriver, the
+ * terminfo string, and whether the terminal must have it. The struct, new()
+ * and destroy() all expand this list, so they cannot disagree.
+ */
+#define TI_CAPS(X) \
+  /* Positioning */ \
+  X(cup,    unibi_cursor_address,        1) /* cursor_address */ \
+  X(vpa,    unibi_row_address,           0) /* row_address == vertical position absolute */ \
+  X(hpa,    unibi_column_address,        0) /* column_address = horizontal position absolute */ \
+                                                                       \
+  /* Moving */ \
+  X(cuu,    unibi_parm_up_cursor,        1) /* Cursor Up */ \
+  X(cuu1,   unibi_cursor_up,             0) \
+  X(cud,    unibi_parm_down_cursor,      1) /* Cursor Down */ \
+  X(cud1,   unibi_cursor_down,           0) \
+  X(cuf,    unibi_parm_right_cursor,     1) /* Cursor Forward == Right */ \
+  X(cuf1,   unibi_cursor_right,          0) \
+  X(cub,    unibi_parm_left_cursor,      1) /* Cursor Backward == Left */ \
+  X(cub1,   unibi_cursor_left,           0) \
+                                                                       \
+  /* Editing */ \
+  X(ich,    unibi_parm_ich,              1) /* Insert Character */ \
+  X(ich1,   unibi_insert_character,      0) \
+  X(dch,    unibi_parm_dch,              1) /* Delete Character */ \
+  X(dch1,   unibi_delete_character,      0) \
+  X(il,     unibi_parm_insert_line,      1) /* Insert Line */ \
+  X(il1,    unibi_insert_line,           0) \
+  X(dl,     unibi_parm_delete_line,      1) /* Delete Line */ \
+  X(dl1,    unibi_delete_line,           0) \
+  X(ech,    unibi_erase_chars,           1) /* Erase Character */ \
+  X(ed2,    unibi_clear_screen,          1) /* Erase Data 2 == Clear screen */ \
+  X(stbm,   unibi_change_scroll_region,  1) /* Set Top/Bottom Margins */ \
+                                                                       \
+  /* Formatting */ \
+  X(sgr,    unibi_set_attributes,        1) /* Select Graphic Rendition */ \
+  X(sgr0,   unibi_exit_attribute_mode,   1) /* Exit Attribute Mode */ \
+  X(sgr_i0, unibi_exit_italics_mode,     0) /* SGR italic off */ \
+  X(sgr_i1, unibi_enter_italics_mode,    0) /* SGR italic on */ \
+  X(sgr_fg, unibi_set_a_foreground,      1) /* SGR foreground colour */ \
+  X(sgr_bg, unibi_set_a_background,      1) /* SGR background colour */ \
+                                                                       \
+  /* Mode setting/clearing */ \
+  X(sm_csr, unibi_cursor_normal,         1) /* Set mode: Cursor visible */ \
+  X(rm_csr, unibi_cursor_invisible,      1) /* Reset mode: Cursor visible */
+
 struct TIDriver {
   TickitTermDriver driver;
 
@@ -80,6 +234,7 @@ struct TIDriver {
     unsigned int altscreen:1;
     unsigned int cursorvis:1;
     unsigned int mouse:1;
+    unsigned int paste:1;
   } mode;
 
   struct {
@@ -88,35 +243,9 @@ struct TIDriver {
   } cap;
 
   struct {
-    // Positioning
-    const char *cup;  // cursor_address
-    const char *vpa;  // row_address == vertical position absolute
-    const char *hpa;  // column_address = horizontal position absolute
-
-    // Moving
-    const char *cuu; const char *cuu1; // Cursor Up
-    const char *cud; const char *cud1; // Cursor Down
-    const char *cuf; const char *cuf1; // Cursor Forward == Right
-    const char *cub; const char *cub1; // Cursor Backward == Left
-
-    // Editing
-    const char *ich; const char *ich1; // Insert Character
-    const char *dch; const char *dch1; // Delete Character
-    const char *il;  const char *il1;  // Insert Line
-    const char *dl;  const char *dl1;  // Delete Line
-    const char *ech;                   // Erase Character
-    const char *ed2;                   // Erase Data 2 == Clear screen
-    const char *stbm;                  // Set Top/Bottom Margins
-
-    // Formatting
-    const char *sgr;    // Select Graphic Rendition
-    const char *sgr0;   // Exit Attribute Mode
-    const char *sgr_i0, *sgr_i1; // SGR italic off/on
-    const char *sgr_fg; // SGR foreground colour
-    const char *sgr_bg; // SGR background colour
-
-    // Mode setting/clearing
-    const char *sm_csr; const char *rm_csr; // Set/reset mode: Cursor visible
+#define TI_CAP_FIELD(name, s, required) struct TICap *name;
+    TI_CAPS(TI_CAP_FIELD)
+#undef TI_CAP_FIELD
   } str;
 
   const struct TermInfoExtraStrings *extra;
@@ -128,27 +257,59 @@ static bool print(TickitTermDriver *ttd, const char *str, size_t len)
   return true;
 }
 
-static void run_ti(TickitTermDriver *ttd, const char *str, int n_params, ...)
+static char *put_ti_int(char *p, int v)
+{
+  char digits[12], *d = digits + sizeof(digits);
+  unsigned int u = v < 0 ? -(unsigned int)v : (unsigned int)v;
+
+  do
+    *--d = '0' + u % 10;
+  while(u /= 10);
+  if(v < 0)
+    *--d = '-';
+
+  size_t len = digits + sizeof(digits) - d;
+  memcpy(p, d, len);
+  return p + len;
+}
+
+static void run_ti(TickitTermDriver *ttd, const struct TICap *cap, int n_params, ...)
 {
   unibi_var_t params[9];
   va_list args;
 
-  if(!str) {
+  if(!cap) {
     fprintf(stderr, "Abort on attempt to use NULL TI string\n");
     abort();
   }
 
   va_start(args, n_params);
-  for(int i = 0; i < 10 && i < n_params; i++)
+  for(int i = 0; i < 9 && i < n_params; i++)
     params[i].i = va_arg(args, int);
+  va_end(args);
 
   char tmp[64];
   char *buf = tmp;
-  size_t len = unibi_run(str, params, buf, sizeof(tmp));
+  size_t len;
+
+  if(cap->nparams >= 0) {
+    // Same output unibi_run would give, without interpreting anything
+    char *p = buf;
+    for(int i = 0; i <= cap->nparams; i++) {
+      if(i > 0)
+        p = put_ti_int(p, i - 1 < n_params ? params[i - 1].i + cap->incr : cap->incr);
+      memcpy(p, cap->lit[i], cap->litlen[i]);
+      p += cap->litlen[i];
+    }
+    len = p - buf;
+  }
+  else {
+    len = unibi_run_prog(cap->prog, params, buf, sizeof(tmp));
 
-  if(len > sizeof(tmp)) {
-    buf = tickit_termdrv_get_tmpbuffer(ttd, len);
-    unibi_run(str, params, buf, len);
+    if(len > sizeof(tmp)) {
+      buf = tickit_termdrv_get_tmpbuffer(ttd, len);
+      unibi_run_prog(cap->prog, params, buf, len);
+    }
   }
 
   tickit_termdrv_write_str(ttd, buf, len);
@@ -358,6 +519,10 @@ static bool getctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int *value)
       *value = td->mode.mouse;
       return true;
 
+    case TICKIT_TERMCTL_BRACKETED_PASTE:
+      *value = td->mode.paste;
+      return true;
+
     case TICKIT_TERMCTL_COLORS:
       *value = td->cap.colours;
       return true;
@@ -402,6 +567,17 @@ static bool setctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int value)
       td->mode.mouse = !!value;
       return true;
 
+    case TICKIT_TERMCTL_BRACKETED_PASTE:
+      if(!td->extra->enter_paste_mode)
+        return false;
+
+      if(!td->mode.paste == !value)
+        return true;
+
+      tickit_termdrv_write_str(ttd, value ? td->extra->enter_paste_mode : td->extra->exit_paste_mode, 0);
+      td->mode.paste = !!value;
+      return true;
+
     default:
       return false;
   }
@@ -431,6 +607,8 @@ static void stop(TickitTermDriver *ttd)
 
   if(td->mode.mouse)
     setctl_int(ttd, TICKIT_TERMCTL_MOUSE, 0);
+  if(td->mode.paste)
+    setctl_int(ttd, TICKIT_TERMCTL_BRACKETED_PASTE, 0);
   if(!td->mode.cursorvis)
     setctl_int(ttd, TICKIT_TERMCTL_CURSORVIS, 1);
   if(td->mode.altscreen)
@@ -443,6 +621,10 @@ static void destroy(TickitTermDriver *ttd)
 {
   struct TIDriver *td = (struct TIDriver *)ttd;
 
+#define TI_CAP_FREE(name, s, required) free_ti(td->str.name);
+  TI_CAPS(TI_CAP_FREE)
+#undef TI_CAP_FREE
+
   unibi_destroy(td->ut);
 
   free(td);
@@ -467,7 +649,7 @@ static TickitTermDriverVTable ti_vtable = {
 
 static TickitTermDriver *new(const char *termtype)
 {
-  unibi_term *ut = unibi_from_term(termtype);
+  unibi_term *ut = unibi_from_term_cached(termtype);
   if(!ut)
     return NULL;
 
@@ -477,43 +659,17 @@ static TickitTermDriver *new(const char *termtype)
   td->ut = ut;
 
   td->mode.mouse = 0;
+  td->mode.paste = 0;
   td->mode.cursorvis = 1;
   td->mode.altscreen = 0;
 
   td->cap.bce = unibi_get_bool(ut, unibi_back_color_erase);
   td->cap.colours = unibi_get_num(ut, unibi_max_colors);
 
-  td->str.cup    = require_ti_string(ut, termtype, unibi_cursor_address, "cup");
-  td->str.vpa    = lookup_ti_string (ut, termtype, unibi_row_address);
-  td->str.hpa    = lookup_ti_string (ut, termtype, unibi_column_address);
-  td->str.cuu    = require_ti_string(ut, termtype, unibi_parm_up_cursor, "cuu");
-  td->str.cuu1   = lookup_ti_string (ut, termtype, unibi_cursor_up);
-  td->str.cud    = require_ti_string(ut, termtype, unibi_parm_down_cursor, "cud");
-  td->str.cud1   = lookup_ti_string (ut, termtype, unibi_cursor_down);
-  td->str.cuf    = require_ti_string(ut, termtype, unibi_parm_right_cursor, "cuf");
-  td->str.cuf1   = lookup_ti_string (ut, termtype, unibi_cursor_right);
-  td->str.cub    = require_ti_string(ut, termtype, unibi_parm_left_cursor, "cub");
-  td->str.cub1   = lookup_ti_string (ut, termtype, unibi_cursor_left);
-  td->str.ich    = require_ti_string(ut, termtype, unibi_parm_ich, "ich");
-  td->str.ich1   = lookup_ti_string (ut, termtype, unibi_insert_character);
-  td->str.dch    = require_ti_string(ut, termtype, unibi_parm_dch, "dch");
-  td->str.dch1   = lookup_ti_string (ut, termtype, unibi_delete_character);
-  td->str.il     = require_ti_string(ut, termtype, unibi_parm_insert_line, "il");
-  td->str.il1    = lookup_ti_string (ut, termtype, unibi_insert_line);
-  td->str.dl     = require_ti_string(ut, termtype, unibi_parm_delete_line, "dl");
-  td->str.dl1    = lookup_ti_string (ut, termtype, unibi_delete_line);
-  td->str.ech    = require_ti_string(ut, termtype, unibi_erase_chars, "ech");
-  td->str.ed2    = require_ti_string(ut, termtype, unibi_clear_screen, "ed2");
-  td->str.stbm   = require_ti_string(ut, termtype, unibi_change_scroll_region, "stbm");
-  td->str.sgr    = require_ti_string(ut, termtype, unibi_set_attributes, "sgr");
-  td->str.sgr0   = require_ti_string(ut, termtype, unibi_exit_attribute_mode, "sgr0");
-  td->str.sgr_i0 = lookup_ti_string(ut, termtype, unibi_exit_italics_mode);
-  td->str.sgr_i1 = lookup_ti_string(ut, termtype, unibi_enter_italics_mode);
-  td->str.sgr_fg = require_ti_string(ut, termtype, unibi_set_a_foreground, "sgr_fg");
-  td->str.sgr_bg = require_ti_string(ut, termtype, unibi_set_a_background, "sgr_bg");
-
-  td->str.sm_csr = require_ti_string(ut, termtype, unibi_cursor_normal, "sm_csr");
-  td->str.rm_csr = require_ti_string(ut, termtype, unibi_cursor_invisible, "rm_csr");
+#define TI_CAP_INIT(name, s, required) \
+  td->str.name = required ? require_ti_cap(ut, termtype, s, #name) : lookup_ti_cap(ut, termtype, s);
+  TI_CAPS(TI_CAP_INIT)
+#undef TI_CAP_INIT
 
   const char *key_mouse = lookup_ti_string(ut, termtype, unibi_key_mouse);
   if(key_mouse && strcmp(key_mouse, "\e[M") == 0)
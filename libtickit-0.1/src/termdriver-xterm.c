@@ -19,6 +19,7 @@ struct XTermDriver {
     unsigned int cursorshape:2;
     unsigned int mouse:2;
     unsigned int keypad:1;
+    unsigned int paste:1;
   } mode;
 
   struct {
@@ -324,6 +325,10 @@ static bool getctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int *value)
       *value = xd->mode.keypad;
       return true;
 
+    case TICKIT_TERMCTL_BRACKETED_PASTE:
+      *value = xd->mode.paste;
+      return true;
+
     case TICKIT_TERMCTL_COLORS:
       *value = 256;
       return true;
@@ -406,6 +411,14 @@ static bool setctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int value)
       tickit_termdrv_write_strf(ttd, value ? "\e=" : "\e>");
       return true;
 
+    case TICKIT_TERMCTL_BRACKETED_PASTE:
+      if(!xd->mode.paste == !value)
+        return true;
+
+      tickit_termdrv_write_str(ttd, value ? "\e[?2004h" : "\e[?2004l", 0);
+      xd->mode.paste = !!value;
+      return true;
+
     default:
       return false;
   }
@@ -555,6 +568,8 @@ static void stop(TickitTermDriver *ttd)
     setctl_int(ttd, TICKIT_TERMCTL_ALTSCREEN, 0);
   if(xd->mode.keypad)
     setctl_int(ttd, TICKIT_TERMCTL_KEYPAD_APP, 0);
+  if(xd->mode.paste)
+    setctl_int(ttd, TICKIT_TERMCTL_BRACKETED_PASTE, 0);
 
   // Reset pen
   tickit_termdrv_write_str(ttd, "\e[m", 3);
@@ -54,6 +54,14 @@ int main(int argc, char *argv[])
   tickit_term_goto(tt, -1, 0);
   is_str_escape(buffer, "\r", "buffer after tickit_term_goto col=0");
 
+  buffer[0] = 0;
+  tickit_term_goto(tt, -1, 5);
+  is_str_escape(buffer, "\e[6G", "buffer after tickit_term_goto col");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 3, -1);
+  is_str_escape(buffer, "\e[4d", "buffer after tickit_term_goto line");
+
   buffer[0] = 0;
   tickit_term_move(tt, 2, 0);
   is_str_escape(buffer, "\e[2B", "buffer after tickit_term_move down 2");
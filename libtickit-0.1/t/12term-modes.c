@@ -49,6 +49,14 @@ int main(int argc, char *argv[])
 
   is_str_escape(buffer, "\e[?1002h\e[?1006h", "buffer after set_mode_mouse to drag");
 
+  buffer[0] = 0;
+  tickit_term_setctl_int(tt, TICKIT_TERMCTL_BRACKETED_PASTE, 1);
+
+  is_str_escape(buffer, "\e[?2004h", "buffer after set_mode_bracketed_paste on");
+
+  tickit_term_getctl_int(tt, TICKIT_TERMCTL_BRACKETED_PASTE, &value);
+  is_int(value, 1, "get_mode_bracketed_paste returns value");
+
   buffer[0] = 0;
   tickit_term_setctl_str(tt, TICKIT_TERMCTL_TITLE_TEXT, "title here");
 
@@ -59,7 +67,7 @@ int main(int argc, char *argv[])
 
   ok(1, "tickit_term_unref");
 
-  is_str_escape(buffer, "\e[?1002l\e[?1006l\e[?25h\e[?1049l\e[m", "buffer after termkey_term_unref resets modes");
+  is_str_escape(buffer, "\e[?1002l\e[?1006l\e[?25h\e[?1049l\e[?2004l\e[m", "buffer after termkey_term_unref resets modes");
 
   return exit_status();
 }
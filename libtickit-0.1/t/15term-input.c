@@ -46,6 +46,19 @@ int on_mouse(TickitTerm *tt, TickitEventType ev, void *_info, void *data)
   return 1;
 }
 
+char pastestr[32];
+size_t pastelen;
+
+int on_paste(TickitTerm *tt, TickitEventType ev, void *_info, void *data)
+{
+  TickitPasteEventInfo *info = _info;
+
+  strncpy(pastestr, info->str, sizeof(pastestr)-1); pastestr[sizeof(pastestr)-1] = 0;
+  pastelen = info->len;
+
+  return 1;
+}
+
 int main(int argc, char *argv[])
 {
   TickitTerm *tt;
@@ -57,6 +70,7 @@ int main(int argc, char *argv[])
 
   tickit_term_bind_event(tt, TICKIT_EV_KEY,   0, on_key,   NULL);
   tickit_term_bind_event(tt, TICKIT_EV_MOUSE, 0, on_mouse, NULL);
+  tickit_term_bind_event(tt, TICKIT_EV_PASTE, 0, on_paste, NULL);
 
   {
     TickitKeyEventInfo info = {
@@ -136,6 +150,17 @@ int main(int argc, char *argv[])
   is_int(mousecol,    0,                    "mousecol after mouse wheel up");
   is_int(mousemod,    0,                    "mousemod after mouse wheel up");
 
+  keytype = -1; keystr[0] = 0;
+  tickit_term_input_push_bytes(tt, "\e[200~a\rb\e[201~", 15);
+
+  is_int(keytype,  -1,     "keytype not set after bracketed paste");
+  is_str(pastestr, "a\rb", "pastestr after bracketed paste");
+  is_int(pastelen, 3,      "pastelen after bracketed paste");
+
+  tickit_term_input_push_bytes(tt, "\e[200~a\0b\e[201~", 15);
+
+  is_int(pastelen, 3, "pastelen counts a pasted NUL");
+
   keytype = -1; keystr[0] = 0;
   tickit_term_input_push_bytes(tt, "\e[", 2);
 
@@ -0,0 +1,120 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <string.h>
+
+int keys_run;
+
+int on_key(TickitTerm *tt, TickitEventType ev, void *_info, void *data)
+{
+  keys_run++;
+  return 1;
+}
+
+int resizes_run;
+
+int on_resize(TickitTerm *tt, TickitEventType ev, void *_info, void *data)
+{
+  resizes_run++;
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+  TickitTermEvent events[4];
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_utf8(tt, 1);
+
+  tickit_term_bind_event(tt, TICKIT_EV_KEY,    0, on_key,    NULL);
+  tickit_term_bind_event(tt, TICKIT_EV_RESIZE, 0, on_resize, NULL);
+
+  is_int(tickit_term_get_events(tt, events, 4), 0, "no events queued initially");
+
+  tickit_term_set_event_queue(tt, true);
+
+  tickit_term_input_push_bytes(tt, "A\xc3\xa9", 3);
+
+  is_int(keys_run, 0, "queued keys do not run handlers");
+
+  is_int(tickit_term_get_events(tt, events, 4), 2, "two events from push_bytes");
+
+  is_int(events[0].ev,                  TICKIT_EV_KEY,     "events[0] ev");
+  is_int(events[0].info.key.type,       TICKIT_KEYEV_TEXT, "events[0] key type");
+  is_str(events[0].info.key.str,        "A",               "events[0] key str");
+  is_int(events[0].info.key.codepoint,  'A',               "events[0] key codepoint");
+  is_str(events[1].info.key.str,        "\xc3\xa9",        "events[1] key str");
+  is_int(events[1].info.key.codepoint,  0xe9,              "events[1] key codepoint");
+
+  is_int(tickit_term_get_events(tt, events, 4), 0, "queue empty after draining");
+
+  tickit_term_input_push_bytes(tt, "\e[A", 3);
+  tickit_term_get_events(tt, events, 4);
+
+  is_int(events[0].info.key.type, TICKIT_KEYEV_KEY, "key type for Up");
+  is_str(events[0].info.key.str,  "Up",             "key str for Up");
+
+  tickit_term_input_push_bytes(tt, "\e[M !!", 6);
+  tickit_term_get_events(tt, events, 4);
+
+  is_int(events[0].ev,                TICKIT_EV_MOUSE,      "ev for mouse press");
+  is_int(events[0].info.mouse.type,   TICKIT_MOUSEEV_PRESS, "mouse type");
+  is_int(events[0].info.mouse.button, 1,                    "mouse button");
+  is_int(events[0].info.mouse.line,   0,                    "mouse line");
+  is_int(events[0].info.mouse.col,    0,                    "mouse col");
+
+  tickit_term_input_push_bytes(tt, "\e[200~xy\e[201~", 14);
+  is_int(tickit_term_get_events(tt, events, 4), 1, "paste is queued as one event");
+
+  is_int(events[0].ev,             TICKIT_EV_PASTE, "ev for paste");
+  is_str(events[0].info.paste.str, "xy",            "paste str");
+  is_int(events[0].info.paste.len, 2,               "paste len");
+
+  tickit_term_input_push_bytes(tt, "\e[200~x\0y\e[201~", 15);
+  tickit_term_get_events(tt, events, 4);
+
+  ok(events[0].info.paste.len == 3 && memcmp(events[0].info.paste.str, "x\0y", 3) == 0,
+    "paste with NUL keeps every byte");
+
+  tickit_term_set_size(tt, 30, 100);
+
+  is_int(resizes_run, 1, "resize still runs handlers when queued");
+  is_int(tickit_term_get_events(tt, events, 4), 1, "resize is queued too");
+  is_int(events[0].ev,                TICKIT_EV_RESIZE, "ev for resize");
+  is_int(events[0].info.resize.lines, 30,               "resize lines");
+  is_int(events[0].info.resize.cols,  100,              "resize cols");
+
+  // Enough input to grow and wrap the queue, drained a few at a time
+  {
+    char bytes[200];
+    for(int i = 0; i < 200; i++)
+      bytes[i] = 'a' + i % 26;
+
+    tickit_term_input_push_bytes(tt, bytes, 50);
+    tickit_term_get_events(tt, events, 4);
+    tickit_term_input_push_bytes(tt, bytes + 50, 150);
+
+    int count = 4, inorder = 1;
+    size_t n;
+    while((n = tickit_term_get_events(tt, events, 4)) > 0) {
+      for(size_t i = 0; i < n; i++, count++)
+        if(events[i].info.key.codepoint != bytes[count])
+          inorder = 0;
+    }
+
+    is_int(count, 200, "all events drained after growing");
+    ok(inorder, "events drained in input order");
+  }
+
+  tickit_term_set_event_queue(tt, false);
+
+  tickit_term_input_push_bytes(tt, "B", 1);
+
+  is_int(keys_run, 1, "keys run handlers again once queueing is off");
+  is_int(tickit_term_get_events(tt, events, 4), 0, "nothing queued once queueing is off");
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime
+
+#include "tickit.h"
+#include "taplib.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static long now_msec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static char order[16];
+static int  norder;
+
+static int on_timer(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(flags & TICKIT_LOOP_FIRE)
+    order[norder++] = *(char *)user;
+  return 0;
+}
+
+static int unbound;
+static int on_unbind(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(flags & TICKIT_LOOP_FIRE)
+    order[norder++] = '!';
+  else if(flags & TICKIT_LOOP_UNBIND)
+    unbound++;
+  return 0;
+}
+
+static int io_flags;
+static int on_io(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(!(flags & TICKIT_LOOP_FIRE))
+    return 0;
+
+  io_flags = flags;
+
+  char buffer[16];
+  read(*(int *)user, buffer, sizeof buffer);
+  return 0;
+}
+
+static int on_stop(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(flags & TICKIT_LOOP_FIRE)
+    tickit_loop_stop(loop);
+  return 0;
+}
+
+static int requeued;
+static int on_requeue(TickitLoop *loop, TickitLoopFlags flags, void *user)
+{
+  if(!(flags & TICKIT_LOOP_FIRE))
+    return 0;
+
+  if(++requeued < 2)
+    tickit_loop_watch_later(loop, &on_requeue, NULL);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  TickitLoop *loop = tickit_loop_new();
+
+  ok(!!loop, "tickit_loop_new");
+
+  // Timers fire in order of expiry, not of creation
+  {
+    norder = 0;
+    tickit_loop_watch_timer_msec(loop, 30, &on_timer, "c");
+    tickit_loop_watch_timer_msec(loop, 10, &on_timer, "a");
+    tickit_loop_watch_timer_msec(loop, 20, &on_timer, "b");
+
+    long start = now_msec();
+    while(norder < 3 && now_msec() - start < 1000)
+      tickit_loop_run_once(loop, -1);
+
+    order[norder] = 0;
+    is_str(order, "abc", "timers fire in expiry order");
+    ok(now_msec() - start >= 29, "timers do not fire early");
+  }
+
+  // Timers beyond the first wheel level still cascade down and fire
+  {
+    norder = 0;
+    long start = now_msec();
+    tickit_loop_watch_timer_msec(loop, 150, &on_timer, "x");
+
+    while(norder < 1 && now_msec() - start < 1000)
+      tickit_loop_run_once(loop, -1);
+
+    long elapsed = now_msec() - start;
+    is_int(norder, 1, "cascaded timer fired");
+    ok(elapsed >= 149 && elapsed < 400, "cascaded timer fired on time");
+  }
+
+  // Cancelled timers never fire but do get unbound
+  {
+    norder = 0; unbound = 0;
+    int id = tickit_loop_watch_timer_msec(loop, 5, &on_unbind, NULL);
+    tickit_loop_watch_timer_msec(loop, 10, &on_timer, "y");
+    tickit_loop_cancel(loop, id);
+
+    is_int(unbound, 1, "cancelled timer is unbound");
+
+    while(norder < 1)
+      tickit_loop_run_once(loop, -1);
+
+    order[norder] = 0;
+    is_str(order, "y", "cancelled timer did not fire");
+
+    tickit_loop_cancel(loop, id);
+    is_int(unbound, 1, "stale ID cancels nothing");
+  }
+
+  // Later callbacks run on the next turn without blocking; ones queued while
+  // running wait for the turn after
+  {
+    requeued = 0;
+    tickit_loop_watch_later(loop, &on_requeue, NULL);
+
+    long start = now_msec();
+    tickit_loop_run_once(loop, -1);
+    is_int(requeued, 1, "later ran once");
+
+    tickit_loop_run_once(loop, -1);
+    is_int(requeued, 2, "requeued later ran on the next turn");
+    ok(now_msec() - start < 100, "pending later does not block");
+
+    tickit_loop_run_once(loop, 0);
+    is_int(requeued, 2, "later that stopped requeueing is gone");
+
+    unbound = 0;
+    tickit_loop_watch_later(loop, &on_unbind, NULL);
+    int id2 = tickit_loop_watch_later(loop, &on_unbind, NULL);
+    tickit_loop_cancel(loop, id2);
+    is_int(unbound, 1, "cancelled later is unbound");
+
+    norder = 0;
+    tickit_loop_run_once(loop, 0);
+    is_int(norder, 1, "remaining later still runs after cancelling the tail");
+  }
+
+  // I/O watches
+  {
+    int fds[2];
+    pipe(fds);
+
+    int id = tickit_loop_watch_io(loop, fds[0], TICKIT_LOOP_IN, &on_io, &fds[0]);
+    ok(id > 0, "tickit_loop_watch_io");
+
+    io_flags = 0;
+    tickit_loop_run_once(loop, 0);
+    is_int(io_flags, 0, "I/O watch idle without data");
+
+    write(fds[1], "x", 1);
+    tickit_loop_run_once(loop, 0);
+    is_int(io_flags, TICKIT_LOOP_FIRE|TICKIT_LOOP_IN, "I/O watch fires when readable");
+
+    tickit_loop_cancel(loop, id);
+
+    io_flags = 0;
+    write(fds[1], "x", 1);
+    tickit_loop_run_once(loop, 0);
+    is_int(io_flags, 0, "cancelled I/O watch does not fire");
+
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  // tickit_loop_run until stopped
+  {
+    tickit_loop_watch_timer_msec(loop, 10, &on_stop, NULL);
+    tickit_loop_run(loop);
+    pass("tickit_loop_run returns after tickit_loop_stop");
+  }
+
+  // Destroying the loop unbinds whatever is left
+  {
+    unbound = 0;
+    tickit_loop_watch_timer_msec(loop, 1000, &on_unbind, NULL);
+    tickit_loop_watch_later(loop, &on_unbind, NULL);
+    tickit_loop_destroy(loop);
+    is_int(unbound, 2, "destroy unbinds remaining watches");
+  }
+
+  return exit_status();
+}
@@ -0,0 +1,162 @@
+#include <unibilium.h>
+#include <string.h>
+#include <stdlib.h>
+#include "test-simple.c.inc"
+
+/* Every output chunk and padding request is logged, so the comparison also
+ * covers pad() arguments. */
+struct rec {
+    size_t used;
+    char buf[8192];
+};
+
+static void rec_out(void *ctx, const char *p, size_t n) {
+    struct rec *r = ctx;
+    if (n > sizeof r->buf - r->used) {
+        n = sizeof r->buf - r->used;
+    }
+    memcpy(r->buf + r->used, p, n);
+    r->used += n;
+}
+
+static void rec_pad(void *ctx, size_t n, int scale, int force) {
+    char tmp[64];
+    sprintf(tmp, "<pad %zu %d %d>", n, scale, force);
+    rec_out(ctx, tmp, strlen(tmp));
+}
+
+/* No %s, %l, %/ or %m: the parameters are numbers, and dividing by a
+ * random value may divide by zero */
+static const char *const tokens[] = {
+    "%p1", "%p2", "%p3", "%p9", "%d", "%c", "%i", "%%", "%",
+    "%{0}", "%{1}", "%{42}", "%{300}", "%'a'", "%'%'", "%'",
+    "%Pa", "%Pz", "%PA", "%ga", "%gz", "%gA", "%P", "%g",
+    "%?", "%t", "%e", "%;", "%?%p1%t", "%e%p2%t", "%;",
+    "%+", "%-", "%*", "%&", "%|", "%^", "%=", "%<", "%>", "%A", "%O", "%!", "%~",
+    "%:-3d", "%03d", "%x", "%X", "%o", "%#x", "%+d", "% d", "%2.3d", "%.d", "%5", "%:",
+    "$<5>", "$<2.5*/>", "$<10/*>", "$<", "$<3", "$",
+    "\033[", ";", "H", "x", " ", "?", "e", "t", ";",
+};
+
+static void gen(char *buf, size_t size) {
+    size_t n = 0, k = rand() % 24;
+
+    while (k--) {
+        const char *t = tokens[rand() % (sizeof tokens / sizeof *tokens)];
+        size_t len = strlen(t);
+        if (n + len >= size) {
+            break;
+        }
+        memcpy(buf + n, t, len);
+        n += len;
+    }
+    buf[n] = '\0';
+}
+
+static int run_both(const char *fmt, const int *args) {
+    unibi_var_t pa[9], pb[9];
+    unibi_var_t va[52] = {{0}}, vb[52] = {{0}};
+    struct rec ra, rb;
+    unibi_prog *prog;
+    int i;
+
+    for (i = 0; i < 9; i++) {
+        pa[i] = pb[i] = unibi_var_from_num(args[i]);
+    }
+    ra.used = rb.used = 0;
+
+    if (!(prog = unibi_compile(fmt))) {
+        return 0;
+    }
+    unibi_format(va, va + 26, fmt, pa, rec_out, &ra, rec_pad, &ra);
+    unibi_format_prog(vb, vb + 26, prog, pb, rec_out, &rb, rec_pad, &rb);
+    unibi_destroy_prog(prog);
+
+    if (ra.used != rb.used || memcmp(ra.buf, rb.buf, ra.used) != 0) {
+        diag("output differs for \"%s\"", fmt);
+        return 0;
+    }
+    for (i = 0; i < 9; i++) {
+        if (unibi_num_from_var(pa[i]) != unibi_num_from_var(pb[i])) {
+            diag("params differ for \"%s\"", fmt);
+            return 0;
+        }
+    }
+    for (i = 0; i < 52; i++) {
+        if (unibi_num_from_var(va[i]) != unibi_num_from_var(vb[i])) {
+            diag("variables differ for \"%s\"", fmt);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const char *const known[] = {
+    "\033[%i%p1%d;%p2%dH",
+    "\033[%p1%dd",
+    "\033[%?%p1%{8}%<%t3%p1%d%e%p1%{16}%<%t9%p1%{8}%-%d%e38;5;%p1%d%;m",
+    "\033[0%?%p6%t;1%;%?%p2%t;4%;%?%p1%p3%|%t;7%;%?%p4%t;5%;%?%p7%t;8%;m",
+    "%?%p1%t%?%p2%t[ab]%e[a]%;%e%?%p2%t[b]%e[]%;%;",
+    "\033[%i%p1%d;%p2%dr$<5>",
+    "%p1%p2%p3%p4%p5%p6%p7%p8%p9%d%d%d%d%d%d%d%d%d",
+    "%p1%{2}%*%{7}%m%d %p2%{3}%/%d",
+};
+
+int main(void) {
+    static const int args[9] = {4, 17, 0, 1, -3, 1, 0, 255, 65536};
+    char fmt[1024];
+    unibi_var_t param[9];
+    char buf[64];
+    unibi_prog *prog;
+    size_t i, n;
+    int good;
+
+    plan(8);
+
+    good = 1;
+    for (i = 0; i < sizeof known / sizeof *known; i++) {
+        good &= run_both(known[i], args);
+    }
+    ok(good, "real capabilities give identical output");
+
+    srand(20261019);
+    good = 1;
+    for (i = 0; i < 200000 && good; i++) {
+        int a[9], j;
+        for (j = 0; j < 9; j++) {
+            a[j] = rand() % 7 - 2;
+        }
+        gen(fmt, sizeof fmt);
+        good = run_both(fmt, a);
+    }
+    ok(good, "random format strings give identical output");
+
+    /* stack overflow: the 124th push is dropped */
+    {
+        char *p = fmt;
+        for (i = 0; i < 123; i++) {
+            p += sprintf(p, "%%{%zu}", i);
+        }
+        strcpy(p, "%p1%d%d");
+        ok(run_both(fmt, args), "full stack behaves the same");
+    }
+
+    /* the skip loops see %'%' as two pairs, not a character constant */
+    ok(run_both("%{0}%t%'%'%e'x%;y%{1}%t%'%';%;z", args), "jumps over character constants");
+
+    prog = unibi_compile("\033[%i%p1%d;%p2%dH");
+    ok(prog != NULL, "unibi_compile");
+
+    param[0] = unibi_var_from_num(4);
+    param[1] = unibi_var_from_num(17);
+    n = unibi_run_prog(prog, param, buf, sizeof buf);
+    ok(n == 7 && memcmp(buf, "\033[5;18H", 7) == 0, "unibi_run_prog output");
+    ok(unibi_num_from_var(param[0]) == 5, "%%i increments the caller's parameters");
+
+    n = unibi_run_prog(prog, param, buf, 3);
+    ok(n == 7 && memcmp(buf, "\033[6", 3) == 0, "unibi_run_prog truncates but reports the full length");
+
+    unibi_destroy_prog(prog);
+
+    return 0;
+}
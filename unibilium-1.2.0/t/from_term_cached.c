@@ -0,0 +1,130 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unibilium.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "test-simple.c.inc"
+
+static char dir[] = "/tmp/unibi-cached-XXXXXX";
+static char path[sizeof dir + 32];
+
+static void write_entry(const char *name, short cols) {
+    unibi_term *ut = unibi_dummy();
+    char buf[4096];
+    size_t n;
+    FILE *fp;
+
+    unibi_set_name(ut, name);
+    unibi_set_num(ut, unibi_columns, cols);
+    n = unibi_dump(ut, buf, sizeof buf);
+    unibi_destroy(ut);
+
+    sprintf(path, "%s/%c", dir, name[0]);
+    mkdir(path, 0777);
+    sprintf(path, "%s/%c/%s", dir, name[0], name);
+    if (!(fp = fopen(path, "wb")) || fwrite(buf, 1, n, fp) != n || fclose(fp) != 0) {
+        bail_out("cannot write terminfo entry");
+    }
+}
+
+/* Looks up and releases both entries over and over; returns how many times
+ * an object was missing or had the wrong capabilities */
+static void *churn(void *arg) {
+    size_t bad = 0;
+    int i;
+
+    (void)arg;
+    for (i = 0; i < 20000; i++) {
+        unibi_term *x = unibi_from_term_cached("cached");
+        unibi_term *y = unibi_from_term_cached("other");
+
+        if (!x || unibi_get_num(x, unibi_columns) != 132) {
+            bad++;
+        }
+        if (!y || unibi_get_num(y, unibi_columns) != 100) {
+            bad++;
+        }
+        if (x) {
+            unibi_destroy(x);
+        }
+        if (y) {
+            unibi_destroy(y);
+        }
+    }
+    return (void *)bad;
+}
+
+int main(void) {
+    unibi_term *a, *b, *c;
+    pthread_t th[2];
+    void *bad[2];
+
+    plan(10);
+
+    if (!mkdtemp(dir)) {
+        bail_out("mkdtemp failed");
+    }
+    setenv("TERMINFO", dir, 1);
+
+    write_entry("cached", 80);
+    write_entry("other", 100);
+
+    a = unibi_from_term_cached("cached");
+    ok(a != NULL, "first lookup loads the entry");
+    ok(unibi_get_num(a, unibi_columns) == 80, "entry has its capabilities");
+
+    b = unibi_from_term_cached("cached");
+    ok(b == a, "second lookup shares the same object");
+
+    c = unibi_from_term_cached("other");
+    ok(c != NULL && c != a, "different name gives a different object");
+
+    /* Rewriting the file is not seen while references remain */
+    write_entry("cached", 132);
+
+    unibi_destroy(a);
+    a = unibi_from_term_cached("cached");
+    ok(a == b && unibi_get_num(a, unibi_columns) == 80, "object survives while still referenced");
+
+    unibi_destroy(a);
+    unibi_destroy(b);
+
+    a = unibi_from_term_cached("cached");
+    ok(a != NULL && unibi_get_num(a, unibi_columns) == 132, "entry is read again after the last release");
+    unibi_destroy(a);
+    unibi_destroy(c);
+
+    errno = 0;
+    a = unibi_from_term_cached("missing");
+    ok(a == NULL && errno == ENOENT, "missing entry fails with ENOENT");
+
+    a = unibi_from_term_cached("missing");
+    ok(a == NULL, "failures are not cached");
+
+    if (pthread_create(&th[0], NULL, churn, NULL) != 0 || pthread_create(&th[1], NULL, churn, NULL) != 0) {
+        bail_out("pthread_create failed");
+    }
+    pthread_join(th[0], &bad[0]);
+    pthread_join(th[1], &bad[1]);
+    ok(bad[0] == NULL && bad[1] == NULL, "two threads looking up and releasing entries at once");
+
+    /* Every reference is gone, so nothing may still be cached */
+    write_entry("cached", 90);
+    a = unibi_from_term_cached("cached");
+    ok(a != NULL && unibi_get_num(a, unibi_columns) == 90, "threads leave no references behind");
+    unibi_destroy(a);
+
+    remove(path);
+    sprintf(path, "%s/o/other", dir);
+    remove(path);
+    sprintf(path, "%s/c", dir);
+    rmdir(path);
+    sprintf(path, "%s/o", dir);
+    rmdir(path);
+    rmdir(dir);
+
+    return 0;
+}
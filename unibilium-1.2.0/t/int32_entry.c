@@ -0,0 +1,34 @@
+#include <unibilium.h>
+#include <string.h>
+#include "test-simple.c.inc"
+
+/* ncurses 6.1 extended number format: magic 01036, 32-bit numbers */
+static const char terminfo[] = {
+    0x1e, 0x02, /* magic */
+    10, 0,      /* names */
+    0, 0,       /* bools */
+    3, 0,       /* nums */
+    0, 0,       /* strs */
+    0, 0,       /* table */
+    'x', '3', '2', '|', 'w', 'i', 'd', 'e', 'r', '\0',
+    (char)0x50, 0, 0, 0,                       /* columns */
+    (char)0xff, (char)0xff, (char)0xff, (char)0xff, /* init_tabs: absent */
+    0, 0, 1, 0,                                /* lines */
+};
+
+int main(void) {
+    unibi_term *ut;
+
+    plan(5);
+
+    ut = unibi_from_mem(terminfo, sizeof terminfo);
+    ok(ut != NULL, "entry with 32-bit numbers loads");
+    ok(strcmp(unibi_get_name(ut), "wider") == 0, "name");
+    ok(unibi_get_num(ut, unibi_columns) == 80, "small number");
+    ok(unibi_get_num(ut, unibi_init_tabs) == -1, "absent number");
+    ok(unibi_get_num(ut, unibi_lines) == 32767, "number beyond 16 bits is clamped");
+
+    unibi_destroy(ut);
+
+    return 0;
+}
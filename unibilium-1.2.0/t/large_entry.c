@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unibilium.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "test-simple.c.inc"
+
+enum {NEXT = 800};
+
+static char names[NEXT][16], values[NEXT][32];
+
+static int check(unibi_term *ut) {
+    size_t i;
+
+    if (!ut || unibi_count_ext_str(ut) != NEXT) {
+        return 0;
+    }
+    if (strcmp(unibi_get_str(ut, unibi_cursor_address), "\033[%i%p1%d;%p2%dH") != 0) {
+        return 0;
+    }
+    for (i = 0; i < NEXT; i++) {
+        if (strcmp(unibi_get_ext_str_name(ut, i), names[i]) != 0 ||
+            strcmp(unibi_get_ext_str(ut, i), values[i]) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    char path[] = "/tmp/unibi-large-XXXXXX";
+    unibi_term *ut;
+    char *buf;
+    size_t n, size = 65536, i;
+    int fd, fds[2];
+    FILE *fp;
+
+    plan(6);
+
+    ut = unibi_dummy();
+    unibi_set_str(ut, unibi_cursor_address, "\033[%i%p1%d;%p2%dH");
+    for (i = 0; i < NEXT; i++) {
+        sprintf(names[i], "Ext%zu", i);
+        sprintf(values[i], "\033]%zu;value-%zu\007", i, i * 7);
+        unibi_add_ext_str(ut, names[i], values[i]);
+    }
+    buf = malloc(size);
+    n = unibi_dump(ut, buf, size);
+    unibi_destroy(ut);
+
+    ok(n > 16384 && n <= size, "entry is large enough to be mapped (%zu bytes)", n);
+
+    if ((fd = mkstemp(path)) < 0 || write(fd, buf, n) != (ssize_t)n || close(fd) != 0) {
+        bail_out("cannot write terminfo entry");
+    }
+
+    ut = unibi_from_file(path);
+    ok(check(ut), "unibi_from_file loads every extended capability");
+    if (ut) {
+        unibi_destroy(ut);
+    }
+
+    fd = open(path, O_RDONLY);
+    lseek(fd, 0, SEEK_SET);
+    ut = unibi_from_fd(fd);
+    ok(check(ut), "unibi_from_fd loads every extended capability");
+    ok(lseek(fd, 0, SEEK_CUR) == (off_t)n, "unibi_from_fd consumes the whole entry");
+    if (ut) {
+        unibi_destroy(ut);
+    }
+    close(fd);
+
+    fp = fopen(path, "rb");
+    ut = unibi_from_fp(fp);
+    ok(check(ut), "unibi_from_fp loads every extended capability");
+    if (ut) {
+        unibi_destroy(ut);
+    }
+    fclose(fp);
+
+    /* A pipe cannot be mapped and is read instead */
+    if (pipe(fds) != 0 || write(fds[1], buf, n) != (ssize_t)n) {
+        bail_out("cannot fill pipe");
+    }
+    close(fds[1]);
+    ut = unibi_from_fd(fds[0]);
+    ok(check(ut), "unibi_from_fd reads a large entry from a pipe");
+    if (ut) {
+        unibi_destroy(ut);
+    }
+    close(fds[0]);
+
+    unlink(path);
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef GUARD_UNIBILIUM_INTERNAL_H_
+#define GUARD_UNIBILIUM_INTERNAL_H_
+
+/*
+
+Copyright 2008, 2010-2013, 2015 Lukas Mai.
+
+This file is part of unibilium.
+
+Unibilium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Unibilium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with unibilium.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/* Not installed; shared between unibilium.c and uniutil.c only. */
+
+#include "unibilium.h"
+
+#include <stddef.h>
+
+typedef void unibi_unmap_fn(void *, size_t);
+
+/* Parses the entry at p..p+n without copying its string tables; the term's
+ * strings point into the writable private mapping 'map', which is released
+ * with unmap(map, map_len) by unibi_destroy. On failure the caller still
+ * owns the mapping. */
+unibi_term *unibi_from_map(void *map, size_t map_len, const char *p, size_t n, unibi_unmap_fn *unmap);
+
+#endif /* GUARD_UNIBILIUM_INTERNAL_H_ */
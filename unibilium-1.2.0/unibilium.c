@@ -20,6 +20,7 @@ along with unibilium.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "unibilium.h"
+#include "unibilium-internal.h"
 
 #include <errno.h>
 #include <limits.h>
@@ -28,6 +29,7 @@ along with unibilium.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #define ASSERT_RETURN(COND, VAL) do { \
     assert(COND); \
@@ -86,6 +88,9 @@ DEFDYNARRAY(const char *, str);
 
 
 enum {MAGIC = 0432};
+/* ncurses 6.1 and later write entries with numbers that do not fit in 16
+ * bits in this format, where every number is 32 bits wide */
+enum {MAGIC_INT32 = 01036};
 
 struct unibi_term {
     const char *name;
@@ -101,6 +106,16 @@ struct unibi_term {
     DYNARR_T(str) ext_strs;
     DYNARR_T(str) ext_names;
     char *ext_alloc;
+
+    /* set only for terms whose strings point into a mapped file */
+    void *map;
+    size_t map_len;
+    unibi_unmap_fn *unmap;
+
+    /* set only for terms shared through unibi_from_term_cached */
+    char *cache_name;
+    unsigned cache_refs;
+    unibi_term *cache_next;
 };
 
 #define ASSERT_EXT_NAMES(X) assert((X)->ext_names.used == (X)->ext_bools.used + (X)->ext_nums.used + (X)->ext_strs.used)
@@ -116,6 +131,18 @@ static short get_short(const char *p) {
     return n <= MAX15BITS ? n : -1;
 }
 
+/* Numbers are shorts here, so larger values are clamped */
+static short get_num(const char *p, size_t size) {
+    const unsigned char *q = (const unsigned char *)p;
+    unsigned long n;
+
+    if (size == 2) {
+        return get_short(p);
+    }
+    n = q[0] + q[1] * 256ul + q[2] * 65536ul + q[3] * 16777216ul;
+    return n > 0x7fffffffu ? -1 : n > MAX15BITS ? MAX15BITS : (short)n;
+}
+
 static void fill_1(short *p, size_t n) {
     while (n--) {
         *p++ = -1;
@@ -156,6 +183,14 @@ unibi_term *unibi_dummy(void) {
     DYNARR(str, init)(&t->ext_names);
     t->ext_alloc = NULL;
 
+    t->map = NULL;
+    t->map_len = 0;
+    t->unmap = NULL;
+
+    t->cache_name = NULL;
+    t->cache_refs = 0;
+    t->cache_next = NULL;
+
     ASSERT_EXT_NAMES(t);
 
     return t;
@@ -179,17 +214,23 @@ static size_t size_max(size_t a, size_t b) {
 #define FAIL_IF(c, e) FAIL_IF_(c, e, (void)0)
 #define DEL_FAIL_IF(c, e, x) FAIL_IF_(c, e, unibi_destroy(x))
 
-unibi_term *unibi_from_mem(const char *p, size_t n) {
+/* With 'copy' unset the string tables are used in place, so p must stay
+ * valid for the life of the term. A string table that is not NUL-terminated
+ * gets its last byte overwritten, as it would in the copy. */
+static unibi_term *from_mem(const char *p, size_t n, int copy) {
     unibi_term *t = NULL;
     unsigned short magic, namlen, boollen, numlen, strslen, tablsz;
-    char *strp, *namp;
+    size_t numsize;
+    const char *strp = NULL;
+    char *namp;
     size_t namco;
     size_t i;
 
     FAIL_IF(n < 12, EFAULT);
 
     magic   = get_ushort(p + 0);
-    FAIL_IF(magic != MAGIC, EINVAL);
+    FAIL_IF(magic != MAGIC && magic != MAGIC_INT32, EINVAL);
+    numsize = magic == MAGIC_INT32 ? 4 : 2;
 
     namlen  = get_ushort(p + 2);
     boollen = get_ushort(p + 4);
@@ -206,13 +247,16 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
     if (!(t = malloc(sizeof *t))) {
         return NULL;
     }
-    if (!(t->alloc = malloc(namco * sizeof *t->aliases + tablsz + namlen + 1))) {
+    if (!(t->alloc = malloc(namco * sizeof *t->aliases + (copy ? tablsz : 0) + namlen + 1))) {
         free(t);
         return NULL;
     }
     t->aliases = (const char **)t->alloc;
-    strp = t->alloc + namco * sizeof *t->aliases;
-    namp = strp + tablsz;
+    namp = t->alloc + namco * sizeof *t->aliases;
+    if (copy) {
+        strp = namp;
+        namp += tablsz;
+    }
     memcpy(namp, p, namlen);
     namp[namlen] = '\0';
     p += namlen;
@@ -234,6 +278,14 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
         t->name = a;
     }
 
+    t->map = NULL;
+    t->map_len = 0;
+    t->unmap = NULL;
+
+    t->cache_name = NULL;
+    t->cache_refs = 0;
+    t->cache_next = NULL;
+
     DYNARR(bool, init)(&t->ext_bools);
     DYNARR(num, init)(&t->ext_nums);
     DYNARR(str, init)(&t->ext_strs);
@@ -255,15 +307,18 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
         n -= 1;
     }
 
-    DEL_FAIL_IF(n < numlen * 2u, EFAULT, t);
+    DEL_FAIL_IF(n < numlen * numsize, EFAULT, t);
     for (i = 0; i < numlen && i < COUNTOF(t->nums); i++) {
-        t->nums[i] = get_short(p + i * 2);
+        t->nums[i] = get_num(p + i * numsize, numsize);
     }
     fill_1(t->nums + i, COUNTOF(t->nums) - i);
-    p += numlen * 2;
-    n -= numlen * 2;
+    p += numlen * numsize;
+    n -= numlen * numsize;
 
     DEL_FAIL_IF(n < strslen * 2u, EFAULT, t);
+    if (!copy) {
+        strp = p + strslen * 2;
+    }
     for (i = 0; i < strslen && i < COUNTOF(t->strs); i++) {
         t->strs[i] = off_of(strp, tablsz, get_short(p + i * 2));
     }
@@ -272,9 +327,11 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
     n -= strslen * 2;
 
     DEL_FAIL_IF(n < tablsz, EFAULT, t);
-    memcpy(strp, p, tablsz);
-    if (tablsz) {
-        strp[tablsz - 1] = '\0';
+    if (copy) {
+        memcpy((char *)strp, p, tablsz);
+    }
+    if (tablsz && strp[tablsz - 1] != '\0') {
+        ((char *)strp)[tablsz - 1] = '\0';
     }
     p += tablsz;
     n -= tablsz;
@@ -315,7 +372,7 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
                 n <
                 extboollen +
                 extboollen % 2 +
-                extnumlen * 2 +
+                extnumlen * numsize +
                 extstrslen * 2 +
                 extalllen * 2 +
                 exttablsz,
@@ -328,7 +385,7 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
                 !DYNARR(num, ensure_slots)(&t->ext_nums, extnumlen) ||
                 !DYNARR(str, ensure_slots)(&t->ext_strs, extstrslen) ||
                 !DYNARR(str, ensure_slots)(&t->ext_names, extalllen) ||
-                (exttablsz && !(t->ext_alloc = malloc(exttablsz))),
+                (copy && exttablsz && !(t->ext_alloc = malloc(exttablsz))),
                 ENOMEM,
                 t
             );
@@ -346,16 +403,17 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
             }
 
             for (i = 0; i < extnumlen; i++) {
-                t->ext_nums.data[i] = get_short(p + i * 2);
+                t->ext_nums.data[i] = get_num(p + i * numsize, numsize);
             }
             t->ext_nums.used = extnumlen;
-            p += extnumlen * 2;
-            n -= extnumlen * 2;
+            p += extnumlen * numsize;
+            n -= extnumlen * numsize;
 
             {
-                char *ext_alloc2;
+                const char *ext_alloc2;
                 size_t tblsz2;
                 const char *const tbl1 = p + extstrslen * 2 + extalllen * 2;
+                const char *const ext_strp = copy ? t->ext_alloc : tbl1;
                 size_t s_max = 0, s_sum = 0;
 
                 for (i = 0; i < extstrslen; i++) {
@@ -372,7 +430,7 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
                         }
                         s_sum += end - start;
                         s_max = size_max(s_max, end - tbl1);
-                        t->ext_strs.data[i] = t->ext_alloc + v;
+                        t->ext_strs.data[i] = ext_strp + v;
                     }
                 }
                 t->ext_strs.used = extstrslen;
@@ -381,7 +439,7 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
 
                 DEL_FAIL_IF(s_max != s_sum, EINVAL, t);
 
-                ext_alloc2 = t->ext_alloc + s_sum;
+                ext_alloc2 = ext_strp + s_sum;
                 tblsz2 = exttablsz - s_sum;
 
                 for (i = 0; i < extalllen; i++) {
@@ -396,8 +454,12 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
                 assert(p == tbl1);
 
                 if (exttablsz) {
-                    memcpy(t->ext_alloc, p, exttablsz);
-                    t->ext_alloc[exttablsz - 1] = '\0';
+                    if (copy) {
+                        memcpy(t->ext_alloc, p, exttablsz);
+                    }
+                    if (ext_strp[exttablsz - 1] != '\0') {
+                        ((char *)ext_strp)[exttablsz - 1] = '\0';
+                    }
 
                     p += exttablsz;
                     n -= exttablsz;
@@ -415,7 +477,86 @@ unibi_term *unibi_from_mem(const char *p, size_t n) {
 #undef FAIL_IF_
 #undef DEL_FAIL_IF
 
+unibi_term *unibi_from_mem(const char *p, size_t n) {
+    return from_mem(p, n, 1);
+}
+
+unibi_term *unibi_from_map(void *map, size_t map_len, const char *p, size_t n, unibi_unmap_fn *unmap) {
+    unibi_term *t;
+
+    if (!(t = from_mem(p, n, 0))) {
+        return NULL;
+    }
+    t->map = map;
+    t->map_len = map_len;
+    t->unmap = unmap;
+    return t;
+}
+
+/* term_cache and the cache_* members of the terms in it are only used with
+ * cache_lock held. The entry is loaded with the lock held too, so two
+ * threads asking for the same name never both read it. */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static unibi_term *term_cache;
+
+unibi_term *unibi_from_term_cached(const char *term) {
+    unibi_term *t;
+
+    pthread_mutex_lock(&cache_lock);
+
+    for (t = term_cache; t; t = t->cache_next) {
+        if (strcmp(t->cache_name, term) == 0) {
+            t->cache_refs++;
+            pthread_mutex_unlock(&cache_lock);
+            return t;
+        }
+    }
+
+    if (!(t = unibi_from_term(term))) {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+    if (!(t->cache_name = malloc(strlen(term) + 1))) {
+        pthread_mutex_unlock(&cache_lock);
+        unibi_destroy(t);
+        errno = ENOMEM;
+        return NULL;
+    }
+    strcpy(t->cache_name, term);
+    t->cache_refs = 1;
+    t->cache_next = term_cache;
+    term_cache = t;
+
+    pthread_mutex_unlock(&cache_lock);
+    return t;
+}
+
+static void uncache(unibi_term *t) {
+    unibi_term **pp;
+
+    for (pp = &term_cache; *pp; pp = &(*pp)->cache_next) {
+        if (*pp == t) {
+            *pp = t->cache_next;
+            break;
+        }
+    }
+    free(t->cache_name);
+    t->cache_name = NULL;
+}
+
 void unibi_destroy(unibi_term *t) {
+    /* cache_name only changes once the last reference is gone, and the
+     * caller still holds one */
+    if (t->cache_name) {
+        pthread_mutex_lock(&cache_lock);
+        if (--t->cache_refs > 0) {
+            pthread_mutex_unlock(&cache_lock);
+            return;
+        }
+        uncache(t);
+        pthread_mutex_unlock(&cache_lock);
+    }
+
     DYNARR(bool, free)(&t->ext_bools);
     DYNARR(num, free)(&t->ext_nums);
     DYNARR(str, free)(&t->ext_strs);
@@ -426,6 +567,10 @@ void unibi_destroy(unibi_term *t) {
     t->aliases = NULL;
     free(t->alloc);
     t->alloc = (char *)":-O";
+
+    if (t->unmap) {
+        t->unmap(t->map, t->map_len);
+    }
     free(t);
 }
 
@@ -975,6 +1120,54 @@ static void dput(
     out(ctx, buf, strlen(buf));
 }
 
+/* Skips the rest of a false %t branch: returns the position after the
+ * matching %e or %; (or the end of the string) */
+static const char *skip_then(const char *fmt) {
+    size_t nesting = 0;
+    for (; *fmt; ++fmt) {
+        if (*fmt == '%') {
+            ++fmt;
+            if (*fmt == '?') {
+                ++nesting;
+            } else if (*fmt == ';') {
+                if (!nesting) {
+                    ++fmt;
+                    break;
+                }
+                --nesting;
+            } else if (*fmt == 'e' && !nesting) {
+                ++fmt;
+                break;
+            } else if (!*fmt) {
+                break;
+            }
+        }
+    }
+    return fmt;
+}
+
+/* Skips an %e branch: returns the position after the matching %; */
+static const char *skip_else(const char *fmt) {
+    size_t nesting = 0;
+    for (; *fmt; ++fmt) {
+        if (*fmt == '%') {
+            ++fmt;
+            if (*fmt == '?') {
+                ++nesting;
+            } else if (*fmt == ';') {
+                if (!nesting) {
+                    ++fmt;
+                    break;
+                }
+                --nesting;
+            } else if (!*fmt) {
+                break;
+            }
+        }
+    }
+    return fmt;
+}
+
 static long cstrtol(const char *s, const char **pp) {
     long r;
     char *tmp;
@@ -1208,50 +1401,14 @@ void unibi_format(
             case 't': {
                 int c = unibi_num_from_var(POP());
                 if (!c) {
-                    size_t nesting = 0;
-                    for (; *fmt; ++fmt) {
-                        if (*fmt == '%') {
-                            ++fmt;
-                            if (*fmt == '?') {
-                                ++nesting;
-                            } else if (*fmt == ';') {
-                                if (!nesting) {
-                                    ++fmt;
-                                    break;
-                                }
-                                --nesting;
-                            } else if (*fmt == 'e' && !nesting) {
-                                ++fmt;
-                                break;
-                            } else if (!*fmt) {
-                                break;
-                            }
-                        }
-                    }
+                    fmt = skip_then(fmt);
                 }
                 break;
             }
 
-            case 'e': {
-                size_t nesting = 0;
-                for (; *fmt; ++fmt) {
-                    if (*fmt == '%') {
-                        ++fmt;
-                        if (*fmt == '?') {
-                            ++nesting;
-                        } else if (*fmt == ';') {
-                            if (!nesting) {
-                                ++fmt;
-                                break;
-                            }
-                            --nesting;
-                        } else if (!*fmt) {
-                            break;
-                        }
-                    }
-                }
+            case 'e':
+                fmt = skip_else(fmt);
                 break;
-            }
 
             case ';':
                 break;
@@ -1328,3 +1485,669 @@ size_t unibi_run(const char *fmt, unibi_var_t param[9], char *p, size_t n) {
     unibi_format(vars, vars + 26, fmt, param, out, &ctx, NULL, NULL);
     return ctx.w;
 }
+
+
+/* Compiled format strings. unibi_compile parses a format string once, the
+ * same way unibi_format does, into a byte code program; jumps for %t and %e
+ * are resolved to the positions unibi_format's skip loops would reach. */
+
+enum {
+    OP_END,
+    OP_TEXT,        /* int len, bytes */
+    OP_PAD,         /* int n, byte flags (1: scale, 2: force) */
+    OP_PRINTF,      /* byte conv, int width, int prec, byte len, format + NUL */
+    OP_PUTD,
+    OP_PARAM_PUTD,  /* byte param */
+    OP_PUTC,
+    OP_PUTS,
+    OP_PARAM,       /* byte param */
+    OP_SET_DYN,     /* byte var */
+    OP_SET_STATIC,  /* byte var */
+    OP_GET_DYN,     /* byte var */
+    OP_GET_STATIC,  /* byte var */
+    OP_CONST,       /* int value */
+    OP_STRLEN,
+    OP_INCR,
+    OP_JZ,          /* int target */
+    OP_JMP,         /* int target */
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_AND, OP_OR, OP_XOR,
+    OP_EQ, OP_LT, OP_GT,
+    OP_LAND, OP_LOR,
+    OP_NOT, OP_COMPL
+};
+
+struct unibi_prog {
+    /* set if the jumps did not line up with the parse; this copy of the
+     * format string is then interpreted with unibi_format instead */
+    const char *fmt;
+    size_t len;
+    unsigned char code[];
+};
+
+typedef struct {
+    unsigned char *code;
+    size_t len, size;
+    size_t text;        /* start of the OP_TEXT being extended, or SIZE_ERR */
+    size_t last_param;  /* position of an OP_PARAM that may be fused, or SIZE_ERR */
+    size_t *at;         /* code position of each format position, or SIZE_ERR */
+    size_t *fixup;      /* pairs of (operand position, format position) */
+    size_t nfixup, fixup_size;
+    int nomem;
+} prog_buf;
+
+static void *pb_reserve(prog_buf *b, size_t n) {
+    if (b->nomem) {
+        return NULL;
+    }
+    if (b->len + n > b->size) {
+        size_t size = b->size * 2 + n;
+        unsigned char *code = realloc(b->code, sizeof (unibi_prog) + size);
+        if (!code) {
+            b->nomem = 1;
+            return NULL;
+        }
+        b->code = code;
+        b->size = size;
+    }
+    return b->code + sizeof (unibi_prog) + b->len;
+}
+
+static void pb_op(prog_buf *b, int op) {
+    unsigned char *p;
+    b->text = SIZE_ERR;
+    b->last_param = SIZE_ERR;
+    if ((p = pb_reserve(b, 1))) {
+        *p = op;
+        b->len++;
+    }
+}
+
+static void pb_byte(prog_buf *b, int x) {
+    unsigned char *p;
+    if ((p = pb_reserve(b, 1))) {
+        *p = x;
+        b->len++;
+    }
+}
+
+static void pb_int(prog_buf *b, int x) {
+    unsigned char *p;
+    if ((p = pb_reserve(b, sizeof x))) {
+        memcpy(p, &x, sizeof x);
+        b->len += sizeof x;
+    }
+}
+
+static void pb_text(prog_buf *b, const char *s, size_t n) {
+    unsigned char *p;
+    int len;
+
+    if (b->text == SIZE_ERR) {
+        pb_op(b, OP_TEXT);
+        b->text = b->len;
+        pb_int(b, 0);
+    }
+    if (n > INT_MAX || b->len > INT_MAX - n) {
+        b->nomem = 1;
+        return;
+    }
+    if ((p = pb_reserve(b, n))) {
+        memcpy(p, s, n);
+        b->len += n;
+        memcpy(&len, b->code + sizeof (unibi_prog) + b->text, sizeof len);
+        len += n;
+        memcpy(b->code + sizeof (unibi_prog) + b->text, &len, sizeof len);
+    }
+}
+
+/* Called at each point where unibi_format could resume after a jump */
+static void pb_mark(prog_buf *b, size_t pos) {
+    if (b->at[pos] == SIZE_ERR - 1) {
+        b->text = SIZE_ERR;
+        b->last_param = SIZE_ERR;
+        b->at[pos] = b->len;
+    }
+}
+
+static void pb_jump(prog_buf *b, int op, size_t target) {
+    pb_op(b, op);
+    if (b->nfixup == b->fixup_size) {
+        size_t size = b->fixup_size * 2 + 8;
+        size_t *fixup = realloc(b->fixup, size * 2 * sizeof *fixup);
+        if (!fixup) {
+            b->nomem = 1;
+            return;
+        }
+        b->fixup = fixup;
+        b->fixup_size = size;
+    }
+    b->fixup[b->nfixup * 2] = b->len;
+    b->fixup[b->nfixup * 2 + 1] = target;
+    b->nfixup++;
+    if (b->at[target] == SIZE_ERR) {
+        b->at[target] = SIZE_ERR - 1;
+    }
+    pb_int(b, 0);
+}
+
+static unibi_prog *compile_fallback(const char *fmt) {
+    size_t n = strlen(fmt) + 1;
+    unibi_prog *prog;
+
+    if (!(prog = malloc(sizeof *prog + n))) {
+        return NULL;
+    }
+    memcpy(prog->code, fmt, n);
+    prog->fmt = (const char *)prog->code;
+    prog->len = 0;
+    return prog;
+}
+
+unibi_prog *unibi_compile(const char *fmt) {
+    const char *const fmt0 = fmt;
+    const size_t fmtlen = strlen(fmt);
+    prog_buf b;
+    unibi_prog *prog;
+    size_t i;
+
+#define UC(F, C) (F((unsigned char)(C)))
+
+    b.code = NULL;
+    b.len = b.size = 0;
+    b.text = b.last_param = SIZE_ERR;
+    b.fixup = NULL;
+    b.nfixup = b.fixup_size = 0;
+    b.nomem = 0;
+    if (!(b.at = malloc((fmtlen + 1) * sizeof *b.at))) {
+        return NULL;
+    }
+    for (i = 0; i <= fmtlen; i++) {
+        b.at[i] = SIZE_ERR;
+    }
+
+    while (*fmt) {
+        pb_mark(&b, fmt - fmt0);
+        {
+            size_t r = strcspn(fmt, "%$");
+            if (r) {
+                pb_text(&b, fmt, r);
+                fmt += r;
+                if (!*fmt) {
+                    break;
+                }
+                pb_mark(&b, fmt - fmt0);
+            }
+        }
+
+        if (*fmt == '$') {
+            ++fmt;
+            if (*fmt == '<' && UC(isdigit, fmt[1])) {
+                int scale = 0, force = 0;
+                const char *v = fmt + 1;
+                size_t n = cstrtol(v, &v);
+                n *= 10;
+                if (*v == '.') {
+                    ++v;
+                }
+                if (UC(isdigit, *v)) {
+                    n += *v++ - '0';
+                }
+                if (*v == '/') {
+                    ++v;
+                    force = 1;
+                    if (*v == '*') {
+                        ++v;
+                        scale = 1;
+                    }
+                } else if (*v == '*') {
+                    ++v;
+                    scale = 1;
+                    if (*v == '/') {
+                        ++v;
+                        force = 1;
+                    }
+                }
+                if (*v == '>') {
+                    fmt = v + 1;
+                    pb_op(&b, OP_PAD);
+                    pb_int(&b, (int)n);
+                    pb_byte(&b, scale | force << 1);
+                } else {
+                    pb_text(&b, fmt - 1, 1);
+                }
+            } else {
+                pb_text(&b, fmt - 1, 1);
+            }
+            continue;
+        }
+
+        ++fmt;
+
+        if (UC(isdigit, *fmt) || (*fmt && strchr(":# .doxX", *fmt))) {
+            enum {
+                FlagAlt = 1,
+                FlagSpc = 2,
+                FlagSgn = 4,
+                FlagLft = 8,
+                FlagZro = 16
+            };
+            int flags = 0, width = -1, prec = -1;
+            const char *v = fmt;
+            if (*v == ':') {
+                ++v;
+            }
+            while (1) {
+                switch (*v++) {
+                    case '#': flags |= FlagAlt; continue;
+                    case ' ': flags |= FlagSpc; continue;
+                    case '0': flags |= FlagZro; continue;
+                    case '+': flags |= FlagSgn; continue;
+                    case '-': flags |= FlagLft; continue;
+                }
+                --v;
+                break;
+            }
+            if (UC(isdigit, *v)) {
+                width = cstrtol(v, &v);
+            }
+            if (*v == '.' && UC(isdigit, v[1])) {
+                ++v;
+                prec = cstrtol(v, &v);
+            }
+            if (*v && strchr("doxXs", *v)) {
+                char gen[sizeof "%# +-0*.*d"], *g = gen;
+                *g++ = '%';
+                if (flags & FlagAlt) { *g++ = '#'; }
+                if (flags & FlagSpc) { *g++ = ' '; }
+                if (flags & FlagSgn) { *g++ = '+'; }
+                if (flags & FlagLft) { *g++ = '-'; }
+                if (flags & FlagZro) { *g++ = '0'; }
+                if (width != -1) { *g++ = '*'; }
+                if (prec  != -1) { *g++ = '.'; *g++ = '*'; }
+                *g++ = *v;
+                *g = '\0';
+                if (strcmp(gen, "%d") == 0) {
+                    if (b.last_param != SIZE_ERR) {
+                        b.code[sizeof (unibi_prog) + b.last_param] = OP_PARAM_PUTD;
+                        b.last_param = SIZE_ERR;
+                    } else {
+                        pb_op(&b, OP_PUTD);
+                    }
+                } else {
+                    pb_op(&b, OP_PRINTF);
+                    pb_byte(&b, *v);
+                    pb_int(&b, width);
+                    pb_int(&b, prec);
+                    pb_byte(&b, g - gen + 1);
+                    for (g = gen; *g; g++) {
+                        pb_byte(&b, *g);
+                    }
+                    pb_byte(&b, '\0');
+                }
+                fmt = v;
+            } else {
+                pb_text(&b, fmt - 1, 2);
+            }
+            ++fmt;
+            continue;
+        }
+
+        switch (*fmt++) {
+            default:
+                pb_text(&b, fmt - 2, 2);
+                break;
+
+            case '\0':
+                --fmt;
+                pb_text(&b, "%", 1);
+                break;
+
+            case '%':
+                pb_text(&b, "%", 1);
+                break;
+
+            case 'c':
+                pb_op(&b, OP_PUTC);
+                break;
+
+            case 's':
+                pb_op(&b, OP_PUTS);
+                break;
+
+            case 'p':
+                if (*fmt >= '1' && *fmt <= '9') {
+                    pb_op(&b, OP_PARAM);
+                    b.last_param = b.len - 1;
+                    pb_byte(&b, *fmt++ - '1');
+                } else {
+                    pb_text(&b, fmt - 2, 2);
+                }
+                break;
+
+            case 'P':
+                if (*fmt >= 'a' && *fmt <= 'z') {
+                    pb_op(&b, OP_SET_DYN);
+                    pb_byte(&b, *fmt++ - 'a');
+                } else if (*fmt >= 'A' && *fmt <= 'Z') {
+                    pb_op(&b, OP_SET_STATIC);
+                    pb_byte(&b, *fmt++ - 'A');
+                } else {
+                    pb_text(&b, fmt - 2, 2);
+                }
+                break;
+
+            case 'g':
+                if (*fmt >= 'a' && *fmt <= 'z') {
+                    pb_op(&b, OP_GET_DYN);
+                    pb_byte(&b, *fmt++ - 'a');
+                } else if (*fmt >= 'A' && *fmt <= 'Z') {
+                    pb_op(&b, OP_GET_STATIC);
+                    pb_byte(&b, *fmt++ - 'A');
+                } else {
+                    pb_text(&b, fmt - 2, 2);
+                }
+                break;
+
+            case '\'':
+                if (*fmt && fmt[1] == '\'') {
+                    pb_op(&b, OP_CONST);
+                    pb_int(&b, (unsigned char)*fmt);
+                    fmt += 2;
+                } else {
+                    pb_text(&b, fmt - 2, 2);
+                }
+                break;
+
+            case '{': {
+                size_t r = strspn(fmt, "0123456789");
+                if (r && fmt[r] == '}') {
+                    pb_op(&b, OP_CONST);
+                    pb_int(&b, atoi(fmt));
+                    fmt += r + 1;
+                } else {
+                    pb_text(&b, fmt - 2, 2);
+                }
+                break;
+            }
+
+            case 'l':
+                pb_op(&b, OP_STRLEN);
+                break;
+
+            case 'i':
+                pb_op(&b, OP_INCR);
+                break;
+
+            case '?':
+            case ';':
+                break;
+
+            case 't':
+                pb_jump(&b, OP_JZ, skip_then(fmt) - fmt0);
+                break;
+
+            case 'e':
+                pb_jump(&b, OP_JMP, skip_else(fmt) - fmt0);
+                break;
+
+            case '+': pb_op(&b, OP_ADD); break;
+            case '-': pb_op(&b, OP_SUB); break;
+            case '*': pb_op(&b, OP_MUL); break;
+            case '/': pb_op(&b, OP_DIV); break;
+            case 'm': pb_op(&b, OP_MOD); break;
+            case '&': pb_op(&b, OP_AND); break;
+            case '|': pb_op(&b, OP_OR); break;
+            case '^': pb_op(&b, OP_XOR); break;
+            case '=': pb_op(&b, OP_EQ); break;
+            case '<': pb_op(&b, OP_LT); break;
+            case '>': pb_op(&b, OP_GT); break;
+            case 'A': pb_op(&b, OP_LAND); break;
+            case 'O': pb_op(&b, OP_LOR); break;
+            case '!': pb_op(&b, OP_NOT); break;
+            case '~': pb_op(&b, OP_COMPL); break;
+        }
+    }
+
+#undef UC
+
+    pb_mark(&b, fmt - fmt0);
+    pb_op(&b, OP_END);
+
+    prog = NULL;
+    if (!b.nomem) {
+        for (i = 0; i < b.nfixup; i++) {
+            size_t target = b.at[b.fixup[i * 2 + 1]];
+            int off;
+            if (target >= SIZE_ERR - 1) {
+                /* a jump lands inside something the linear parse saw as
+                 * one item */
+                break;
+            }
+            off = (int)target;
+            memcpy(b.code + sizeof (unibi_prog) + b.fixup[i * 2], &off, sizeof off);
+        }
+        if (i < b.nfixup) {
+            free(b.code);
+            prog = compile_fallback(fmt0);
+        } else {
+            prog = (unibi_prog *)b.code;
+            prog->fmt = NULL;
+            prog->len = b.len;
+        }
+    } else {
+        free(b.code);
+        errno = ENOMEM;
+    }
+
+    free(b.at);
+    free(b.fixup);
+    return prog;
+}
+
+void unibi_destroy_prog(unibi_prog *prog) {
+    free(prog);
+}
+
+static int get_int(const unsigned char *p) {
+    int x;
+    memcpy(&x, p, sizeof x);
+    return x;
+}
+
+static void put_dec(int x, void (*out)(void *, const char *, size_t), void *ctx) {
+    char buf[sizeof x * CHAR_BIT / 3 + 3], *p = buf + sizeof buf;
+    unsigned u = x < 0 ? -(unsigned)x : (unsigned)x;
+    do {
+        *--p = '0' + u % 10;
+    } while (u /= 10);
+    if (x < 0) {
+        *--p = '-';
+    }
+    out(ctx, p, buf + sizeof buf - p);
+}
+
+void unibi_format_prog(
+    unibi_var_t var_dyn[26],
+    unibi_var_t var_static[26],
+    const unibi_prog *prog,
+    unibi_var_t param[9],
+    void (*out)(void *, const char *, size_t),
+    void *ctx1,
+    void (*pad)(void *, size_t, int, int),
+    void *ctx2
+) {
+    const unibi_var_t zero = {0};
+    unibi_var_t stack[123];  /* only read below sp, so left uninitialised */
+    size_t sp = 0;
+    const unsigned char *const code = prog->code;
+    const unsigned char *pc = code;
+
+    if (prog->fmt) {
+        unibi_format(var_dyn, var_static, prog->fmt, param, out, ctx1, pad, ctx2);
+        return;
+    }
+
+#define POP() (sp ? stack[--sp] : zero)
+#define PUSH(X) do { if (sp < COUNTOF(stack)) { stack[sp++] = (X); } } while (0)
+#define PUSHi(N) do { unibi_var_t tmp_ = unibi_var_from_num(N); PUSH(tmp_); } while (0)
+
+    for (;;) {
+        switch (*pc++) {
+            case OP_END:
+                return;
+
+            case OP_TEXT: {
+                int n = get_int(pc);
+                pc += sizeof n;
+                out(ctx1, (const char *)pc, n);
+                pc += n;
+                break;
+            }
+
+            case OP_PAD: {
+                int n = get_int(pc);
+                pc += sizeof n;
+                if (pad) {
+                    pad(ctx2, (size_t)n, *pc & 1, *pc >> 1 & 1);
+                }
+                pc++;
+                break;
+            }
+
+            case OP_PRINTF: {
+                char conv = pc[0];
+                int width = get_int(pc + 1);
+                int prec = get_int(pc + 1 + sizeof width);
+                const unsigned char *g = pc + 1 + 2 * sizeof width;
+                dput(conv, (const char *)g + 1, width, prec, POP(), out, ctx1);
+                pc = g + 1 + *g;
+                break;
+            }
+
+            case OP_PUTD:
+                put_dec(unibi_num_from_var(POP()), out, ctx1);
+                break;
+
+            case OP_PARAM_PUTD:
+                if (sp < COUNTOF(stack)) {
+                    put_dec(unibi_num_from_var(param[*pc++]), out, ctx1);
+                } else {
+                    /* %p would have been dropped, so %d prints the top */
+                    pc++;
+                    put_dec(unibi_num_from_var(POP()), out, ctx1);
+                }
+                break;
+
+            case OP_PUTC: {
+                unsigned char c;
+                c = unibi_num_from_var(POP());
+                out(ctx1, (const char *)&c, 1);
+                break;
+            }
+
+            case OP_PUTS: {
+                const char *s;
+                s = unibi_str_from_var(POP());
+                out(ctx1, s, strlen(s));
+                break;
+            }
+
+            case OP_PARAM:
+                PUSH(param[*pc++]);
+                break;
+
+            case OP_SET_DYN:
+                var_dyn[*pc++] = POP();
+                break;
+
+            case OP_SET_STATIC:
+                var_static[*pc++] = POP();
+                break;
+
+            case OP_GET_DYN:
+                PUSH(var_dyn[*pc++]);
+                break;
+
+            case OP_GET_STATIC:
+                PUSH(var_static[*pc++]);
+                break;
+
+            case OP_CONST:
+                PUSHi(get_int(pc));
+                pc += sizeof (int);
+                break;
+
+            case OP_STRLEN:
+                PUSHi(strlen(unibi_str_from_var(POP())));
+                break;
+
+            case OP_INCR:
+                param[0] = unibi_var_from_num(unibi_num_from_var(param[0]) + 1);
+                param[1] = unibi_var_from_num(unibi_num_from_var(param[1]) + 1);
+                break;
+
+            case OP_JZ:
+                if (!unibi_num_from_var(POP())) {
+                    pc = code + get_int(pc);
+                } else {
+                    pc += sizeof (int);
+                }
+                break;
+
+            case OP_JMP:
+                pc = code + get_int(pc);
+                break;
+
+#define ARITH2(C, O) \
+    case (C): { \
+        unibi_var_t x, y; \
+        y = POP(); \
+        x = POP(); \
+        PUSHi(unibi_num_from_var(x) O unibi_num_from_var(y)); \
+    } break
+
+            ARITH2(OP_ADD, +);
+            ARITH2(OP_SUB, -);
+            ARITH2(OP_MUL, *);
+            ARITH2(OP_DIV, /);
+            ARITH2(OP_MOD, %);
+            ARITH2(OP_AND, &);
+            ARITH2(OP_OR, |);
+            ARITH2(OP_XOR, ^);
+            ARITH2(OP_EQ, ==);
+            ARITH2(OP_LT, <);
+            ARITH2(OP_GT, >);
+            ARITH2(OP_LAND, &&);
+            ARITH2(OP_LOR, ||);
+
+#undef ARITH2
+
+#define ARITH1(C, O) \
+    case (C): \
+        PUSHi(O unibi_num_from_var(POP())); \
+        break
+
+            ARITH1(OP_NOT, !);
+            ARITH1(OP_COMPL, ~);
+
+#undef ARITH1
+        }
+    }
+
+#undef PUSHi
+#undef PUSH
+#undef POP
+}
+
+size_t unibi_run_prog(const unibi_prog *prog, unibi_var_t param[9], char *p, size_t n) {
+    unibi_var_t vars[26 + 26] = {{0}};
+    run_ctx_t ctx;
+
+    ctx.p = p;
+    ctx.n = n;
+    ctx.w = 0;
+
+    unibi_format_prog(vars, vars + 26, prog, param, out, &ctx, NULL, NULL);
+    return ctx.w;
+}
@@ -564,6 +564,9 @@ unibi_term *unibi_from_fd(int);
 unibi_term *unibi_from_file(const char *);
 unibi_term *unibi_from_term(const char *);
 unibi_term *unibi_from_env(void);
+unibi_term *unibi_from_term_cached(const char *);
+
+char *unibi_find_term(const char *);
 
 extern const char *const unibi_terminfo_dirs;
 
@@ -627,4 +630,22 @@ void unibi_format(
 
 size_t unibi_run(const char *, unibi_var_t [9], char *, size_t);
 
+typedef struct unibi_prog unibi_prog;
+
+unibi_prog *unibi_compile(const char *);
+void unibi_destroy_prog(unibi_prog *);
+
+void unibi_format_prog(
+    unibi_var_t [26],
+    unibi_var_t [26],
+    const unibi_prog *,
+    unibi_var_t [9],
+    void (*)(void *, const char *, size_t),
+    void *,
+    void (*)(void *, size_t, int, int),
+    void *
+);
+
+size_t unibi_run_prog(const unibi_prog *, unibi_var_t [9], char *, size_t);
+
 #endif /* GUARD_UNIBILIUM_H_ */
@@ -20,57 +20,137 @@ along with unibilium.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "unibilium.h"
+#include "unibilium-internal.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #ifndef TERMINFO_DIRS
 #error "internal error: TERMINFO_DIRS is not defined"
 #endif
 
-enum {MAX_BUF = 4096};
+enum {MIN_BUF = 4096, MIN_MAP = 4 * MIN_BUF};
 
 const char *const unibi_terminfo_dirs = TERMINFO_DIRS;
 
-unibi_term *unibi_from_fp(FILE *fp) {
-    char buf[MAX_BUF];
-    size_t n, r;
+/* Entries with many extended capabilities can be larger than any fixed
+ * buffer, so streams are read into one that grows as needed. */
+static int grow_buf(char **buf, size_t *size) {
+    size_t nsize = *size ? *size * 2 : MIN_BUF;
+    char *nbuf;
 
-    for (n = 0; n < sizeof buf && (r = fread(buf + n, 1, sizeof buf - n, fp)) > 0; ) {
-        n += r;
+    if (nsize < *size || !(nbuf = realloc(*buf, nsize))) {
+        errno = ENOMEM;
+        return 0;
+    }
+    *buf = nbuf;
+    *size = nsize;
+    return 1;
+}
+
+unibi_term *unibi_from_fp(FILE *fp) {
+    char *buf = NULL;
+    size_t size = 0, n = 0, r;
+    unibi_term *ut;
 
-        if (feof(fp)) {
+    for (;;) {
+        if (n == size && !grow_buf(&buf, &size)) {
+            free(buf);
+            return NULL;
+        }
+        if ((r = fread(buf + n, 1, size - n, fp)) == 0) {
             break;
         }
+        n += r;
     }
 
     if (ferror(fp)) {
+        free(buf);
         return NULL;
     }
 
-    return unibi_from_mem(buf, n);
+    ut = unibi_from_mem(buf, n);
+    free(buf);
+    return ut;
+}
+
+static void unmap_entry(void *map, size_t len) {
+    munmap(map, len);
+}
+
+/* Large regular files are mapped, and the term's strings point straight into
+ * the mapping. Below MIN_MAP bytes the mmap and munmap calls cost more than
+ * copying, so such files are read as before. The mapping is private and
+ * writable only so that an entry whose string table is not NUL-terminated
+ * can be fixed up in place. */
+static unibi_term *from_fd_mapped(int fd, const struct stat *st, off_t off) {
+    size_t len = (size_t)st->st_size;
+    void *map;
+    unibi_term *ut;
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (!(ut = unibi_from_map(map, len, (const char *)map + off, len - off, &unmap_entry))) {
+        int e = errno;
+        munmap(map, len);
+        errno = e;
+    }
+    return ut;
 }
 
 unibi_term *unibi_from_fd(int fd) {
-    char buf[MAX_BUF];
-    size_t n;
+    struct stat st;
+    off_t off;
+    char *buf = NULL;
+    size_t size = 0, n = 0;
     ssize_t r;
+    unibi_term *ut;
 
-    for (n = 0; n < sizeof buf && (r = read(fd, buf + n, sizeof buf - n)) > 0; ) {
+    if (
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (uintmax_t)st.st_size <= SIZE_MAX &&
+        (off = lseek(fd, 0, SEEK_CUR)) >= 0 && st.st_size - off >= MIN_MAP
+    ) {
+        if ((ut = from_fd_mapped(fd, &st, off))) {
+            lseek(fd, 0, SEEK_END);
+            return ut;
+        }
+        if (errno != ENODEV && errno != EACCES) {
+            return NULL;
+        }
+        /* the file cannot be mapped; read it instead */
+    }
+
+    for (;;) {
+        if (n == size && !grow_buf(&buf, &size)) {
+            free(buf);
+            return NULL;
+        }
+        if ((r = read(fd, buf + n, size - n)) <= 0) {
+            break;
+        }
         n += r;
     }
 
     if (r < 0) {
+        free(buf);
         return NULL;
     }
 
-    return unibi_from_mem(buf, n);
+    ut = unibi_from_mem(buf, n);
+    free(buf);
+    return ut;
 }
 
 unibi_term *unibi_from_file(const char *file) {
@@ -91,9 +171,34 @@ static int add_overflowed(size_t *dst, size_t src) {
     return *dst < src;
 }
 
-static unibi_term *from_dir(const char *dir_begin, const char *dir_end, const char *mid, const char *term) {
+/* The directory search is shared by unibi_from_term and unibi_find_term;
+ * 'load' gets each candidate path and returns NULL (with errno) to go on. */
+typedef void *loader_fn(const char *);
+
+static void *load_term(const char *path) {
+    return unibi_from_file(path);
+}
+
+static void *find_file(const char *path) {
+    struct stat st;
+    char *copy;
+
+    if (stat(path, &st) < 0) {
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(copy = malloc(strlen(path) + 1))) {
+        return NULL;
+    }
+    return strcpy(copy, path);
+}
+
+static void *from_dir(const char *dir_begin, const char *dir_end, const char *mid, const char *term, loader_fn *load) {
     char *path;
-    unibi_term *ut;
+    void *ut;
     size_t dir_len, mid_len, term_len, path_size;
 
     dir_len = dir_end ? (size_t)(dir_end - dir_begin) : strlen(dir_begin);
@@ -121,19 +226,19 @@ static unibi_term *from_dir(const char *dir_begin, const char *dir_end, const ch
                                  mid ? mid : "", mid ? "/" : "",  term[0], term);
 
     errno = 0;
-    ut = unibi_from_file(path);
+    ut = load(path);
     if (!ut && errno == ENOENT) {
         /* OS X likes to use /usr/share/terminfo/<hexcode>/name instead of the first letter */
         sprintf(path + dir_len + 1 + mid_len, "%02x/%s",
                                                (unsigned int)((unsigned char)term[0] & 0xff),
                                                term);
-        ut = unibi_from_file(path);
+        ut = load(path);
     }
     free(path);
     return ut;
 }
 
-static unibi_term *from_dirs(const char *list, const char *term) {
+static void *from_dirs(const char *list, const char *term, loader_fn *load) {
     const char *a, *z;
 
     if (list[0] == '\0') {
@@ -144,7 +249,7 @@ static unibi_term *from_dirs(const char *list, const char *term) {
     a = list;
 
     for (;;) {
-        unibi_term *ut;
+        void *ut;
 
         while (*a == ':') {
             ++a;
@@ -155,7 +260,7 @@ static unibi_term *from_dirs(const char *list, const char *term) {
 
         z = strchr(a, ':');
 
-        ut = from_dir(a, z, NULL, term);
+        ut = from_dir(a, z, NULL, term, load);
         if (ut) {
             return ut;
         }
@@ -170,8 +275,8 @@ static unibi_term *from_dirs(const char *list, const char *term) {
     return NULL;
 }
 
-unibi_term *unibi_from_term(const char *term) {
-    unibi_term *ut;
+static void *from_term(const char *term, loader_fn *load) {
+    void *ut;
     const char *env;
 
     if (term[0] == '\0' || term[0] == '.' || strchr(term, '/')) {
@@ -180,21 +285,29 @@ unibi_term *unibi_from_term(const char *term) {
     }
 
     if ((env = getenv("TERMINFO"))) {
-        return from_dir(env, NULL, NULL, term);
+        return from_dir(env, NULL, NULL, term, load);
     }
 
     if ((env = getenv("HOME"))) {
-        ut = from_dir(env, NULL, ".terminfo", term);
+        ut = from_dir(env, NULL, ".terminfo", term, load);
         if (ut) {
             return ut;
         }
     }
 
     if ((env = getenv("TERMINFO_DIRS"))) {
-        return from_dirs(env, term);
+        return from_dirs(env, term, load);
     }
 
-    return from_dirs(unibi_terminfo_dirs, term);
+    return from_dirs(unibi_terminfo_dirs, term, load);
+}
+
+unibi_term *unibi_from_term(const char *term) {
+    return from_term(term, &load_term);
+}
+
+char *unibi_find_term(const char *term) {
+    return from_term(term, &find_file);
 }
 
 unibi_term *unibi_from_env(void) {
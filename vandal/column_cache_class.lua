@@ -0,0 +1,473 @@
+--[[
+    Copyright (c) 2017 Alexandru-Mihai Maftei. All rights reserved.
+
+
+    Developed by: Alexandru-Mihai Maftei
+    aka Vercas
+    http://vercas.com | https://github.com/vercas/Vandal
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal with the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimers.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimers in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the names of Alexandru-Mihai Maftei, Vercas, nor the names of
+        its contributors may be used to endorse or promote products derived from
+        this Software without specific prior written permission.
+
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    WITH THE SOFTWARE.
+
+    ---
+
+    You may also find the text of this license in "LICENSE.md".
+]]
+
+local classes = require "vandal/classes"
+local ffi = require "ffi"
+require "vandal/ffi/misc"
+local tk = require "vandal/ffi/tickit"
+
+local c = tk.C
+
+--  Display columns of the lines of a buffer, for turning caret and scroll
+--  columns into byte offsets and back. Each line which was looked at gets a
+--  list of checkpoints, byte offsets paired with the column they start at,
+--  no more than `checkpoint_interval` columns apart. A lookup is a binary
+--  search for the nearest checkpoint and a count over at most that many
+--  columns, so it costs the same anywhere in a line of any length.
+--  Checkpoints are made lazily, as far into a line as was asked for, and an
+--  edit only recounts the span between the checkpoints around it.
+--  Widths are the ones libtickit draws with. Anything it cannot measure, like
+--  control characters or broken UTF-8, is taken to be a column per byte.
+
+local checkpoint_interval = 64
+local fetch_chunk = 64 * 1024
+
+local cl = {
+    Name = "ColumnCache",
+}
+
+local pos, limit = ffi.new "TickitStringPos", ffi.new "TickitStringPos"
+local count_failed = ffi.cast("size_t", -1)
+
+--  Where the first character at or after byte `b` which libtickit cannot
+--  measure starts, or the end of the string. This follows its UTF-8 decoder.
+local function find_unmeasurable(str, b)
+    local len = #str
+
+    while b < len do
+        local b0, n, cp = str:byte(b + 1)
+
+        if b0 == 0 or (b0 >= 0x80 and b0 < 0xc0) or b0 >= 0xf8 then
+            return b
+        elseif b0 < 0x80 then
+            n, cp = 1, b0
+        elseif b0 < 0xe0 then
+            n, cp = 2, b0 % 0x20
+        elseif b0 < 0xf0 then
+            n, cp = 3, b0 % 0x10
+        else
+            n, cp = 4, b0 % 0x08
+        end
+
+        if b + n > len then
+            return b
+        end
+
+        for i = b + 2, b + n do
+            local x = str:byte(i)
+
+            if x == 0 then
+                return b
+            end
+
+            cp = cp * 0x40 + x % 0x40
+        end
+
+        if cp < 0x20 or (cp >= 0x7f and cp < 0xa0) then
+            return b
+        end
+
+        b = b + n
+    end
+
+    return len
+end
+
+--  Counts `str` from byte `b`, which is at column `col`, until a limit is
+--  reached or the string ends. Limits of -1 do not apply. Returns the byte
+--  and column reached, which are always at the start of a grapheme.
+local function count(str, b, col, maxBytes, maxCols, maxGraphemes)
+    local len = #str
+
+    pos.bytes, pos.codepoints, pos.graphemes, pos.columns = b, 0, 0, col
+    limit.bytes, limit.codepoints, limit.graphemes, limit.columns = maxBytes, -1, maxGraphemes, maxCols
+
+    while true do
+        local res = c.tickit_string_ncountmore(str, len, pos, limit)
+
+        b = tonumber(pos.bytes)
+
+        if b >= len or (res ~= count_failed and str:byte(b + 1) ~= 0) then
+            return b, pos.columns
+        end
+
+        --  It stopped at or shortly before something it cannot measure. The
+        --  text up to that is counted on its own, so the outcome does not
+        --  depend on where counting started.
+        local bad = find_unmeasurable(str, b)
+
+        if bad > b then
+            res = c.tickit_string_ncountmore(str, bad, pos, limit)
+            b = tonumber(pos.bytes)
+
+            if res ~= count_failed and b < bad then
+                return b, pos.columns
+            end
+        end
+
+        col = pos.columns
+
+        if (maxBytes >= 0 and b + 1 > maxBytes) or (maxCols >= 0 and col + 1 > maxCols)
+        or (maxGraphemes >= 0 and pos.graphemes + 1 > maxGraphemes) then
+            return b, col
+        end
+
+        pos.bytes, pos.columns, pos.graphemes = b + 1, col + 1, pos.graphemes + 1
+
+        --  Zero-width characters after it belong to it, as they would to any
+        --  other character.
+        limit.bytes, limit.graphemes = -1, pos.graphemes
+
+        if c.tickit_string_ncountmore(str, len, pos, limit) == count_failed then
+            --  Nothing but those was passed before failing again.
+            c.tickit_string_ncountmore(str, find_unmeasurable(str, b + 1), pos, limit)
+        end
+
+        limit.bytes, limit.graphemes = maxBytes, maxGraphemes
+
+        if maxBytes >= 0 and pos.bytes > maxBytes then
+            return b, col
+        end
+    end
+end
+
+--  Index of the last element of `arr` (`n` long, ascending) not above `val`.
+local function search(arr, n, val)
+    local lo, hi = 1, n
+
+    while lo < hi do
+        local mid = math.floor((lo + hi + 1) / 2)
+
+        if arr[mid] <= val then
+            lo = mid
+        else
+            hi = mid - 1
+        end
+    end
+
+    return lo
+end
+
+--  Appends checkpoints for `str`, whose start is at byte `base` and column
+--  `col` of the line, counting no further than byte `maxBytes` of it.
+local function add_checkpoints(e, str, base, col, maxBytes)
+    local b, n = 0, e.n
+
+    while true do
+        local nb, nc = count(str, b, col, maxBytes, col + checkpoint_interval, -1)
+
+        if nb == b then
+            break
+        end
+
+        b, col, n = nb, nc, n + 1
+        e.b[n], e.c[n] = base + b, col
+    end
+
+    e.n = n
+
+    return b
+end
+
+--  Makes checkpoints until one is at or past both the given byte and column,
+--  or the end of the line was reached.
+local function extend(self, e, start, len, byte, col)
+    local bs, cs = e.b, e.c
+
+    while not e.done and (bs[e.n] < byte or cs[e.n] < col) do
+        local from = bs[e.n]
+        local last = from + fetch_chunk >= len
+
+        --  A few bytes past the chunk, so a character across its end can be
+        --  decoded. Counting stops before it, and it starts the next chunk.
+        local str = self.buffer:sub(start + from, last and len - from or fetch_chunk + 8)
+
+        add_checkpoints(e, str, from, cs[e.n], last and -1 or fetch_chunk)
+
+        e.done = last
+    end
+end
+
+local function get_entry(self, line, byte, col)
+    local start, len = self.buffer:line_range(line)
+    local e = self.lines[line]
+
+    if not e then
+        e = { b = { 0 }, c = { 0 }, n = 1, done = false }
+        self.lines[line] = e
+    end
+
+    extend(self, e, start, len, byte, col)
+
+    return e, start
+end
+
+--  The text between checkpoint `k` and the next one.
+local function segment(self, e, start, k)
+    return self.buffer:sub(start + e.b[k], e.b[k + 1] - e.b[k])
+end
+
+function cl:__init(buffer)
+    self.buffer = buffer
+    self.lines = { }
+end
+
+function cl:width(line)
+    local e = get_entry(self, line, math.huge, math.huge)
+
+    return e.c[e.n]
+end
+
+--  Whether the line is wider than the given number of columns. Unlike
+--  `width`, this only looks as far into the line as it needs to.
+function cl:exceeds(line, col)
+    local e = get_entry(self, line, 0, col + 1)
+
+    return e.c[e.n] > col
+end
+
+--  The column at which the character containing the given byte starts.
+--  Returns its first byte too.
+function cl:column(line, byte)
+    local e, start = get_entry(self, line, byte, 0)
+    local k = search(e.b, e.n, byte)
+
+    if e.b[k] == byte or k == e.n then
+        return e.c[k], e.b[k]
+    end
+
+    local b, col = count(segment(self, e, start, k), 0, e.c[k], byte - e.b[k], -1, -1)
+
+    return col, e.b[k] + b
+end
+
+--  The first byte of the last character which starts at or before the given
+--  column, and the column it starts at. Past the end of the line, that is the
+--  end of the line.
+function cl:byte(line, col)
+    local e, start = get_entry(self, line, 0, col)
+    local k = search(e.c, e.n, col)
+
+    if e.c[k] == col or k == e.n then
+        return e.b[k], e.c[k]
+    end
+
+    local b, bcol = count(segment(self, e, start, k), 0, e.c[k], -1, col, -1)
+
+    return e.b[k] + b, bcol
+end
+
+--  Where the character after the one starting at the given byte starts, as a
+--  byte and a column. At the end of the line, that is the end of the line.
+function cl:next(line, byte)
+    local e, start = get_entry(self, line, byte + 1, 0)
+    local k = search(e.b, e.n, byte)
+
+    if k == e.n then
+        return e.b[k], e.c[k]
+    end
+
+    local str = segment(self, e, start, k)
+    local b, col = count(str, 0, e.c[k], byte - e.b[k], -1, -1)
+
+    b, col = count(str, b, col, -1, -1, 1)
+
+    return e.b[k] + b, col
+end
+
+--  Takes note of `removed` bytes at the given byte of the line being replaced
+--  by `inserted` ones, which must not contain line breaks.
+function cl:edit(line, byte, removed, inserted)
+    local e = self.lines[line]
+
+    if not e then
+        return
+    end
+
+    --  A character is decoded from up to four bytes, so in broken UTF-8 one
+    --  which starts up to three bytes before the edit can decode differently
+    --  after it. Counting starts from a checkpoint before any of those.
+    local bs, cs, n = e.b, e.c, e.n
+    local k = search(bs, n, byte - 4)
+
+    if not e.done and byte + removed >= bs[n] then
+        --  Reaches past what was counted, which is counted again on demand.
+        for i = k + 1, n do
+            bs[i], cs[i] = nil, nil
+        end
+
+        e.n = k
+
+        return
+    end
+
+    --  The text from the checkpoint before the edit is counted again, up to
+    --  the first checkpoint after it. That normally still starts a character,
+    --  but around broken UTF-8 the edit can change how the bytes after it
+    --  decode, so counting goes on until it lands on one of the later ones.
+    local delta = inserted - removed
+    local start, len = self.buffer:line_range(line)
+    local m = math.min(search(bs, n, byte + removed) + 1, n)
+    local mid = { b = { bs[k] }, c = { cs[k] }, n = 1 }
+
+    while true do
+        local from, to = mid.b[mid.n], bs[m] + delta
+        local last = m == n and e.done
+
+        --  A few bytes past `to`, so a character across it decodes as it
+        --  does in the whole line.
+        local str = self.buffer:sub(start + from, last and len - from or math.min(to + 8, len) - from)
+
+        add_checkpoints(mid, str, from, mid.c[mid.n], last and -1 or to - from)
+
+        if mid.b[mid.n] == to then
+            break
+        elseif m == n then
+            --  Nothing after this was counted yet, which is done on demand.
+            for i = 2, mid.n do
+                bs[k + i - 1], cs[k + i - 1] = mid.b[i], mid.c[i]
+            end
+
+            for i = k + mid.n, n do
+                bs[i], cs[i] = nil, nil
+            end
+
+            e.n = k + mid.n - 1
+
+            return
+        end
+
+        m = m + 1
+    end
+
+    local dcol = mid.c[mid.n] - cs[m]
+    local shift = (mid.n - 1) - (m - k)
+
+    --  The last new checkpoint is the old `m` moved, and so are the ones after.
+    if shift > 0 then
+        for i = n, m + 1, -1 do
+            bs[i + shift], cs[i + shift] = bs[i] + delta, cs[i] + dcol
+        end
+    else
+        for i = m + 1, n do
+            bs[i + shift], cs[i + shift] = bs[i] + delta, cs[i] + dcol
+        end
+
+        for i = n + shift + 1, n do
+            bs[i], cs[i] = nil, nil
+        end
+    end
+
+    for i = 2, mid.n do
+        bs[k + i - 1], cs[k + i - 1] = mid.b[i], mid.c[i]
+    end
+
+    e.n = n + shift
+end
+
+--  Forgets the given line, whose contents changed, and renumbers the ones
+--  after it when `cnt` lines were inserted after it, or removed when negative.
+function cl:shift(line, cnt)
+    local new = { }
+
+    for l, e in pairs(self.lines) do
+        if l < line then
+            new[l] = e
+        elseif l > line - math.min(cnt, 0) then
+            new[l + cnt] = e
+        end
+    end
+
+    self.lines = new
+end
+
+local ColumnCache = classes.create(cl)
+
+do
+    --  Edits next to broken UTF-8, after which the bytes around them decode
+    --  differently. In the first, removing a stray lead byte turns a checkpoint
+    --  after the edit into the middle of a character. In the second, a NUL
+    --  that kept an earlier lead byte from decoding is replaced.
+    local cases = {
+        { ("a"):rep(63) .. "\195\228\184\173" .. ("x"):rep(100), 63, 1, "" },
+        { ("a"):rep(63) .. "\240\159x\0" .. ("x"):rep(100), 66, 1, "y" },
+    }
+
+    local buf = {
+        line_range = function(self) return 0, #self.str end,
+        sub = function(self, off, len) return self.str:sub(off + 1, off + len) end,
+    }
+
+    for _, case in ipairs(cases) do
+        local str, byte, removed, inserted = unpack(case)
+
+        buf.str = str
+
+        local cache = ColumnCache(buf)
+
+        cache:width(1)
+
+        buf.str = str:sub(1, byte) .. inserted .. str:sub(byte + removed + 1)
+        cache:edit(1, byte, removed, #inserted)
+
+        local fresh = ColumnCache(buf)
+        local same = cache:width(1) == fresh:width(1)
+
+        for b = 0, #buf.str do
+            local c1, b1 = cache:column(1, b)
+            local c2, b2 = fresh:column(1, b)
+            local n1, m1 = cache:next(1, b)
+            local n2, m2 = fresh:next(1, b)
+
+            same = same and c1 == c2 and b1 == b2 and n1 == n2 and m1 == m2
+        end
+
+        for col = 0, fresh:width(1) do
+            local b1, c1 = cache:byte(1, col)
+            local b2, c2 = fresh:byte(1, col)
+
+            same = same and b1 == b2 and c1 == c2
+        end
+
+        if not same then
+            error(string.format("Test failure: Column cache disagrees with a fresh one after an edit at byte %d.", byte))
+        end
+    end
+end
+
+return ColumnCache
@@ -268,10 +268,35 @@ do
         end
     end
 
+    --  Declares a new local in the innermost scope, for the compiler's own
+    --  use, with a name which is not used by any other in the output.
+    function cl:temporary(decl)
+        local s = self["$scopes"]
+        self.temporaries = self.temporaries + 1
+
+        local var = clVar("__tmp" .. self.temporaries, "temporary", true, decl)
+        s[#s][var.name] = var
+
+        return var
+    end
+
     function cl:__init(parent)
         self.in_statement = true
-        self.tail = true
+        self.tail = true    --  Or the temporary which receives the value.
         self["$scopes"] = { clScp() }
+        self.folds = { }    --  Constant values of expressions, by node.
+        self.spills = { }   --  Expressions which put statements before theirs.
+        self.lowered = { }  --  Conditionals used as values, turned into those.
+        self.all_values = { }   --  Values all of whose results are used.
+        self.temporaries = 0
+
+        --  The temporary a `return` assigns to, when it is in a conditional
+        --  being lowered, rather than returning from the function.
+        self.returns_to = false
+
+        --  Where statements are put when they have to run before the one
+        --  being compiled, and whether that is allowed here.
+        self.hoist_at, self.no_hoist = 0, false
     end
 
     clCmp = classes.create(cl)
@@ -304,6 +329,8 @@ do
     local cl = {
         Name = "OperatorExpression",
         ParentName = "Expression",
+
+        kind = "OperatorExpression",
     }
 
     function cl:__init(opr)
@@ -327,6 +354,8 @@ do
     local cl = {
         Name = "ConstantExpression",
         ParentName = "Expression",
+
+        kind = "ConstantExpression",
     }
 
     function cl:__init(val)
@@ -355,6 +384,8 @@ do
     local cl = {
         Name = "VariableExpression",
         ParentName = "Expression",
+
+        kind = "VariableExpression",
     }
 
     function cl:__init(name)
@@ -374,6 +405,8 @@ do
     local cl = {
         Name = "CommandExpression",
         ParentName = "Expression",
+
+        kind = "CommandExpression",
     }
 
     function cl:__init(typ)
@@ -424,6 +457,8 @@ do
     local cl = {
         Name = "SequenceExpression",
         ParentName = "Expression",
+
+        kind = "SequenceExpression",
     }
 
     function cl:__init()
@@ -455,6 +490,8 @@ do
     local cl = {
         Name = "Subexpression",
         ParentName = "SequenceExpression",
+
+        kind = "Subexpression",
     }
 
     function cl:__init()
@@ -478,14 +515,105 @@ do
     SubExp = classes.create(cl)
 end
 
+--  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
+--  Expression Nodes    --
+--  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
+
+--  The parser builds plain tables instead of instances of the classes above,
+--  because going through their metatables for every token and every field
+--  read is most of what parsing used to cost. A node's `kind` is the name of
+--  the matching class, which the instances have as well, so the compiler can
+--  be given either. `view` turns a tree of nodes into instances, for printing.
+
+local view
+
+local function new_operator(opr, start, finish)
+    return { kind = "OperatorExpression", opr = opr, start = start, finish = finish }
+end
+
+local function new_constant(str, start, finish)
+    return { kind = "ConstantExpression", string = str, start = start, finish = finish }
+end
+
+local function new_variable(name, start, finish)
+    return { kind = "VariableExpression", name = name, start = start, finish = finish }
+end
+
+local function new_command(start)
+    return { kind = "CommandExpression", command_name = false, args = { }, start = start, finish = -1 }
+end
+
+local function new_sequence(kind, start)
+    return { kind = kind, subexpressions = { }, start = start, finish = -1 }
+end
+
+local function add_component(exp, comp)
+    if exp.command_name then
+        local args = exp.args
+        args[#args + 1] = comp
+    else
+        exp.command_name = comp
+    end
+end
+
+local function add_expression(seq, exp)
+    local subs = seq.subexpressions
+    subs[#subs + 1] = exp
+end
+
+local function kind_of(val)
+    return type(val) == "table" and val.kind or types.get(val)
+end
+
+local function is_node(val)
+    return type(val) == "table" and val.kind ~= nil
+end
+
+--  Whether a constant is exactly the given word, without quotes or escapes.
+local function eq(exp, str)
+    return exp.string == str and #str == (exp.finish - exp.start + 1)
+end
+
+function view(node)
+    local kind, res = node.kind
+
+    if kind == "OperatorExpression" then
+        res = OprExp(node.opr)
+    elseif kind == "ConstantExpression" then
+        res = ConExp(node.string)
+    elseif kind == "VariableExpression" then
+        res = VarExp(node.name)
+    elseif kind == "CommandExpression" then
+        res = CmdExp()
+
+        if node.command_name then
+            res:add_component(view(node.command_name))
+        end
+
+        for i = 1, #node.args do
+            res:add_component(view(node.args[i]))
+        end
+    elseif kind == "SequenceExpression" or kind == "Subexpression" then
+        res = kind == "Subexpression" and SubExp() or SeqExp()
+
+        for i = 1, #node.subexpressions do
+            res:add_expression(view(node.subexpressions[i]))
+        end
+    else
+        error("Vandal commands error: Cannot view a node of kind " .. tostring(kind) .. ".")
+    end
+
+    res.start, res.finish, res.type = node.start, node.finish, node.type or false
+
+    return res
+end
+
 --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
 --  Parser  --
 --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
 
 local parse
 local escape_sequences = { n = '\n', t = '\t', b = '\b', }
-local word_characters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"
-local operator_characters = "!%^&*-+=<>/|~"
 local operator_translation = {
     --  Type 1: Left-associative infix binary operator, translates to Lua operator.
     --  Type 2: Non-associative infix binary operator, translates to Lua operator.
@@ -528,6 +656,8 @@ for kw, e in pairs(constant_names) do
 end
 
 do
+    local byte, sub, find, concat = string.byte, string.sub, string.find, table.concat
+
     local operator_state_machine = {
         false,
 
@@ -570,155 +700,192 @@ do
         },
     }
 
-    local function parse_operator(line, linelen, i)
-        local res, state, start, c = { }, operator_state_machine, i
+    --  The state machine flattened by byte: the operator a character is on its
+    --  own, if any, and the two-character operators it starts.
+    local operator_bytes = { }
 
-        while i <= linelen do
-            c = line:sub(i, i)
+    for c, state in pairs(operator_state_machine) do
+        if type(c) == "string" then
+            local ent = { alone = (state == true or state[1]) and c or false }
+
+            if type(state) == "table" then
+                for c2 in pairs(state) do
+                    if type(c2) == "string" then
+                        ent[byte(c2)] = c .. c2
+                    end
+                end
+            end
 
-            if not c then break end
+            operator_bytes[byte(c)] = ent
+        end
+    end
 
-            if state[c] then
-                state = state[c]
-                res[#res + 1] = c
+    local B_TAB, B_LF, B_SPACE, B_DQ, B_HASH, B_DOLLAR, B_SQ = 9, 10, 32, 34, 35, 36, 39
+    local B_SEMICOLON, B_LBRACKET, B_BACKSLASH, B_RBRACKET, B_LBRACE, B_RBRACE = 59, 91, 92, 93, 123, 125
 
-                if state == true then
-                    break
-                end
-            else
-                i = i - 1
-                --  The current character is not part of the operator.
+    --  Scanning goes byte by byte through lookup tables, because LuaJIT only
+    --  compiles `string.find` for plain searches.
+    local word_bytes, space_bytes = { }, { [B_TAB] = true, [B_LF] = true, [B_SPACE] = true }
 
-                break
-            end
+    for b = byte "a", byte "z" do word_bytes[b] = true end
+    for b = byte "A", byte "Z" do word_bytes[b] = true end
+    for b = byte "0", byte "9" do word_bytes[b] = true end
+    word_bytes[byte "_"] = true
 
+    --  Returns the offset of the last word character from the given one on.
+    local function word_end(line, i)
+        while word_bytes[byte(line, i)] do
             i = i + 1
         end
 
-        res = OprExp(table.concat(res))
-        res.start = start
+        return i - 1
+    end
 
-        if state == true or (state and state[1]) then
-            --  Means this is a valid state to end in.
-            res.finish = i
+    --  Parts of a word with quotes or escapes in it, reused between words.
+    local pieces = { }
 
-            return res, math.min(i, linelen)
-        else
-            --  Means this is an intermediate state, or an invalid end state, but not and a valid end state.
-            res.finish = i - 1
+    local function parse_operator(line, linelen, i)
+        local ent = operator_bytes[byte(line, i)]
+        local pair = i < linelen and ent[byte(line, i + 1)]
 
-            return res, i - 1, "Incomplete operator started at #" .. start
+        if pair then
+            return new_operator(pair, i, i + 1), i + 1
+        elseif ent.alone then
+            return new_operator(ent.alone, i, i), i
         end
+
+        --  Means this is an intermediate state, but not a valid end state. The
+        --  offset given back is the one before the operator, unless it ends
+        --  the line, as the parser has always reported it.
+        local last = i < linelen and i - 1 or i
+
+        return new_operator(sub(line, i, i), i, last), last, "Incomplete operator started at #" .. i
     end
 
+    --  Returns the word, and the offset of its last character; or one past the
+    --  end of the line when it runs to the end.
     local function parse_word(line, linelen, i)
-        local res = { }
+        local last = word_end(line, i)
+        local b = byte(line, last + 1)
 
-        local inEscape, inSQ, inDQ = false, false, false
-        local wordStart, quoteStart, c = i
+        if b ~= B_BACKSLASH and b ~= B_DQ and b ~= B_SQ then
+            --  No quotes or escapes, which is most words.
 
-        while i <= linelen do
-            c = line:sub(i, i)
-
-            if not c then break end
-
-            if inEscape then
-                res[#res + 1] = escape_sequences[c] or c
-
-                inEscape = false
-            elseif quoteStart then
-                if c == '\\' then
-                    inEscape = true
-                elseif inSQ and c == "'" then
-                    quoteStart = nil
-                    inSQ = false
-                elseif inDQ and c == '"' then
-                    quoteStart = nil
-                    inDQ = false
-                else
-                    res[#res + 1] = c
-                end
-            else
-                if c == '\\' then
-                    inEscape = true
-                elseif c == '"' then
-                    quoteStart = i
-                    inDQ = true
-                elseif c == "'" then
-                    quoteStart = i
-                    inSQ = true
-                elseif word_characters:find(c, 1, true) then
-                    res[#res + 1] = c
-                else
-                    --  This character does not belong to this word.
+            return new_constant(sub(line, i, last), i, last), last < linelen and last or linelen + 1
+        end
 
-                    i = i - 1
+        local n, j, err = 0, last + 1
 
+        if last >= i then
+            n = 1
+            pieces[1] = sub(line, i, last)
+        end
+
+        while j <= linelen do
+            b = byte(line, j)
+
+            if b == B_BACKSLASH then
+                if j == linelen then
+                    err = "Unfinished escape sequence at character #" .. j
                     break
                 end
-            end
 
-            i = i + 1
-        end
+                local c = sub(line, j + 1, j + 1)
+                n = n + 1
+                pieces[n] = escape_sequences[c] or c
+                j = j + 2
+            elseif b == B_DQ or b == B_SQ then
+                local quoteStart = j
+                j = j + 1
 
-        res = ConExp(table.concat(res))
-        res.start, res.finish = wordStart, math.min(i, linelen)
+                while true do
+                    local e = j
 
-        if inEscape then
-            return res, i, "Unfinished escape sequence at character #" .. (i - 1)
-        end
+                    while e <= linelen and byte(line, e) ~= b and byte(line, e) ~= B_BACKSLASH do
+                        e = e + 1
+                    end
+
+                    if e > j then
+                        n = n + 1
+                        pieces[n] = sub(line, j, e - 1)
+                    end
+
+                    if e > linelen then
+                        err = "Unpaired " .. (b == B_DQ and "double" or "single") .. " quotes at character #" .. quoteStart
+                        break
+                    elseif byte(line, e) == b then
+                        j = e + 1
+                        break
+                    elseif e == linelen then
+                        err = "Unfinished escape sequence at character #" .. e
+                        break
+                    end
+
+                    local c = sub(line, e + 1, e + 1)
+                    n = n + 1
+                    pieces[n] = escape_sequences[c] or c
+                    j = e + 2
+                end
+
+                if err then break end
+            else
+                last = word_end(line, j)
+
+                if last < j then
+                    --  This character does not belong to this word.
+                    break
+                end
 
-        if inSQ then
-            return res, i, "Unpaired single quotes at character #" .. quoteStart
+                n = n + 1
+                pieces[n] = sub(line, j, last)
+                j = last + 1
+            end
         end
 
-        if inDQ then
-            return res, i, "Unpaired double quotes at character #" .. quoteStart
+        if err or j > linelen then
+            return new_constant(concat(pieces, "", 1, n), i, linelen), linelen + 1, err
         end
 
-        return res, i
+        return new_constant(concat(pieces, "", 1, n), i, j - 1), j - 1
     end
 
     local exty_names = { main = "main/outer", cmdarg = "command argument", subexp = "sub-expression" }
 
     local function _parse(line, linelen, i, exty)
-        local exp, start, res, err, seq = CmdExp(), (exty == "main") and i or (i - 1)
-        local subStart, inLineComment, inBlockComment, blockCommentStart = start, false, false
-        exp.start = start
+        local start = (exty == "main") and i or (i - 1)
+        local exp, res, err, seq = new_command(start)
+        local subStart, blockCommentStart = start, false
 
         local firstWord = true
 
         while i <= linelen do
-            local c = line:sub(i, i)
+            local b = byte(line, i)
 
-            if inLineComment then
-                if c == '\n' then
-                    inLineComment = false
-                elseif c == '[' and i - 1 == inLineComment then
-                    --  #[ means this is a block comment.
+            if b == B_SPACE or b == B_TAB or b == B_LF then
+                --  Whitespaces are completely ignored here.
 
-                    blockCommentStart = inLineComment
-                    inLineComment, inBlockComment = false, true
-                end
+                repeat
+                    i = i + 1
+                until not space_bytes[byte(line, i)]
 
-                --  Everything else is ignored.
-            elseif inBlockComment then
-                if c == '#' then
-                    inBlockComment = i
-                elseif c == ']' and i - 1 == inBlockComment then
-                    --  #] means this block comment has ended!.
+                i = i - 1
+            elseif b == B_HASH then
+                if byte(line, i + 1) == B_LBRACKET then
+                    --  #[ means this is a block comment, until #].
 
-                    inBlockComment = false
-                end
+                    local e = find(line, "#]", i + 2, true)
 
-                --  Everything else is ignored.
-            elseif string.find(" \t\n", c, 1, true) then
-                --  Whitespaces are completely ignored here.
-            elseif c == '#' then
-                --  Means the beginning of a line comment.
+                    if e then
+                        i = e + 1
+                    else
+                        blockCommentStart, i = i, linelen
+                    end
+                else
+                    --  Means a line comment; everything until the line feed is ignored.
 
-                inLineComment = i
-            elseif c == '[' then
+                    i = find(line, "\n", i + 1, true) or linelen
+                end
+            elseif b == B_LBRACKET then
                 --  Means the beginning of a sub statement.
 
                 if firstWord then
@@ -728,7 +895,7 @@ do
                 end
 
                 res, i, err = _parse(line, linelen, i + 1, "cmdarg")
-            elseif c == ']' then
+            elseif b == B_RBRACKET then
                 if exty ~= "cmdarg" then
                     return exp, i, "Stray ']' found in (" .. exty .. ") command at character #" .. i
                 end
@@ -742,7 +909,7 @@ do
                 exp.finish = i
 
                 return exp, i
-            elseif c == '{' then
+            elseif b == B_LBRACE then
                 --  Means the beginning of a sub-expression.
 
                 if firstWord then
@@ -752,7 +919,7 @@ do
                 end
 
                 res, i, err = _parse(line, linelen, i + 1, "subexp")
-            elseif c == '}' then
+            elseif b == B_RBRACE then
                 if exty ~= "subexp" then
                     return exp, i, "Stray '}' found in (" .. exty .. ") command at character #" .. i
                 end
@@ -765,53 +932,42 @@ do
                 --  Note: An empty subexpression is completely fine!
 
                 if not seq then
-                    seq = SubExp()
-                    seq.start = exp.start
+                    seq = new_sequence("Subexpression", exp.start)
                 end
 
                 if not firstWord then
-                    seq:add_expression(exp)
+                    add_expression(seq, exp)
                 end
 
                 seq.finish = i
 
                 return seq, i
-            elseif c == ';' then
+            elseif b == B_SEMICOLON then
                 if exty == "cmdarg" then
                     return exp, i, "Sequence separator at character #" .. i .. " should not appear inside a command substitution"
                 end
 
                 if not seq then
-                    if exty == "main" then
-                        seq = SeqExp()
-                    else
-                        seq = SubExp()
-                    end
-
-                    seq.start = exp.start
+                    seq = new_sequence(exty == "main" and "SequenceExpression" or "Subexpression", exp.start)
                 end
 
-                seq:add_expression(exp)
+                add_expression(seq, exp)
 
-                exp, firstWord, start, res, err = CmdExp(), true, i + 1, nil, nil
-                exp.start = start
-            elseif c == "$" then
+                exp, firstWord, start, res, err = new_command(i + 1), true, i + 1, nil, nil
+            elseif b == B_DOLLAR then
                 local oi = i + 1
                 res, i, err = parse_word(line, linelen, oi)
 
                 if i < oi then
-                    return exp, i, "Illegal character encountered at #" .. i .. ": " .. c .. " - expected word"
+                    return exp, i, "Illegal character encountered at #" .. i .. ": $ - expected word"
                 elseif res.string == "" then
                     return exp, i, "Expected identifier for variable name at #" .. i
                 end
 
-                local var = VarExp(res.string)
-                var.start, var.finish = res.start, res.finish
-
-                res = var
+                res = new_variable(res.string, res.start, res.finish)
 
                 firstWord = false
-            elseif operator_characters:find(c, 1, true) then
+            elseif operator_bytes[b] then
                 res, i, err = parse_operator(line, linelen, i)
 
                 firstWord = false
@@ -823,14 +979,14 @@ do
 
                 if i < oi then
                     --  Parser couldn't advance because this character doesn't belong anywhere.
-                    return exp, i, "Illegal character encountered at #" .. i .. ": " .. c
+                    return exp, i, "Illegal character encountered at #" .. i .. ": " .. sub(line, oi, oi)
                 end
 
                 firstWord = false
             end
 
             if res ~= nil then
-                exp:add_component(res)
+                add_component(exp, res)
                 res = nil
             end
 
@@ -847,13 +1003,13 @@ do
             err = "Command substitution beginning at character #" .. subStart .. " lacks a closing ']'"
         elseif exty == "subexp" then
             err = "Subexpression beginning at character #" .. subStart .. " lacks a closing '}'"
-        elseif inBlockComment then
+        elseif blockCommentStart then
             err = "Block comment started at character #" .. blockCommentStart .. " lacks closing '#]'"
         end
 
         if seq then
             if not firstWord then
-                seq:add_expression(exp)
+                add_expression(seq, exp)
                 exp.finish = i - 1
             end
 
@@ -883,10 +1039,10 @@ do
             ERR("ERROR: ", err)
             LASTRES = false
         else
-            LASTRES = tostring(res)
+            LASTRES = tostring(view(res))
         end
 
-        ERR(res)
+        ERR(view(res))
     end
 
     local function CHECKLAST(val)
@@ -958,6 +1114,13 @@ do
 
     local conditional_keywords = { ["if"] = "if", ["elif"] = "elseif", ["else"] = "else" }
 
+    --  The value of a constant as each type, or nil if it is not valid as one.
+    local constant_readers = {
+        number = function(str) return (string.parsenumber(str)) end,
+        boolean = toboolean,
+        string = function(str) return str end,
+    }
+
     local function compConExp(comp, exp, typ)
         local oldIS = comp.in_statement
 
@@ -967,20 +1130,24 @@ do
         end
 
         if typ == "number" then
-            if not exp.number then
+            local num = string.parsenumber(exp.string)
+
+            if not num then
                 comp.exp, comp.err = exp, "Constant should be a valid number"
                 return
             end
 
-            comp:add(tostring(exp.number))
+            comp:add(tostring(num))
             exp.type = "number"
         elseif typ == "boolean" then
-            if not exp.boolean then
+            local bool = toboolean(exp.string)
+
+            if not bool then
                 comp.exp, comp.err = exp, "Constant should be a valid boolean"
                 return
             end
 
-            comp:add(tostring(exp.boolean))
+            comp:add(tostring(bool))
             exp.type = "boolean"
         elseif typ == "string" or not typ then
             comp:add(string.format("%q", exp.string))
@@ -990,9 +1157,11 @@ do
             local hit = false
 
             for i = 1, #typ do
-                if exp[typ[i]] then
+                local val = constant_readers[typ[i]](exp.string)
+
+                if val then
                     hit = true
-                    comp:add(tostring(exp[typ[i]]))
+                    comp:add(tostring(val))
                     exp.type = typ[i]
                     break
                 end
@@ -1056,6 +1225,101 @@ do
         end
     end
 
+    --  Starts the statement which gives a value back: a `return`, or an
+    --  assignment to the temporary a conditional is being lowered into.
+    local function compTail(comp, tail)
+        if tail == true then
+            comp:add "return "
+        else
+            comp:add(tail.lua_identifier)
+            comp:add " = "
+        end
+    end
+
+    --  Moves the output added after the mark to where statements which run
+    --  before the current one go, after any put there earlier.
+    local function hoist(comp, mark)
+        local at, cnt = comp.hoist_at, #comp - mark
+
+        if at < mark then
+            local moved = { }
+
+            for i = 1, cnt do
+                moved[i] = comp[mark + i]
+            end
+
+            for i = mark, at + 1, -1 do
+                comp[i + cnt] = comp[i]
+            end
+
+            for i = 1, cnt do
+                comp[at + i] = moved[i]
+            end
+        end
+
+        comp.hoist_at = at + cnt
+    end
+
+    --  The position of the last value in the list which is lowered into
+    --  statements, or 0. Every value before it which is not constant has to
+    --  be put in a temporary, so it is still evaluated first.
+    local function last_spill(comp, list)
+        if comp.no_hoist then return 0 end
+
+        for i = #list, 1, -1 do
+            if comp.spills[list[i]] then
+                return i
+            end
+        end
+
+        return 0
+    end
+
+    --  Whether an operator expression evaluates some operands only depending
+    --  on others, so nothing in it can be moved ahead.
+    local function short_circuits(exp)
+        local cn, ca = exp.command_name, exp.args
+
+        if kind_of(cn) == "OperatorExpression" and (cn.opr == "&&" or cn.opr == "||") then
+            return true
+        end
+
+        for i = 1, #ca do
+            if kind_of(ca[i]) == "OperatorExpression" and (ca[i].opr == "&&" or ca[i].opr == "||") then
+                return true
+            end
+        end
+
+        return false
+    end
+
+    local function volatile(comp, val)
+        local vType = kind_of(val)
+
+        return (vType == "CommandExpression" or vType == "VariableExpression") and not comp.folds[val] and not comp.lowered[val]
+    end
+
+    --  Compiles a value into a new temporary declared before the statement,
+    --  and refers to the temporary in its place.
+    local function compSpilled(comp, val, compValue, typ)
+        local mark, oldH, var = #comp, comp.hoist_at, comp:temporary(val)
+
+        if comp.indent then comp:add(comp.indent) end
+        comp:add "local "
+        comp:add(var.lua_identifier)
+        comp:add " = "
+
+        comp.hoist_at = mark
+        compValue(comp, val, typ)
+        comp.hoist_at = oldH
+
+        if comp.err then return end
+
+        comp:add "\n"
+        hoist(comp, mark)
+        comp:add(var.lua_identifier)
+    end
+
     local function compCmdExpOprMulti(comp, exp, arr, opr)
     end
 
@@ -1067,10 +1331,11 @@ do
         end
 
         local stack = { }   --  Stack will store operators.
+        local last = last_spill(comp, arr)
 
         for i = 1, #arr do
             local oper = arr[i]
-            local oType = types.get(oper)
+            local oType = kind_of(oper)
 
             if oType == "OperatorExpression" then
                 local opr = operator_translation[oper.opr]
@@ -1102,7 +1367,9 @@ do
 
                 top.operands = top.operands + 1
 
-                if oType == "CommandExpression" then
+                if i < last and volatile(comp, oper) then
+                    compSpilled(comp, oper, oType == "CommandExpression" and compCmdExp or compVarExp)
+                elseif oType == "CommandExpression" then
                     compCmdExp(comp, oper)
                 elseif oType == "VariableExpression" then
                     compVarExp(comp, oper)
@@ -1140,11 +1407,13 @@ do
         end
     end
 
-    local function compRpnOperand(comp, operand, operator)
+    local function compRpnOperand(comp, operand, operator, spilled)
         if #operand == 1 then
-            local oType = types.get(operand[1])
+            local oType = kind_of(operand[1])
 
-            if oType == "CommandExpression" then
+            if spilled[operand[1]] then
+                compSpilled(comp, operand[1], oType == "CommandExpression" and compCmdExp or compVarExp)
+            elseif oType == "CommandExpression" then
                 compCmdExp(comp, operand[1])
             elseif oType == "VariableExpression" then
                 compVarExp(comp, operand[1])
@@ -1174,7 +1443,7 @@ do
                     end
                 end
 
-                compRpnOperand(comp, operand[i], operand[1])
+                compRpnOperand(comp, operand[i], operand[1], spilled)
             end
 
             comp:add ")"
@@ -1189,10 +1458,17 @@ do
         end
 
         local stack = { }   --  Stack will store operands.
+        local spilled = { }
+
+        for i = 1, last_spill(comp, arr) - 1 do
+            if volatile(comp, arr[i]) then
+                spilled[arr[i]] = true
+            end
+        end
 
         for i = 1, #arr do
             local oper = arr[i]
-            local oType = types.get(oper)
+            local oType = kind_of(oper)
 
             if oType == "OperatorExpression" then
                 local opr = operator_translation[oper.opr]
@@ -1217,13 +1493,173 @@ do
             comp.exp, comp.err = exp, "Unbalanced (excess) operands in Reverse Polish Notation expression"
         end
 
-        return compRpnOperand(comp, stack[1])
+        return compRpnOperand(comp, stack[1], nil, spilled)
+    end
+
+    --  The operands of an operator expression as a tree, whose operations are
+    --  `{ operator, left, right }`; false if the expression is malformed, which
+    --  the functions above report.
+    local function operator_tree(exp, arr, fO)
+        local function pn(i)
+            local oper = arr[i]
+
+            if kind_of(oper) ~= "OperatorExpression" then
+                return oper ~= nil and oper, i + 1
+            end
+
+            local opr, left, right = operator_translation[oper.opr]
+
+            if not opr then return false end
+
+            left, i = pn(i + 1)
+            if not left then return false end
+            right, i = pn(i)
+            if not right then return false end
+
+            return { opr, left, right, node = exp }, i
+        end
+
+        if fO then
+            local tree, i = pn(1)
+
+            return i == #arr + 1 and tree
+        end
+
+        local stack = { }
+
+        for i = 1, #arr do
+            local oper = arr[i]
+
+            if kind_of(oper) == "OperatorExpression" then
+                local opr, sz = operator_translation[oper.opr], #stack
+
+                if not opr or sz < 2 then return false end
+
+                stack[sz - 1], stack[sz] = { opr, stack[sz - 1], stack[sz], node = exp }, nil
+            else
+                stack[#stack + 1] = oper
+            end
+        end
+
+        return #stack == 1 and stack[1]
+    end
+
+    --  Whether compiling part of an operator tree puts statements before the
+    --  one it is in, or evaluates anything which those could change.
+    local function tree_spills(comp, t)
+        if t.node then
+            return tree_spills(comp, t[2]) or tree_spills(comp, t[3])
+        end
+
+        return comp.spills[t]
+    end
+
+    local function tree_volatile(comp, t)
+        if t.node then
+            return tree_volatile(comp, t[2]) or tree_volatile(comp, t[3])
+        end
+
+        return volatile(comp, t) or comp.spills[t]
+    end
+
+    local compOprTree
+
+    --  An `&&` or `||` whose right operand puts statements before the one it
+    --  is in cannot have them run every time. The operation becomes a new
+    --  temporary holding the left operand, which an `if` replaces with the
+    --  right one when that is what the operator would give.
+    local function compShortCircuit(comp, t)
+        local opr, oldI, oldH = t[1], comp.indent, comp.hoist_at
+        local mark, var = #comp, comp:temporary(t.node)
+        local inner = oldI and oldI .. "    " or "    "
+
+        if oldI then comp:add(oldI) end
+        comp:add "local "
+        comp:add(var.lua_identifier)
+        comp:add " = "
+
+        comp.hoist_at = mark
+        compOprTree(comp, t[2], opr.operands_type)
+
+        if comp.err then return end
+
+        comp:add "\n"
+        if oldI then comp:add(oldI) end
+        comp:add(opr.lua_infix == " and " and "if " or "if not ")
+        comp:add(var.lua_identifier)
+        comp:add " then\n"
+
+        comp.indent, comp.hoist_at = inner, #comp
+        comp:add(inner)
+        comp:add(var.lua_identifier)
+        comp:add " = "
+        compOprTree(comp, t[3], opr.operands_type)
+
+        if comp.err then return end
+
+        comp:add "\n"
+        if oldI then comp:add(oldI) end
+        comp:add "end\n"
+
+        comp.indent, comp.hoist_at = oldI, oldH
+        hoist(comp, mark)
+        comp:add(var.lua_identifier)
+    end
+
+    --  Compiles an operator expression from its tree, which is only done when
+    --  it short-circuits and something in it has to be lowered.
+    function compOprTree(comp, t, typ)
+        if not t.node then
+            local oType = kind_of(t)
+
+            if oType == "CommandExpression" then
+                compCmdExp(comp, t)
+            elseif oType == "VariableExpression" then
+                compVarExp(comp, t)
+            elseif oType == "ConstantExpression" then
+                compConExp(comp, t, typ)
+            else
+                comp.exp, comp.err = t, "Operands in an expression must be command substitutions, variable accesses, or constants"
+            end
+
+            return
+        end
+
+        local opr = t[1]
+        local later = tree_spills(comp, t[3])
+
+        if later and (opr.lua_infix == " and " or opr.lua_infix == " or ") then
+            return compShortCircuit(comp, t)
+        end
+
+        if opr.archetype == 3 then
+            comp:add(opr.lua_function)
+        end
+
+        comp:add "("
+
+        --  The left operand has to be evaluated before any statements the right
+        --  one puts ahead.
+        if later and tree_volatile(comp, t[2]) then
+            compSpilled(comp, t[2], compOprTree, opr.operands_type)
+        else
+            compOprTree(comp, t[2], opr.operands_type)
+        end
+
+        if comp.err then return end
+
+        comp:add(opr.archetype == 3 and ", " or opr.lua_infix)
+        compOprTree(comp, t[3], opr.operands_type)
+
+        if comp.err then return end
+
+        comp:add ")"
     end
 
     local function compCmdExpOprAsgn(comp, exp, arr)
         for i = 1, #arr - 2 do
             local name = arr[i]
-            local nType = types.get(name)
+            local nType = kind_of(name)
 
             if nType == "ConstantExpression" then
                 if not name.string:match "^[a-zA-Z_][0-9a-zA-Z_]*$" then
@@ -1237,7 +1673,7 @@ do
                 local var = comp.scope[name.string]
 
                 if not var then
-                    comp.exp, comp.err = name, "No variable defined with the name " .. name
+                    comp.exp, comp.err = name, "No variable defined with the name " .. name.string
                     return
                 end
 
@@ -1248,13 +1684,13 @@ do
                 comp:add(var.lua_identifier)
             else
                 comp.exp, comp.err = exp, "Variable assignment needs names before the assignment operator; operand #" .. i .. " is not a name"
-                if types.match(name, "Expression") then comp.exp = name end
+                if is_node(name) then comp.exp = name end
                 return
             end
         end
 
         local val = arr[#arr]
-        local vType = types.get(val)
+        local vType = kind_of(val)
 
         comp:add " = "
         comp.tail, comp.in_statement = false, false
@@ -1267,21 +1703,21 @@ do
             compVarExp(comp, val)
         else
             comp.exp, comp.err = exp, "Local writing value must be a constant or a command substitution"
-            if types.match(val, "Expression") then comp.exp = val end
+            if is_node(val) then comp.exp = val end
             return
         end
     end
 
     local function compCmdExpOpr(comp, exp)
-        local oldT, oldIS, oldI = comp.tail, comp.in_statement, comp.indent
+        local oldT, oldIS, oldI, oldNH = comp.tail, comp.in_statement, comp.indent, comp.no_hoist
         local ca, arr, oprcnt, fO, lO = exp.args, { exp.command_name }, 0
 
-        fO = types.get(arr[1]) == "OperatorExpression"
+        fO = kind_of(arr[1]) == "OperatorExpression"
         if fO then oprcnt = 1 end
 
         for i = 1, #ca do
             arr[i + 1] = ca[i]
-            lO = types.get(ca[i]) == "OperatorExpression"
+            lO = kind_of(ca[i]) == "OperatorExpression"
 
             if lO then oprcnt = oprcnt + 1 end
         end
@@ -1295,12 +1731,23 @@ do
             end
         else
             if oldIS and oldI then comp:add(oldI) end
-            if oldT then comp:add "return " end
+            if oldT then compTail(comp, oldT) end
         end
 
         comp.tail, comp.in_statement = false, false
 
-        if fO then
+        --  Nothing evaluated only depending on other operands may be moved
+        --  ahead, unless the operators deciding that are turned into `if`s.
+        local tree = short_circuits(exp) and comp.spills[exp] and not oldNH and fO ~= lO
+            and not (oprcnt == 1 and #arr > 3) and operator_tree(exp, arr, fO)
+
+        if short_circuits(exp) and not tree then
+            comp.no_hoist = true
+        end
+
+        if tree then
+            compOprTree(comp, tree)
+        elseif fO then
             if lO then
                 comp.exp, comp.err = exp, "Operator-enabled expression has an unrecognized structure"
             else
@@ -1316,23 +1763,532 @@ do
 
         if comp.err then return end
 
-        comp.tail, comp.in_statement, comp.indent = oldT, oldIS, oldI
+        comp.tail, comp.in_statement, comp.indent, comp.no_hoist = oldT, oldIS, oldI, oldNH
     end
 
-    function compCmdExp(comp, exp)
-        local cn, ca = exp.command_name, exp.args
-        local cnt = types.get(cn)
+    --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
+    --  Before any code is generated, operator expressions whose operands are
+    --  all constants are evaluated here, the same way the generated Lua would
+    --  evaluate them, and so are constant names. The values are kept in the
+    --  compiler by node, leaving the tree as it was parsed. Anything which
+    --  would not compile, or would fail when run, is left to the code
+    --  generator, so errors are reported exactly as before.
+
+    local fold_operations = {
+        ["+"]  = function(a, b) return a + b end,
+        ["-"]  = function(a, b) return a - b end,
+        ["*"]  = function(a, b) return a * b end,
+        ["/"]  = function(a, b) return a / b end,
+        ["%"]  = function(a, b) return a % b end,
+        ["&"]  = bit.band,
+        ["|"]  = bit.bor,
+        ["^"]  = bit.bxor,
+        ["~"]  = function(a, b) return a .. b end,
+        ["&&"] = function(a, b) return a and b end,
+        ["||"] = function(a, b) return a or b end,
+        ["=="] = function(a, b) return a == b end,
+        ["!="] = function(a, b) return a ~= b end,
+        ["<="] = function(a, b) return a <= b end,
+        [">="] = function(a, b) return a >= b end,
+    }
 
-        if cnt == "ConstantExpression" then
-            local oldT, oldIS, oldI = comp.tail, comp.in_statement, comp.indent
+    local statement_keywords = { ["if"] = true, ["return"] = true, ["local"] = true, ["get"] = true, ["set"] = true, ["const"] = true }
 
-            if cn:eq "if" then
-                local done, keyword, i = false, "if", 1
+    local constant_folds = { }
 
-                if not oldIS then
-                    if oldT then
-                        comp:add "return (function()\n"
-                    else
+    do
+        local keyword_values = { ["true"] = true, ["false"] = false }
+
+        for name, const in pairs(constant_names) do
+            constant_folds[const] = { value = keyword_values[const.lua_keyword] }
+        end
+    end
+
+    local function finite(num)
+        return num == num and num ~= math.huge and num ~= -math.huge
+    end
+
+    local function fold_apply(opr, a, b)
+        local ok, val = pcall(fold_operations[opr], a, b)
+
+        if ok and (type(val) ~= "number" or finite(val)) then
+            return true, val
+        end
+
+        return false
+    end
+
+    --  What the generated code would see for an operand of the given type.
+    local function fold_operand(comp, oper, typ)
+        if kind_of(oper) == "ConstantExpression" then
+            if typ == "number" then
+                --  Constants are written out with `tostring`, which rounds.
+                local num = string.parsenumber(oper.string)
+                num = num and tonumber(tostring(num))
+
+                return num and finite(num), num
+            elseif typ == "boolean" then
+                return toboolean(oper.string), true
+            end
+
+            return true, oper.string
+        end
+
+        local known = comp.folds[oper]
+
+        if known then
+            return true, known.value
+        end
+
+        return false
+    end
+
+    local function fold_pn(comp, arr, i, typ)
+        local oper = arr[i]
+
+        if kind_of(oper) == "OperatorExpression" then
+            local opr = operator_translation[oper.opr]
+
+            if not opr then return false end
+
+            local ok, a, b
+            ok, a, i = fold_pn(comp, arr, i + 1, opr.operands_type)
+            if not ok then return false end
+            ok, b, i = fold_pn(comp, arr, i, opr.operands_type)
+            if not ok then return false end
+            ok, a = fold_apply(oper.opr, a, b)
+
+            return ok, a, i
+        elseif oper == nil then
+            return false
+        end
+
+        local ok, val = fold_operand(comp, oper, typ)
+
+        return ok, val, i + 1
+    end
+
+    local function fold_rpn(comp, operand, typ)
+        if #operand == 1 then
+            return fold_operand(comp, operand[1], typ)
+        end
+
+        local opr = operator_translation[operand[1].opr]
+        local ok, a, b
+        ok, a = fold_rpn(comp, operand[2], opr.operands_type)
+        if not ok then return false end
+        ok, b = fold_rpn(comp, operand[3], opr.operands_type)
+        if not ok then return false end
+
+        return fold_apply(operand[1].opr, a, b)
+    end
+
+    local function fold_operators(comp, exp)
+        local ca, arr, oprcnt = exp.args, { exp.command_name }, 0
+        local fO, lO = kind_of(arr[1]) == "OperatorExpression", false
+
+        if fO then oprcnt = 1 end
+
+        for i = 1, #ca do
+            arr[i + 1] = ca[i]
+            lO = kind_of(ca[i]) == "OperatorExpression"
+
+            if lO then oprcnt = oprcnt + 1 end
+        end
+
+        --  Both or neither mean a malformed expression or an assignment, and
+        --  a single operator over more operands is not compiled at all.
+        if fO == lO or (oprcnt == 1 and #arr > 3) then return end
+
+        local ok, val, i
+
+        if fO then
+            ok, val, i = fold_pn(comp, arr, 1)
+            ok = ok and i == #arr + 1
+        else
+            local stack = { }
+
+            for i = 1, #arr do
+                local oper = arr[i]
+
+                if kind_of(oper) == "OperatorExpression" then
+                    if not operator_translation[oper.opr] or #stack < 2 then return end
+
+                    stack[#stack - 1] = { oper, stack[#stack - 1], stack[#stack] }
+                    stack[#stack] = nil
+                else
+                    stack[#stack + 1] = { oper }
+                end
+            end
+
+            if #stack ~= 1 then return end
+
+            ok, val = fold_rpn(comp, stack[1])
+        end
+
+        if ok then
+            comp.folds[exp] = { value = val }
+        end
+    end
+
+    --  If the first branch of a conditional statement which can run will
+    --  always run, returns the position of its body; otherwise false.
+    local function sole_branch(comp, ca)
+        local i, keyword = 1, "if"
+
+        while i <= #ca do
+            if keyword == "else" then return i end
+
+            local known = comp.folds[ca[i]]
+
+            if not known then
+                return false
+            elseif known.value then
+                return i + 1
+            end
+
+            keyword = ca[i + 2]
+
+            if kind_of(keyword) ~= "ConstantExpression" then return false end
+
+            keyword, i = keyword.string, i + 3
+        end
+
+        return false
+    end
+
+    --  Whether the body of a branch can be written as a plain value instead
+    --  of the body of a function called on the spot: a variable access, or a
+    --  single command which is not a statement.
+    local function inline_value(sub)
+        local sType = kind_of(sub)
+
+        if sType == "VariableExpression" then
+            return true
+        elseif sType ~= "Subexpression" or #sub.subexpressions ~= 1 then
+            return false
+        end
+
+        local cmd = sub.subexpressions[1]
+
+        if kind_of(cmd) ~= "CommandExpression" then return false end
+
+        local cn, ca = cmd.command_name, cmd.args
+
+        if kind_of(cn) == "ConstantExpression" and (eq(cn, "return") or eq(cn, "local") or eq(cn, "set")) then
+            return false
+        end
+
+        for i = 1, #ca do
+            if kind_of(ca[i]) == "OperatorExpression" and ca[i].opr == "=" then
+                return false
+            end
+        end
+
+        return true
+    end
+
+    --  Whether a `return` can run in the bodies of a conditional statement.
+    local function returns(exp)
+        local ca = exp.args
+
+        for i = 1, #ca do
+            if kind_of(ca[i]) == "Subexpression" then
+                local subs = ca[i].subexpressions
+
+                for j = 1, #subs do
+                    local cn = kind_of(subs[j]) == "CommandExpression" and subs[j].command_name
+
+                    if kind_of(cn) == "ConstantExpression" and (eq(cn, "return") or (eq(cn, "if") and returns(subs[j]))) then
+                        return true
+                    end
+                end
+            end
+        end
+
+        return false
+    end
+
+    --  Marks the arguments of a command all of whose values are used: the
+    --  last one of a call or a `return`, a value given to several names, and
+    --  the right operand of an operator which is a function call. A temporary
+    --  holds only one value, so conditionals there are not lowered.
+    local function mark_all_values(comp, exp)
+        local cn, ca = exp.command_name, exp.args
+        local n, cnt, all = #ca, kind_of(cn), comp.all_values
+
+        if n == 0 then return end
+
+        if cnt == "ConstantExpression" and statement_keywords[cn.string] and eq(cn, cn.string) then
+            local keyword = cn.string
+
+            if keyword == "return" or (keyword == "local" and n > 3) or (keyword == "set" and n > 2) then
+                all[ca[n]] = true
+            elseif keyword == "if" and all[exp] then
+                --  A branch may be written in place of the conditional.
+                for i = 1, n do
+                    if kind_of(ca[i]) == "Subexpression" and #ca[i].subexpressions == 1 then
+                        all[ca[i].subexpressions[1]] = true
+                    end
+                end
+            end
+
+            return
+        end
+
+        local fO, lO, oprcnt = cnt == "OperatorExpression", false, 0
+
+        if fO then oprcnt = 1 end
+
+        for i = 1, n do
+            lO = kind_of(ca[i]) == "OperatorExpression"
+
+            if lO then oprcnt = oprcnt + 1 end
+        end
+
+        if oprcnt == 0 then
+            all[ca[n]] = true
+        elseif not fO and not lO and oprcnt == 1 and n >= 2 and ca[n - 1].opr == "=" then
+            if n > 2 then all[ca[n]] = true end
+        elseif fO == lO or (oprcnt == 1 and n > 2) then
+            return
+        elseif fO then
+            --  Follows the operands the way `compCmdExpOprPn` does.
+            local stack = { }
+
+            for i = 0, n do
+                local oper = i == 0 and cn or ca[i]
+                local top = stack[#stack]
+
+                if kind_of(oper) == "OperatorExpression" then
+                    local opr = operator_translation[oper.opr]
+
+                    if top then top.operands = top.operands + 1 end
+
+                    stack[#stack + 1] = { call = opr and opr.archetype == 3, operands = 0 }
+                elseif not top then
+                    return
+                else
+                    top.operands = top.operands + 1
+
+                    if top.operands == 2 then
+                        if top.call then all[oper] = true end
+
+                        repeat
+                            stack[#stack] = nil
+                            top = stack[#stack]
+                        until not top or top.operands < 2
+                    end
+                end
+            end
+        else
+            --  And the way `compCmdExpOprRpn` does; `true` is an operation.
+            local stack = { }
+
+            for i = 0, n do
+                local oper = i == 0 and cn or ca[i]
+                local sz = #stack
+
+                if kind_of(oper) == "OperatorExpression" then
+                    local opr = operator_translation[oper.opr]
+
+                    if sz < 2 then return end
+
+                    if opr and opr.archetype == 3 and stack[sz] ~= true then
+                        all[stack[sz]] = true
+                    end
+
+                    stack[sz - 1], stack[sz] = true, nil
+                else
+                    stack[sz + 1] = oper
+                end
+            end
+        end
+    end
+
+    local function fold(comp, exp)
+        local kind = kind_of(exp)
+
+        if kind == "CommandExpression" then
+            local cn, ca = exp.command_name, exp.args
+            local cnt = kind_of(cn)
+
+            mark_all_values(comp, exp)
+
+            for i = 1, #ca do
+                fold(comp, ca[i])
+            end
+
+            if cnt == "OperatorExpression" then
+                fold_operators(comp, exp)
+            elseif cnt == "ConstantExpression" and statement_keywords[cn.string] and eq(cn, cn.string) then
+                if cn.string == "const" and #ca == 1 and kind_of(ca[1]) == "ConstantExpression" then
+                    local const = constant_names[ca[1].string:upper()]
+
+                    if const then
+                        comp.folds[exp] = constant_folds[const]
+                    end
+                end
+            elseif cnt == "ConstantExpression" or cnt == "VariableExpression" then
+                for i = 1, #ca do
+                    if kind_of(ca[i]) == "OperatorExpression" then
+                        fold_operators(comp, exp)
+                        break
+                    end
+                end
+            end
+
+            if comp.folds[exp] then return end
+
+            --  Conditionals used as values are lowered into statements which
+            --  run before the one they are in, except where all of their values
+            --  are used, or when they are written in place of one of their
+            --  branches.
+            if cnt == "ConstantExpression" and eq(cn, "if") then
+                local only = sole_branch(comp, ca)
+
+                if only and inline_value(ca[only]) then
+                    comp.spills[exp] = kind_of(ca[only]) == "Subexpression" and comp.spills[ca[only].subexpressions[1]]
+                else
+                    comp.lowered[exp] = not comp.all_values[exp]
+                    comp.spills[exp] = comp.lowered[exp]
+                end
+            else
+                for i = 1, #ca do
+                    if comp.spills[ca[i]] then
+                        comp.spills[exp] = true
+                        break
+                    end
+                end
+            end
+        elseif kind == "SequenceExpression" or kind == "Subexpression" then
+            local subs = exp.subexpressions
+
+            for i = 1, #subs do
+                fold(comp, subs[i])
+            end
+        elseif kind == "VariableExpression" then
+            local const = getConst(exp.name)
+
+            if const then
+                comp.folds[exp] = constant_folds[const]
+            end
+        end
+    end
+
+    --  A folded value as Lua source.
+    local function literal(val)
+        if type(val) == "number" then
+            local str = tostring(val)
+
+            if tonumber(str) ~= val then
+                str = string.format("%.17g", val)
+            end
+
+            return str
+        elseif type(val) == "string" then
+            return string.format("%q", val)
+        end
+
+        return tostring(val)
+    end
+
+    local function compFolded(comp, exp)
+        local val = comp.folds[exp].value
+
+        if comp.in_statement then
+            if comp.indent then comp:add(comp.indent) end
+            compTail(comp, comp.tail)
+            comp:add(literal(val))
+        elseif type(val) == "number" then
+            --  Operands are written right next to the operators, and neither
+            --  `1..a` nor `a - -1` mean what they should.
+            comp:add "("
+            comp:add(literal(val))
+            comp:add ")"
+        else
+            comp:add(literal(val))
+        end
+    end
+
+    --  Removes the output added since the given mark.
+    local function drop(comp, mark)
+        for i = #comp, mark + 1, -1 do
+            comp[i] = nil
+        end
+    end
+
+    --  Compiles a conditional used as a value into a statement which assigns
+    --  a new temporary, put before the statement being compiled, and refers
+    --  to the temporary in its place. Otherwise it would be the body of a
+    --  function made and called on the spot, which LuaJIT cannot compile.
+    --  A `return` in its bodies gives the value and leaves the conditional,
+    --  which is then put in a loop that runs once, to `break` out of.
+    local function compLowered(comp, exp)
+        local oldT, oldIS, oldI, oldH, oldR = comp.tail, comp.in_statement, comp.indent, comp.hoist_at, comp.returns_to
+        local mark, var, loop = #comp, comp:temporary(exp), returns(exp)
+
+        if oldI then comp:add(oldI) end
+        comp:add "local "
+        comp:add(var.lua_identifier)
+        comp:add "\n"
+
+        if loop then
+            if oldI then comp:add(oldI) end
+            comp:add "repeat\n"
+
+            comp.indent = oldI and oldI .. "    " or "    "
+        end
+
+        comp.tail, comp.in_statement, comp.hoist_at, comp.returns_to = var, true, #comp, loop and var
+        compCmdExp(comp, exp)
+        comp.hoist_at, comp.returns_to = oldH, oldR
+
+        if comp.err then return end
+
+        comp:add "\n"
+
+        if loop then
+            if oldI then comp:add(oldI) end
+            comp:add "until true\n"
+        end
+
+        hoist(comp, mark)
+        comp:add(var.lua_identifier)
+
+        comp.tail, comp.in_statement, comp.indent = oldT, oldIS, oldI
+    end
+
+    function compCmdExp(comp, exp)
+        local cn, ca = exp.command_name, exp.args
+        local cnt = kind_of(cn)
+
+        if comp.folds[exp] and (comp.tail or not comp.in_statement) then
+            return compFolded(comp, exp)
+        end
+
+        if cnt == "ConstantExpression" then
+            local oldT, oldIS, oldI = comp.tail, comp.in_statement, comp.indent
+
+            if eq(cn, "if") then
+                --  Branches whose condition is known to be false are still
+                --  compiled, to check them, but their code is dropped. One
+                --  whose condition is known to be true becomes the `else`, and
+                --  if it is the first that can run, no `if` is needed at all.
+                local only = sole_branch(comp, ca)
+                local inline = only and not oldIS and inline_value(ca[only])
+                local oldH, oldNH, oldR = comp.hoist_at, comp.no_hoist, comp.returns_to
+                local done, taken, opened, keyword, i = false, false, false, "if", 1
+                local nested = { }  --  Indentation of the `if`s holding this one.
+
+                if not oldIS and not inline then
+                    if comp.lowered[exp] and not oldNH then
+                        return compLowered(comp, exp)
+                    end
+
+                    if oldT then
+                        comp:add "return (function()\n"
+                    else
                         comp:add "(function()\n"
                     end
 
@@ -1341,6 +2297,8 @@ do
                     else
                         comp.indent = "    "
                     end
+
+                    comp.hoist_at, comp.no_hoist, comp.returns_to = #comp, false, false
                 end
 
                 repeat
@@ -1356,80 +2314,122 @@ do
                         return
                     end
 
+                    local cond, sub
+
                     if done then
                         --  Means this is the `else`.
 
-                        local sub = ca[i]
+                        sub = ca[i]
                         i = i + 1
+                    else
+                        cond, sub = ca[i], ca[i + 1]
+                        i = i + 2
+                    end
 
-                        local sType = types.get(sub)
-
-                        if comp.indent then comp:add(comp.indent) end
-                        comp:add "else\n"
+                    local sType = kind_of(sub)
+                    local known = cond and comp.folds[cond]
+                    local live = not taken and not (known and not known.value)
+                    local mark = #comp
 
-                        comp.tail = oldT or not oldIS
+                    if cond then
+                        local cType = kind_of(cond)
+                        local condH = comp.hoist_at
 
-                        if sType == "Subexpression" then
-                            compSubExp(comp, sub)
-                        elseif sType == "VariableExpression" then
-                            if not comp.tail then
-                                comp.exp, comp.err = exp, "Conditional statement accepts a variable access after the keyword `else` only when the statement value's is returned"
-                                return
-                            end
+                        --  A later condition with statements to put before it
+                        --  is tested in an `if` of its own, in an `else`.
+                        if opened and live and not known and comp.spills[cond] and not comp.no_hoist then
+                            if comp.indent then comp:add(comp.indent) end
+                            comp:add "else\n"
 
-                            compVarExp(comp, sub)
-                        else
-                            comp.exp, comp.err = exp, "Conditional statement needs a subexpression after the keyword `else`"
-                            if types.match(sub, "Expression") then comp.exp = sub end
-                            return
+                            nested[#nested + 1] = comp.indent or false
+                            comp.indent = (comp.indent or "") .. "    "
+                            comp.hoist_at, opened = #comp, false
                         end
 
-                        if comp.err then return end
-                    else
-                        local cond, sub = ca[i], ca[i + 1]
-                        i = i + 2
-
-                        local cType, sType = types.get(cond), types.get(sub)
-
-                        if comp.indent then comp:add(comp.indent) end
-                        comp:add(conditional_keywords[keyword])
-                        comp:add " "
+                        if live and not known then
+                            if comp.indent then comp:add(comp.indent) end
+                            comp:add(opened and conditional_keywords[keyword] or "if")
+                            comp:add " "
+                        end
 
                         comp.tail, comp.in_statement = false, false
 
+                        --  Only the first condition tested is always evaluated.
+                        local condNH = comp.no_hoist
+                        if opened or not live or known then comp.no_hoist = true end
+
                         if cType == "VariableExpression" then
                             compVarExp(comp, cond)
                         elseif cType == "CommandExpression" then
                             compCmdExp(comp, cond)
                         else
                             comp.exp, comp.err = exp, "Conditional statement condition after the keyword `" .. keyword .. "` needs to be a command substitution or variable access"
-                            if types.match(cond, "Expression") then comp.exp = cond end
+                            if is_node(cond) then comp.exp = cond end
                             return
                         end
 
                         if comp.err then return end
 
-                        comp:add " then\n"
-                        comp.tail = oldT or not oldIS
+                        comp.no_hoist, comp.hoist_at = condNH, condH
 
-                        if sType == "Subexpression" then
-                            compSubExp(comp, sub)
-                        elseif sType == "VariableExpression" then
-                            if not comp.tail then
-                                comp.exp, comp.err = exp, "Conditional statement accepts a variable access after the keyword `" .. keyword .. "` and the condition only when the statement value's is returned"
-                                return
-                            end
+                        if live and not known then
+                            comp:add " then\n"
+                            opened = true
+                        else
+                            drop(comp, mark)
+                        end
+                    end
 
-                            compVarExp(comp, sub)
+                    if live and (known or not cond) then
+                        --  Nothing after this branch can run.
+                        taken = true
+
+                        if opened then
+                            if comp.indent then comp:add(comp.indent) end
+                            comp:add "else\n"
+                        elseif oldIS and sType == "Subexpression" then
+                            if comp.indent then comp:add(comp.indent) end
+                            comp:add "do\n"
+                            opened = true
+                        end
+                    end
+
+                    mark = #comp
+                    comp.tail = oldT or not oldIS
+
+                    if live and inline then
+                        comp.tail, comp.in_statement = false, false
+
+                        if sType == "Subexpression" then
+                            compCmdExp(comp, sub.subexpressions[1])
                         else
-                            comp.exp, comp.err = exp, "Conditional statement needs a subexpression after the keyword `" .. keyword .. "` and the condition"
-                            if types.match(sub, "Expression") then comp.exp = sub end
+                            compVarExp(comp, sub)
+                        end
+                    elseif sType == "Subexpression" then
+                        compSubExp(comp, sub)
+                    elseif sType == "VariableExpression" then
+                        if not comp.tail then
+                            comp.exp, comp.err = exp, "Conditional statement accepts a variable access after the keyword `" .. keyword .. (done and "`" or "` and the condition") .. " only when the statement value's is returned"
                             return
                         end
 
-                        if comp.err then return end
+                        if comp.indent then comp:add(comp.indent) end
+                        comp:add "    "
+                        compTail(comp, comp.tail)
+
+                        comp.in_statement = false
+                        compVarExp(comp, sub)
+                        comp:add "\n"
+                    else
+                        comp.exp, comp.err = exp, "Conditional statement needs a subexpression after the keyword `" .. keyword .. (done and "`" or "` and the condition")
+                        if is_node(sub) then comp.exp = sub end
+                        return
                     end
 
+                    if comp.err then return end
+
+                    if not live then drop(comp, mark) end
+
                     if i > #ca then
                         break
                     elseif done then
@@ -1438,8 +2438,8 @@ do
                         keyword = ca[i]
                         i = i + 1
 
-                        if types.get(keyword) ~= "ConstantExpression" then
-                            comp.exp, comp.err = keyword, "Conditional statement contains invalid expression after a subexpression; a keyword is expected, or nothing; got \"" .. types.get(keyword) .. "\""
+                        if kind_of(keyword) ~= "ConstantExpression" then
+                            comp.exp, comp.err = keyword, "Conditional statement contains invalid expression after a subexpression; a keyword is expected, or nothing; got \"" .. kind_of(keyword) .. "\""
                             return
                         end
 
@@ -1447,31 +2447,51 @@ do
                     end
                 until done
 
-                if comp.indent then comp:add(comp.indent) end
-                comp:add "end"
+                if opened then
+                    if comp.indent then comp:add(comp.indent) end
+                    comp:add "end"
+                end
+
+                for j = #nested, 1, -1 do
+                    comp.indent = nested[j]
 
-                if not oldIS then
                     comp:add "\n"
+                    if comp.indent then comp:add(comp.indent) end
+                    comp:add "end"
+                end
+
+                if not oldIS and not inline then
+                    if opened then comp:add "\n" end
                     if oldI then comp:add(oldI) end
                     comp:add "end)()"
+
+                    comp.hoist_at, comp.no_hoist, comp.returns_to = oldH, oldNH, oldR
                 end
-            elseif cn:eq "return" then
+            elseif eq(cn, "return") then
                 if not oldIS then
                     comp.exp, comp.err = exp, "Return statement is not a valid expression, it is a statement"
                     return
                 end
 
+                --  In a conditional being lowered, gives its value instead.
+                local to = comp.returns_to
+
                 if oldIS and oldI then comp:add(oldI) end
 
-                if oldT then
+                if to then
+                    compTail(comp, to)
+                    if #ca == 0 then comp:add "nil" end
+                elseif oldT then
                     comp:add "return "
                 else
                     comp:add "do return "
                 end
 
+                local last = last_spill(comp, ca)
+
                 for i = 1, #ca do
                     local arg = ca[i]
-                    local aType = types.get(arg)
+                    local aType = kind_of(arg)
 
                     if i > 1 then
                         comp:add ", "
@@ -1481,27 +2501,31 @@ do
 
                     if aType == "ConstantExpression" then
                         compConExp(comp, arg)
+                    elseif i < last and volatile(comp, arg) then
+                        compSpilled(comp, arg, aType == "CommandExpression" and compCmdExp or compVarExp)
                     elseif aType == "VariableExpression" then
                         compVarExp(comp, arg)
                     elseif aType == "CommandExpression" then
                         compCmdExp(comp, arg)
                     elseif aType ~= "nil" then
                         comp.exp, comp.err = exp, "Return statement needs constants, variable accesses, or command substitutions as its arguments"
-                        if types.match(arg, "Expression") then comp.exp = arg end
+                        if is_node(arg) then comp.exp = arg end
                         return
                     end
 
                     if comp.err then return end
                 end
 
-                if not oldT then
+                if to then
+                    if not oldT then comp:add " do break end" end
+                elseif not oldT then
                     comp:add " end"
                 end
-            elseif cn:eq "local" then
+            elseif eq(cn, "local") then
                 local hasAssignment = false
 
                 for i = 1, #ca do
-                    if types.get(ca[i]) == "OperatorExpression" then
+                    if kind_of(ca[i]) == "OperatorExpression" then
                         if i == #ca - 1 and ca[i].opr == "=" then
                             hasAssignment = true
                         else
@@ -1527,7 +2551,7 @@ do
 
                 for i = 1, hasAssignment and (#ca - 2) or #ca do
                     local name = ca[i]
-                    local nType = types.get(name)
+                    local nType = kind_of(name)
 
                     if nType == "ConstantExpression" then
                         if not name.string:match "^[a-zA-Z_][0-9a-zA-Z_]*$" then
@@ -1548,14 +2572,14 @@ do
                         comp:add(var.lua_identifier)
                     else
                         comp.exp, comp.err = exp, "Local assignment needs names before the assignment operator; operand #" .. i .. " is not a name"
-                        if types.match(name, "Expression") then comp.exp = name end
+                        if is_node(name) then comp.exp = name end
                         return
                     end
                 end
 
                 if hasAssignment then
                     local val = ca[#ca]
-                    local vType = types.get(val)
+                    local vType = kind_of(val)
 
                     comp:add " = "
                     comp.tail, comp.in_statement = false, false
@@ -1568,11 +2592,11 @@ do
                         compVarExp(comp, val)
                     else
                         comp.exp, comp.err = exp, "Local variable(s) value(s), if present, must be a constant or a command substitution"
-                        if types.match(val, "Expression") then comp.exp = val end
+                        if is_node(val) then comp.exp = val end
                         return
                     end
                 end
-            elseif cn:eq "get" then
+            elseif eq(cn, "get") then
                 if oldIS and not oldT then
                     comp.exp, comp.err = exp, "Local reading is not a valid statement, it is an expression; however it may be an implicit return"
                     return
@@ -1586,16 +2610,16 @@ do
                 end
 
                 if oldIS and oldI then comp:add(oldI) end
-                if oldT then comp:add "return " end
+                if oldT then compTail(comp, oldT) end
 
                 --for i = 1, #ca do
                 --    local name = ca[i]
                 local name = ca[1]
 
-                if types.get(name) ~= "ConstantExpression" then
+                if kind_of(name) ~= "ConstantExpression" then
                     --comp.exp, comp.err = exp, "Local reading needs a name for each argument; argument #" .. i .. " is not a name"
                     comp.exp, comp.err = exp, "Local reading needs a name"
-                    if types.match(name, "Expression") then comp.exp = name end
+                    if is_node(name) then comp.exp = name end
                     return
                 elseif not name.string:match "^[a-zA-Z_][0-9a-zA-Z_]*$" then
                     --comp.exp, comp.err = exp, "Local variable name may only contain letters, digits, and underscores; first character may not be a digit; name #" .. i .. " is invalid"
@@ -1606,7 +2630,7 @@ do
                 local var = comp.scope[name.string]
 
                 if not var then
-                    comp.exp, comp.err = exp, "No local defined with the name " .. name
+                    comp.exp, comp.err = exp, "No local defined with the name " .. name.string
                     return
                 end
 
@@ -1616,7 +2640,7 @@ do
 
                 comp:add(var.lua_identifier)
                 --end
-            elseif cn:eq "set" then
+            elseif eq(cn, "set") then
                 if not oldIS then
                     comp.exp, comp.err = exp, "Local writing is not a valid expression, it is a statement"
                     return
@@ -1632,9 +2656,9 @@ do
                 for i = 1, #ca - 1 do
                     local name = ca[i]
 
-                    if types.get(name) ~= "ConstantExpression" then
+                    if kind_of(name) ~= "ConstantExpression" then
                         comp.exp, comp.err = exp, "Local writing needs a name for each argument; argument #" .. i .. " is not a name"
-                        if types.match(name, "Expression") then comp.exp = name end
+                        if is_node(name) then comp.exp = name end
                         return
                     elseif not name.string:match "^[a-zA-Z_][0-9a-zA-Z_]*$" then
                         comp.exp, comp.err = exp, "Local variable name may only contain letters, digits, and underscores; first character may not be a digit; name #" .. i .. " is invalid"
@@ -1644,7 +2668,7 @@ do
                     local var = comp.scope[name.string]
 
                     if not var then
-                        comp.exp, comp.err = exp, "No local defined with the name " .. name
+                        comp.exp, comp.err = exp, "No local defined with the name " .. name.string
                         return
                     end
 
@@ -1656,7 +2680,7 @@ do
                 end
 
                 local val = ca[#ca]
-                local vType = types.get(val)
+                local vType = kind_of(val)
 
                 comp:add " = "
                 comp.tail, comp.in_statement = false, false
@@ -1669,12 +2693,12 @@ do
                     compVarExp(comp, val)
                 else
                     comp.exp, comp.err = exp, "Local writing value must be a constant or a command substitution"
-                    if types.match(val, "Expression") then comp.exp = val end
+                    if is_node(val) then comp.exp = val end
                     return
                 end
 
                 if comp.err then return end
-            elseif cn:eq "const" then
+            elseif eq(cn, "const") then
                 if oldIS and not oldT then
                     comp.exp, comp.err = exp, "Constant value is not a valid statement, it is an expression; however it may be an implicit return"
                     return
@@ -1688,16 +2712,16 @@ do
                 end
 
                 if oldIS and oldI then comp:add(oldI) end
-                if oldT then comp:add "return " end
+                if oldT then compTail(comp, oldT) end
 
                 --for i = 1, #ca do
                 --    local name = ca[i]
                 local name = ca[1]
 
-                if types.get(name) ~= "ConstantExpression" then
+                if kind_of(name) ~= "ConstantExpression" then
                     --comp.exp, comp.err = exp, "Constant value needs a name for each argument; argument #" .. i .. " is not a name"
                     comp.exp, comp.err = exp, "Constant value needs a name for the first argument"
-                    if types.match(name, "Expression") then comp.exp = name end
+                    if is_node(name) then comp.exp = name end
                     return
                 end
 
@@ -1713,7 +2737,7 @@ do
                 else
                     --  TODO: Retreive more constants from the compiler, perhaps?
                     --comp.exp, comp.err = exp, "Constant value name #" .. i .. " is invalid or unknown"
-                    comp.exp, comp.err = exp, "Constant value name is invalid or unknown: " .. name
+                    comp.exp, comp.err = exp, "Constant value name is invalid or unknown: " .. name.string
                     return
                 end
                 --end
@@ -1739,19 +2763,19 @@ do
         for i = 1, #ca do
             --  Quickly find if this command invocation contains an operator. If this is the case, it is an expression.
 
-            if types.get(ca[i]) == "OperatorExpression" then
+            if kind_of(ca[i]) == "OperatorExpression" then
                 return compCmdExpOpr(comp, exp)
             end
         end
 
-        local cnt = types.get(cn)
+        local cnt = kind_of(cn)
         local oldT, oldIS, oldI = comp.tail, comp.in_statement, comp.indent
 
         if oldIS and oldI then comp:add(oldI) end
 
         if oldT then
             comp.tail = false
-            comp:add "return "
+            compTail(comp, oldT)
         end
 
         comp.in_statement = false
@@ -1769,9 +2793,11 @@ do
 
         if comp.err then return end
 
+        local last = last_spill(comp, ca)
+
         for i = 1, #ca do
             local arg = ca[i]
-            local aType = types.get(arg)
+            local aType = kind_of(arg)
 
             if i > 1 then
                 comp:add ", "
@@ -1779,6 +2805,8 @@ do
 
             if aType == "ConstantExpression" then
                 compConExp(comp, arg)
+            elseif i < last and volatile(comp, arg) then
+                compSpilled(comp, arg, aType == "CommandExpression" and compCmdExp or compVarExp)
             elseif aType == "VariableExpression" then
                 compVarExp(comp, arg)
             elseif aType == "CommandExpression" then
@@ -1808,7 +2836,7 @@ do
 
         for i = 1, last do
             local sub = exp.subexpressions[i]
-            local sType = types.get(sub)
+            local sType = kind_of(sub)
 
             if i == last then
                 comp.tail = oldT
@@ -1817,6 +2845,7 @@ do
             end
 
             comp.in_statement = true
+            comp.hoist_at = #comp
 
             if sType == "CommandExpression" then
                 compCmdExp(comp, sub)
@@ -1835,9 +2864,12 @@ do
     end
 
     function compSubExp(comp, exp)
-        local oldT, oldIS, oldI = comp.tail, comp.in_statement, comp.indent
+        local oldT, oldIS, oldI, oldH, oldNH = comp.tail, comp.in_statement, comp.indent, comp.hoist_at, comp.no_hoist
         local last = #exp.subexpressions
 
+        --  Its statements run on their own, so anything may be put before them.
+        comp.no_hoist = false
+
         if oldI then
             comp.indent = oldI .. "    "
         else
@@ -1848,7 +2880,7 @@ do
 
         for i = 1, last do
             local sub = exp.subexpressions[i]
-            local sType = types.get(sub)
+            local sType = kind_of(sub)
 
             if i == last then
                 comp.tail = oldT
@@ -1857,6 +2889,7 @@ do
             end
 
             comp.in_statement = true
+            comp.hoist_at = #comp
 
             if sType == "CommandExpression" then
                 compCmdExp(comp, sub)
@@ -1871,11 +2904,11 @@ do
 
         comp:pop_scope()
 
-        comp.tail, comp.in_statement, comp.indent = oldT, oldIS, oldI
+        comp.tail, comp.in_statement, comp.indent, comp.hoist_at, comp.no_hoist = oldT, oldIS, oldI, oldH, oldNH
     end
 
     function _compile(comp, exp)
-        local eType = types.get(exp)
+        local eType = kind_of(exp)
 
         if eType == "CommandExpression" then
             return compCmdExp(comp, exp)
@@ -1887,7 +2920,9 @@ do
     end
 
     function compile(exp)
-        local eType, comp = types.get(exp), clCmp()
+        local eType, comp = kind_of(exp), clCmp()
+
+        fold(comp, exp)
 
         if eType == "CommandExpression" then
             compCmdExp(comp, exp, true)
@@ -1927,7 +2962,7 @@ do
                 ERR("ERROR:\n", err)
 
                 if exp then
-                    ERR("SITE ", exp.start, "-", exp.finish, ":\n", exp)
+                    ERR("SITE ", exp.start, "-", exp.finish, ":\n", view(exp))
                 end
 
                 LASTRES = false
@@ -1981,10 +3016,227 @@ a b = [foo [~ a b]];
 local a b = [bar [| $a $b]]]=]
     TESTCOMP "local a b c; + 0 + [* $b $b] [* 4 [* $a $c]]"
     TESTCOMP "local a b c; 0 [$b $b *] [4 [$a $c *] *] + +"
+    TESTCOMP "+ 0 + [* 4 4] 1"
+    TESTCOMP "local a; ~ [- $a 1] [- 0 1]"
+    TESTCOMP "if [const false] {a} elif [b] {c} elif [== 1 1] {d} else {e}"
+    TESTCOMP "if $true {local a = [b]; c $a}; d"
+    TESTCOMP "outer [if [const false] {a} else {b}] [if $true {c; d}]"
+
+    --  Conditionals used as values must not make functions, and must give
+    --  what the commands would, in the same order. Where all of their values
+    --  are used, they may give several or none, so functions are kept.
+
+    local trace = { }
+
+    local funcs = {
+        id = function(...) return ... end,
+        yes = function() return true end,
+        no = function() return false end,
+        log = function(val) trace[#trace + 1] = val return val end,
+        multi = function() return 1, 2, 3 end,
+        count = function(...) return select("#", ...) end,
+    }
+
+    local function pack(...)
+        return { n = select("#", ...), ... }
+    end
+
+    local function TESTLOWER(str, expected, functions)
+        local exp, _, err = parse(str)
+        local code
+
+        if not err then
+            code, err = compile(exp)
+        end
+
+        if not code then
+            error(string.format("Test failure: %q failed to compile: %s", str, err))
+        elseif not functions and code:find("function", 1, true) then
+            error(string.format("Test failure: %q compiled to a function:\n%s", str, code))
+        end
+
+        trace = { }
+
+        local fnc = assert(loadstring("local __funcs = ...\n" .. code, "=command"))
+        local res = pack(pcall(fnc, funcs))
+
+        for i = 1, res.n do
+            res[i] = tostring(res[i])
+        end
+
+        res = table.concat(trace) .. "=" .. table.concat(res, ",", 2, res.n)
+
+        if res ~= expected then
+            error(string.format("Test failure: %q gave %q instead of %q:\n%s", str, res, expected, code))
+        end
+    end
+
+    TESTLOWER("id [if [yes] {id a} else {id b}] e", "=a,e")
+    TESTLOWER("id [if [no] {id a} elif [yes] {id b} else {id c}] e", "=b,e")
+    TESTLOWER("id [log a] [if [log b] {log c}] [log d]", "abcd=a,c,d")
+    TESTLOWER("+ 1 [if [yes] {+ 2 [id 3]} else {id 0}]", "=6")
+    TESTLOWER("local x = [if [no] {id a}]; id [if $x {id b} else {id c}] e", "=c,e")
+    TESTLOWER("if [if [log a] {no}] {log b} else {log c}", "ac=c")
+    TESTLOWER("id [if [yes] {local y = z; id [if [no] {id a} else $y] e}] f", "=z,f")
+    TESTLOWER("return [log a] [if [log b] {log c; log d}] [log e]", "abcde=a,d,e")
+    TESTLOWER("id [if [yes] {multi}] e", "=1,e")
+    TESTLOWER("id [if [no] {id a}] e", "=nil,e")
+    TESTLOWER("count [if [yes] {multi}]", "=3", true)
+    TESTLOWER("count a [if [no] {id b}]", "=1", true)
+    TESTLOWER("^ 0 [if [no] {id 1}]", "=0", true)
+    TESTLOWER("return [if [no] {id a}]", "=", true)
+    TESTLOWER("&& [log a] [if [log b] {log c}]", "abc=c")
+    TESTLOWER("|| [yes] [if [log b] {log c}]", "=true")
+    TESTLOWER("true [if [log b] {log c}] &&", "bc=c")
+    TESTLOWER("true [if [log b] {log c}] ||", "=true")
+    TESTLOWER("&& || [no] [log a] + [log 1] [if [log 2] {log 3}]", "a123=4")
+    TESTLOWER("id [if [no] {id a} elif [if [log b] {yes}] {log c} else {log d}] e", "bc=c,e")
+    TESTLOWER("id [if [yes] {log a; return [log b]; log c}] d", "ab=b,d")
+    TESTLOWER("id [if [yes] {if [yes] {return a}; log c} else {return}] d", "=a,d")
+    TESTLOWER("id [if [no] {id a} else {return; log c}] d", "=nil,d")
+end
+
+--  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
+--  Compile Cache   --
+--  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
+
+local load_command, set_cache_limit, clear_cache
+
+do
+    --  Loaded functions are kept by source text, most recently used first in
+    --  a doubly-linked list, so key bindings and macros which run the same
+    --  command over and over only pay for parsing, compiling and `loadstring`
+    --  once. The cost of an entry is an estimate of what it keeps alive: both
+    --  texts, plus the function and the bookkeeping.
+
+    local entry_overhead = 256
+
+    local entries, newest, oldest = { }, false, false
+    local size, limit = 0, 1024 * 1024
+
+    local function unlink(ent)
+        if ent.newer then ent.newer.older = ent.older else newest = ent.older end
+        if ent.older then ent.older.newer = ent.newer else oldest = ent.newer end
+
+        ent.newer, ent.older = false, false
+    end
+
+    local function push(ent)
+        ent.older, ent.newer = newest, false
+
+        if newest then newest.newer = ent else oldest = ent end
+
+        newest = ent
+    end
+
+    local function evict(lim)
+        while size > lim and oldest do
+            local ent = oldest
+
+            unlink(ent)
+            entries[ent.source] = nil
+            size = size - ent.cost
+        end
+    end
+
+    --  Returns a function which runs the given command text, called with the
+    --  table of command functions. Otherwise returns false, the error and the
+    --  offending expression, if any. Failures are not kept.
+    function load_command(str)
+        types.assert("string", str, "command text")
+
+        local ent = entries[str]
+
+        if ent then
+            if ent ~= newest then
+                unlink(ent)
+                push(ent)
+            end
+
+            return ent.fnc
+        end
+
+        local exp, _, err = parse(str)
+
+        if err then
+            return false, err, exp
+        end
+
+        local code
+        code, err, exp = compile(exp)
+
+        if not code then
+            return false, err, exp
+        end
+
+        local fnc
+        fnc, err = loadstring("local __funcs = ...\n" .. code, "=command")
+
+        if not fnc then
+            return false, err, false
+        end
+
+        ent = { source = str, fnc = fnc, cost = #str + #code + entry_overhead }
+
+        entries[str] = ent
+        push(ent)
+        size = size + ent.cost
+
+        evict(limit)
+
+        return fnc
+    end
+
+    --  Sets the byte budget of the cache, evicting as needed.
+    function set_cache_limit(val)
+        types.assert("integer", val, "cache limit")
+
+        limit = val
+        evict(limit)
+    end
+
+    function clear_cache()
+        evict(-1)
+    end
+
+    --------------------------------------------------------------------------------
+
+    local function TESTLOAD(str, ...)
+        local fnc, err = load_command(str)
+
+        if not fnc then
+            error(string.format("Test failure: %q failed to load: %s", str, err))
+        end
+
+        return fnc(...)
+    end
+
+    local funcs = { id = function(...) return ... end }
+
+    if TESTLOAD("id 42", funcs) ~= "42" or load_command "id 42" ~= load_command "id 42" then
+        error "Test failure: Loaded command is not reused."
+    end
+
+    set_cache_limit(3 * entry_overhead)
+
+    for i = 1, 10 do
+        TESTLOAD("id " .. i, funcs)
+    end
+
+    if entries["id 1"] or not entries["id 10"] or size > limit then
+        error "Test failure: Compile cache exceeds its limit."
+    end
+
+    set_cache_limit(1024 * 1024)
+    clear_cache()
 end
 
 return {
     parse = parse,
+    view = view,
     compile = compile,
+    load = load_command,
+    set_cache_limit = set_cache_limit,
+    clear_cache = clear_cache,
 }
 
@@ -0,0 +1,51 @@
+if not vandal.ffi then
+    vandal.ffi = { }
+elseif vandal.ffi.lineindex ~= nil then
+    error "wut?"
+end
+
+local decls = [[
+typedef struct LineIndex LineIndex;
+
+LineIndex *lineindex_new(unsigned int stride);
+void       lineindex_destroy(LineIndex *li);
+
+int  lineindex_scan(LineIndex *li, const char *data, size_t len, uint64_t offset);
+int  lineindex_scan_parallel(LineIndex *li, const char *data, size_t len, uint64_t offset, int nthreads);
+
+uint64_t lineindex_breaks(const LineIndex *li);
+size_t   lineindex_count(const LineIndex *li);
+uint64_t lineindex_get(const LineIndex *li, size_t i);
+
+size_t lineindex_count_breaks(const char *data, size_t len);
+]]
+
+--  Built from `vandal/native`. It is optional: without it, users fall back to
+--  scanning with `memchr`, so this module yields `false` when it is missing.
+
+local ffi, okay, lib = require "ffi"
+ffi.cdef(decls)
+
+okay, lib = pcall(ffi.load, "vandal/native/liblineindex.so")
+
+if not okay then
+    okay, lib = pcall(ffi.load, "lineindex")
+end
+
+if not okay then
+    vandal.ffi.lineindex = false
+
+    return false
+end
+
+local lineindex = { DECLS = decls, C = lib }
+
+vandal.ffi.lineindex = setmetatable({ }, {
+    __index = function(self, key)
+        return lineindex[key] or lib[key]
+    end,
+
+    __newindex = function() error "Vandal error: Cannot modify the `vandal.ffi.lineindex` table." end,
+})
+
+return vandal.ffi.lineindex
@@ -11,6 +11,48 @@ int fileno(FILE * stream);
 
 int usleep(unsigned int useconds);
 
+void * memchr(const void * s, int c, size_t n);
+void * memmove(void * dest, const void * src, size_t n);
+
+char * strerror(int errnum);
+
+int open(const char * pathname, int flags);
+int close(int fd);
+int64_t lseek(int fd, int64_t offset, int whence);
+
+enum file_flags {
+    O_RDONLY = 0,
+    SEEK_END = 2,
+};
+
+void * mmap(void * addr, size_t length, int prot, int flags, int fd, int64_t offset);
+int munmap(void * addr, size_t length);
+int madvise(void * addr, size_t length, int advice);
+int getpagesize(void);
+
+long sysconf(int name);
+
+enum sysconf_names {
+    _SC_NPROCESSORS_ONLN = 84,
+};
+
+enum mmap_flags {
+    PROT_READ   = 1,
+    MAP_PRIVATE = 2,
+    MADV_DONTNEED = 4,
+};
+
+struct timespec {
+    long tv_sec;
+    long tv_nsec;
+};
+
+int clock_gettime(int clk_id, struct timespec * tp);
+
+enum clock_ids {
+    CLOCK_MONOTONIC = 1,
+};
+
 char * setlocale(int category, const char * locale);
 
 enum setlocale_categories {
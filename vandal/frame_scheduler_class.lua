@@ -0,0 +1,146 @@
+--[[
+    Copyright (c) 2017 Alexandru-Mihai Maftei. All rights reserved.
+
+
+    Developed by: Alexandru-Mihai Maftei
+    aka Vercas
+    http://vercas.com | https://github.com/vercas/Vandal
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal with the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimers.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimers in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the names of Alexandru-Mihai Maftei, Vercas, nor the names of
+        its contributors may be used to endorse or promote products derived from
+        this Software without specific prior written permission.
+
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    WITH THE SOFTWARE.
+
+    ---
+
+    You may also find the text of this license in "LICENSE.md".
+]]
+
+local classes = require "vandal/classes"
+local types = require "vandal/utils/types"
+local ffi = require "ffi"
+require "vandal/ffi/misc"
+require "vandal/logging"
+
+local C = ffi.C
+
+local now_ts = ffi.new "struct timespec[1]"
+
+local function now()
+    C.clock_gettime(C.CLOCK_MONOTONIC, now_ts)
+
+    return tonumber(now_ts[0].tv_sec) * 1000 + tonumber(now_ts[0].tv_nsec) / 1000000
+end
+
+--  Coalesces redraws: events only mark the frame as dirty, and the frame is
+--  rendered once all pending input has been applied, at most `max_fps` times
+--  per second. `render_now` is there for whatever cannot wait.
+
+local cl = {
+    Name = "FrameScheduler",
+
+    dirty = { RETRIEVE = "_dirty", },
+
+    max_fps = {
+        get = function(self)
+            return self._max_fps
+        end,
+        set = function(self, val)
+            if type(val) ~= "number" or val <= 0 then
+                error "Vandal error: Frame scheduler's maximum frame rate must be a positive number."
+            end
+
+            self._max_fps = val
+            self._interval = 1000 / val
+        end,
+    },
+}
+
+function cl:do_on_render()
+    local fnc = self.on_render
+
+    if fnc then
+        return fnc(self)
+    end
+end
+
+function cl:__init(max_fps)
+    types.assert({ "nil", "number" }, max_fps, "maximum frame rate")
+
+    self.max_fps = max_fps or 60
+
+    self._dirty = false
+    self._dirty_since = 0
+    self._last = -math.huge
+end
+
+function cl:request()
+    if not self._dirty then
+        self._dirty = true
+        self._dirty_since = now()
+    end
+end
+
+--  How long the event loop may sleep before a frame is due: `nil` to block
+--  indefinitely when nothing needs rendering.
+function cl:get_timeout()
+    if not self._dirty then
+        return nil
+    end
+
+    return math.max(0, math.ceil(self._last + self._interval - now()))
+end
+
+--  Called after an event was applied. Only renders when input keeps arriving
+--  for longer than a whole frame, so a flood cannot starve the screen.
+function cl:after_event()
+    if self._dirty then
+        local t = now()
+
+        if t - self._dirty_since >= self._interval and t - self._last >= self._interval then
+            self:render(t)
+        end
+    end
+end
+
+--  Called when polling found no more input. Renders if the frame is due.
+function cl:after_idle()
+    if self._dirty and now() - self._last >= self._interval then
+        self:render()
+    end
+end
+
+function cl:render(t)
+    self._dirty = false
+    self._last = t or now()
+
+    self:do_on_render()
+end
+
+function cl:render_now()
+    self._dirty = true
+
+    return self:render()
+end
+
+return classes.create(cl)
@@ -40,6 +40,7 @@ if not vandal then vandal = { } else error "wut?" end
 local vandal = vandal
 
 local ui, text_input, mode_line, commands  -- REQUIRED LATER
+local frame_scheduler = require "vandal/frame_scheduler_class"
 local inputdispatcher = require "vandal/input_dispatcher_class"
 local inputmode = require "vandal/input_mode_class"
 local vcall = require "vandal/utils/vcall"
@@ -58,7 +59,7 @@ function vandal.inm_nrm:on_event(ev)
     if ev.type == IET_KB then
         if ev.key == ui.KEY_ESC then
             vandal.stopping = true
-        elseif ev.key == ui.KEY_CODEPOINT then
+        elseif ev.key == ui.KEY_CODEPOINT and ev.modifiers == ui.MOD_NONE then
             if ev.char == "m" then
                 vandal.indis:change_mode(vandal.inm_msg)
             elseif ev.char == ":" then
@@ -117,13 +118,27 @@ function vandal.main()
 
     vandal.stopping = false
 
+    vandal.frames = frame_scheduler(vandal.max_fps)
+
+    function vandal.frames:on_render()
+        vandal.indis.mode:do_on_refresh()
+        ui.flush()
+    end
+
+    --  Keys which get the screen updated right away, without waiting for the
+    --  rest of the pending input or for the next frame.
+    vandal.urgent_keys = {
+        [ui.KEY_ENTER] = true,
+        [ui.KEY_ESC] = true,
+    }
+
     vandal.input_window = text_input(ui.main_window, 0, ui.main_window.height - 1, ui.main_window.width, 1)
     vandal.mode_line = mode_line(ui.main_window, 0, ui.main_window.height - 2, ui.main_window.width, 1, vandal.indis)
 
     vandal.indis:change_mode(vandal.inm_nrm)
 
     function ui.main_window:on_geometry_change(x, y, w, h)
-        local tih = math.clamp(1, #vandal.input_window.lines, math.ceil(h / 15))
+        local tih = math.clamp(1, vandal.input_window.line_count, math.ceil(h / 15))
 
         vandal.input_window:reposition(0, h - tih, w, tih)
         vandal.mode_line:reposition(0, h - tih - 1, w, 1)
@@ -141,29 +156,43 @@ function vandal.main()
         end
     end
 
-    function vandal.input_window:on_newline(mod)
-        ui.main_window:do_on_geometry_change(ui.main_window:get_geometry())
-        ui.main_window:invalidate()
-    end
-
     function vandal.input_window:on_contents_change()
-        if #self.lines ~= self.height then
+        local h = ui.main_window.height
+        local old = self.height
+
+        if math.clamp(1, self.line_count, math.ceil(h / 15)) ~= old then
             ui.main_window:do_on_geometry_change(ui.main_window:get_geometry())
-            ui.main_window:invalidate()
+
+            --  Only the rows the input and mode line move over, and below.
+            local rows = math.max(old, self.height) + 1
+
+            ui.main_window:invalidate(h - rows, rows)
         end
     end
 
+    vandal.frames:request()
+
     repeat
-        local ev = ui.poll(100)
+        local ev = ui.poll(vandal.frames:get_timeout())
+        --  Blocks until something happens while the screen is up to date,
+        --  otherwise only until the next frame is due.
 
         if ev then
             ERR("Event ", tostring(ev))
 
-            if ev.type == IET_KB or ev.type == IET_MS then
+            if ev.type == IET_KB or ev.type == IET_MS or ev.type == IET_PASTE then
                 vandal.indis:handle_event(ev)
             end
 
-            vandal.indis.mode:do_on_refresh()
+            if ev.type == IET_KB and vandal.urgent_keys[ev.key] then
+                vandal.frames:render_now()
+            else
+                vandal.frames:request()
+                vandal.frames:after_event()
+            end
+        else
+            --  All pending input has been applied.
+            vandal.frames:after_idle()
         end
     until vandal.stopping
 end
@@ -174,6 +203,7 @@ function vandal.run()
     vandal.colorspace = "xterm"
     vandal.utf8 = true
     vandal.debug = true
+    vandal.max_fps = 60
 
     local res = vcall(require, "vandal/ui")
 
@@ -44,7 +44,8 @@ IET_min = 1
 IET_KB      = 1  --  Keyboard
 IET_MS      = 2  --  Mouse
 IET_RESIZE  = 3  --  Terminal resized
-IET_max = 3
+IET_PASTE   = 4  --  Text pasted in one go
+IET_max = 4
 
 IEMB_min, IEMB_L, IEMB_R, IEMB_M, IEMB_max = 1, 1, 2, 3, 3
 --  Left, right and middle mouse buttons.
@@ -113,6 +114,16 @@ local cl = {
             end
         end,
     },
+
+    text = {
+        get = function(self)
+            if self._type == IET_PASTE then
+                return self._a
+            else
+                error "Vandal error: Input event does not have this property."
+            end
+        end,
+    },
 }
 
 function cl:__init(typ, a, b, c, d)
@@ -152,9 +163,21 @@ function cl:__init(typ, a, b, c, d)
         end
 
         self._a, self._b, self._c = a, b, c
+    elseif typ == IET_PASTE then
+        if type(a) ~= "string" then
+            error "Vandal error: Input event of type paste must receive the pasted text as second argument."
+        end
+
+        self._a = a
     end
 end
 
+--  Reinitializes a recycled event in place. No validation; this is for UI kits
+--  reusing their own, well-formed events.
+function cl:_reset(typ, a, b, c)
+    self._type, self._a, self._b, self._c = typ, a, b, c
+end
+
 function cl:__tostring()
     if self._type == IET_KB then
         if self._a == vandal.ui.KEY_CODEPOINT then
@@ -164,6 +187,8 @@ function cl:__tostring()
         end
     elseif self._type == IET_RESIZE then
         return "[INEV RESIZE]"
+    elseif self._type == IET_PASTE then
+        return string.format("[INEV PASTE %d bytes]", #self._a)
     else
         error "TODO"
     end
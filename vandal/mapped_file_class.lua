@@ -0,0 +1,340 @@
+--[[
+    Copyright (c) 2017 Alexandru-Mihai Maftei. All rights reserved.
+
+
+    Developed by: Alexandru-Mihai Maftei
+    aka Vercas
+    http://vercas.com | https://github.com/vercas/Vandal
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal with the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimers.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimers in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the names of Alexandru-Mihai Maftei, Vercas, nor the names of
+        its contributors may be used to endorse or promote products derived from
+        this Software without specific prior written permission.
+
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    WITH THE SOFTWARE.
+
+    ---
+
+    You may also find the text of this license in "LICENSE.md".
+]]
+
+local classes = require "vandal/classes"
+local types = require "vandal/utils/types"
+local ffi = require "ffi"
+local li = require "vandal/ffi/lineindex"
+require "vandal/ffi/misc"
+
+local C = ffi.C
+
+--  A read-only buffer over a memory-mapped file, offering the same reading
+--  interface as `PieceTable`. Opening one only reads the first few pages.
+--  Line breaks are counted on demand and by `index_in_background`, and only
+--  the start of every `mark_interval`th line is remembered, so neither the
+--  time to open nor the memory used grows with the file. Pages which were
+--  scanned are given back right away, so only the ones on screen stay
+--  resident. The vectorised scanner from `vandal/native` is used when it was
+--  built, and `memchr` otherwise.
+
+local const_char_ptr = ffi.typeof "const char *"
+local double_arr = ffi.typeof "double[?]"
+
+local mark_interval = 1024
+local index_chunk = 16 * 1024 * 1024
+local demand_chunk = 64 * 1024
+local index_threads = math.max(1, math.min(4, tonumber(C.sysconf(C._SC_NPROCESSORS_ONLN))))
+local page_size = C.getpagesize()
+
+local cl = {
+    Name = "MappedFile",
+
+    read_only = true,
+}
+
+local function fail(what, path, errno)
+    error("Vandal error: Failed to " .. what .. " \"" .. path .. "\": " .. ffi.string(C.strerror(errno)), 4)
+end
+
+local function next_break(self, pos)
+    local hit = C.memchr(self.data + pos, 10, self.size - pos)
+
+    if hit == nil then
+        return nil
+    end
+
+    return tonumber(ffi.cast(const_char_ptr, hit) - self.data)
+end
+
+--  Where line `j * mark_interval + 1` starts.
+local function get_mark(self, j)
+    if j == 0 then
+        return 0
+    elseif self.index then
+        return tonumber(li.lineindex_get(self.index, j - 1))
+    else
+        return self.marks[j]
+    end
+end
+
+local function push_mark(self, off)
+    local cnt = self.marks_count
+
+    if cnt == self.marks_cap then
+        local new = double_arr(cnt * 2)
+        ffi.copy(new, self.marks, cnt * ffi.sizeof "double")
+
+        self.marks, self.marks_cap = new, cnt * 2
+    end
+
+    self.marks[cnt] = off
+    self.marks_count = cnt + 1
+end
+
+function cl:__init(path)
+    types.assert("string", path, "path")
+
+    local fd = C.open(path, C.O_RDONLY)
+
+    if fd < 0 then
+        fail("open", path, ffi.errno())
+    end
+
+    local size = tonumber(C.lseek(fd, 0, C.SEEK_END))
+
+    if size < 0 then
+        local errno = ffi.errno()
+        C.close(fd)
+        fail("seek in", path, errno)
+    end
+
+    if size > 0 then
+        local map = C.mmap(nil, size, C.PROT_READ, C.MAP_PRIVATE, fd, 0)
+        local errno = ffi.errno()
+        C.close(fd)
+
+        if ffi.cast("intptr_t", map) == -1 then
+            fail("map", path, errno)
+        end
+
+        self.data = ffi.gc(ffi.cast(const_char_ptr, map), function(ptr)
+            C.munmap(ffi.cast("void *", ptr), size)
+        end)
+    else
+        C.close(fd)
+
+        self.data = ffi.cast(const_char_ptr, "")
+    end
+
+    self.path = path
+    self.size = size
+
+    if li then
+        self.index = ffi.gc(li.lineindex_new(mark_interval), li.lineindex_destroy)
+    else
+        self.marks = double_arr(16)
+        self.marks[0] = 0
+        self.marks_count, self.marks_cap = 1, 16
+    end
+
+    --  Bytes scanned so far, and the line breaks found in them.
+    self.indexed, self.breaks = 0, 0
+    self.complete = size == 0
+
+    --  The last line looked up, since drawing asks for consecutive ones.
+    self.hint_line, self.hint_off = 1, 0
+
+    --  Enough for the first screen.
+    self:index_step(demand_chunk)
+end
+
+--  Scans up to `limit` more bytes for line breaks, on up to `threads` threads
+--  if the native scanner is there. Returns whether there is anything left to
+--  scan.
+function cl:index_step(limit, threads)
+    local start, cnt = self.indexed, self.breaks
+    local stop = math.min(self.size, start + limit)
+    local pos = start
+
+    if self.index then
+        local res
+
+        if threads and threads > 1 then
+            res = li.lineindex_scan_parallel(self.index, self.data + start, stop - start, start, threads)
+        else
+            res = li.lineindex_scan(self.index, self.data + start, stop - start, start)
+        end
+
+        if res < 0 then
+            error "Vandal error: Out of memory while indexing lines."
+        end
+
+        pos, cnt = stop, tonumber(li.lineindex_breaks(self.index))
+    end
+
+    while pos < stop do
+        local hit = C.memchr(self.data + pos, 10, stop - pos)
+
+        if hit == nil then
+            pos = stop
+            break
+        end
+
+        pos = tonumber(ffi.cast(const_char_ptr, hit) - self.data) + 1
+        cnt = cnt + 1
+
+        if cnt % mark_interval == 0 then
+            push_mark(self, pos)
+        end
+    end
+
+    self.indexed, self.breaks = pos, cnt
+    self.complete = pos >= self.size
+
+    local from, to = math.floor(start / page_size) * page_size, math.floor(pos / page_size) * page_size
+
+    if to > from then
+        C.madvise(ffi.cast("void *", self.data + from), to - from, C.MADV_DONTNEED)
+    end
+
+    return not self.complete
+end
+
+--  Indexes the rest of the file a chunk at a time between polls of the event
+--  loop, calling `on_progress` after each chunk.
+function cl:index_in_background(on_progress)
+    types.assert({ "nil", "function" }, on_progress, "progress callback")
+
+    if self.complete or self._indexing then
+        return
+    end
+
+    local function step()
+        if self:index_step(index_chunk, index_threads) then
+            self._indexing = vandal.ui.later(step)
+        else
+            self._indexing = nil
+        end
+
+        if on_progress then
+            on_progress(self)
+        end
+    end
+
+    self._indexing = vandal.ui.later(step)
+end
+
+--  Unmaps the file right away instead of whenever it is collected.
+function cl:close()
+    if self._indexing then
+        vandal.ui.cancel(self._indexing)
+        self._indexing = nil
+    end
+
+    if self.size > 0 then
+        C.munmap(ffi.cast("void *", ffi.gc(self.data, nil)), self.size)
+    end
+
+    self.data, self.size = ffi.cast(const_char_ptr, ""), 0
+    self.indexed, self.breaks, self.complete = 0, 0, true
+    self.hint_line, self.hint_off = 1, 0
+
+    if self.index then
+        li.lineindex_destroy(ffi.gc(self.index, nil))
+        self.index = nil
+    end
+
+    self.marks = double_arr(1)
+    self.marks[0] = 0
+    self.marks_count, self.marks_cap = 1, 1
+end
+
+--  Nothing about it can change.
+function cl:clone()
+    return self
+end
+
+function cl:length()
+    return self.size
+end
+
+--  Until indexing is complete, this only counts the lines found so far.
+function cl:line_count()
+    return self.breaks + 1
+end
+
+function cl:line_start(line)
+    if line <= 1 then
+        return 0
+    end
+
+    local k = line - 1
+
+    while self.breaks < k and not self.complete do
+        self:index_step(demand_chunk)
+    end
+
+    if k > self.breaks then
+        error "Vandal error: Line number out of range."
+    end
+
+    local j = math.floor(k / mark_interval)
+    local from, pos = j * mark_interval + 1, get_mark(self, j)
+
+    if self.hint_line <= line and self.hint_line > from then
+        from, pos = self.hint_line, self.hint_off
+    end
+
+    for _ = from, line - 1 do
+        pos = next_break(self, pos) + 1
+    end
+
+    self.hint_line, self.hint_off = line, pos
+
+    return pos
+end
+
+function cl:line_range(line)
+    local start = self:line_start(line)
+    local brk = next_break(self, start)
+
+    return start, (brk or self.size) - start
+end
+
+function cl:sub(off, len)
+    local to = math.min(off + len, self.size)
+
+    if off >= to then
+        return ""
+    end
+
+    return ffi.string(self.data + off, to - off)
+end
+
+function cl:text()
+    return self:sub(0, self.size)
+end
+
+function cl:insert()
+    error "Vandal error: Cannot modify a read-only buffer."
+end
+
+cl.delete = cl.insert
+
+return classes.create(cl)
@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 199309L  // clock_gettime
+
+#include "lineindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Measures the line indexer over an in-memory buffer of log-like lines, and
+ * checks its results against a plain memchr() scan.
+ *
+ *   ./bench-lineindex [MiB] [average line length]
+ */
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *make_buffer(size_t len, size_t avgline)
+{
+  char *buf = malloc(len);
+  if(!buf)
+    return NULL;
+
+  unsigned int seed = 1;
+  size_t i = 0;
+
+  while(i < len) {
+    seed = seed * 1103515245 + 12345;
+    size_t line = 1 + (seed >> 8) % (avgline * 2);
+
+    for(size_t j = 0; j < line && i < len; j++, i++)
+      buf[i] = 'a' + (i + j) % 26;
+
+    if(i < len)
+      buf[i++] = '\n';
+  }
+
+  return buf;
+}
+
+static void report(const char *name, size_t len, double secs)
+{
+  printf("  %-28s %8.2f ms  %6.2f GB/s\n", name, secs * 1000, len / secs / 1e9);
+}
+
+static int failed;
+
+static void check(LineIndex *li, const char *buf, size_t len, unsigned int stride, const char *name)
+{
+  size_t n = 0, kept = 0;
+  const char *p = buf, *end = buf + len;
+
+  while((p = memchr(p, '\n', end - p))) {
+    p++;
+    if(++n % stride)
+      continue;
+
+    if(kept >= lineindex_count(li) || lineindex_get(li, kept) != (uint64_t)(p - buf)) {
+      printf("  %s: entry %zu differs\n", name, kept);
+      failed = 1;
+      return;
+    }
+    kept++;
+  }
+
+  if(lineindex_breaks(li) != n || lineindex_count(li) != kept) {
+    printf("  %s: counted %llu/%zu, expected %zu/%zu\n", name,
+        (unsigned long long)lineindex_breaks(li), lineindex_count(li), n, kept);
+    failed = 1;
+  }
+}
+
+static void bench_scan(const char *buf, size_t len, unsigned int stride, int nthreads, size_t chunk)
+{
+  char name[64];
+  snprintf(name, sizeof name, "scan stride=%u threads=%d", stride, nthreads);
+
+  LineIndex *li = lineindex_new(stride);
+  double start = now();
+
+  /* Chunks as MappedFile feeds them, to exercise the incremental path */
+  for(size_t off = 0; off < len; off += chunk) {
+    size_t n = len - off < chunk ? len - off : chunk;
+
+    if(nthreads > 1)
+      lineindex_scan_parallel(li, buf + off, n, off, nthreads);
+    else
+      lineindex_scan(li, buf + off, n, off);
+  }
+
+  report(name, len, now() - start);
+  check(li, buf, len, stride, name);
+
+  lineindex_destroy(li);
+}
+
+int main(int argc, char *argv[])
+{
+  size_t len     = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1024) << 20;
+  size_t avgline = argc > 2 ? strtoul(argv[2], NULL, 10) : 80;
+
+  char *buf = make_buffer(len, avgline);
+  if(!buf) {
+    fprintf(stderr, "Cannot allocate %zu bytes\n", len);
+    return 1;
+  }
+
+  printf("%zu MiB, lines of about %zu bytes\n", len >> 20, avgline);
+
+  {
+    double start = now();
+    size_t n = 0;
+    const char *p = buf, *end = buf + len;
+
+    while((p = memchr(p, '\n', end - p))) {
+      p++;
+      n++;
+    }
+
+    report("memchr loop", len, now() - start);
+
+    start = now();
+    size_t counted = lineindex_count_breaks(buf, len);
+    report("count_breaks", len, now() - start);
+
+    if(counted != n) {
+      printf("  count_breaks: %zu, expected %zu\n", counted, n);
+      failed = 1;
+    }
+  }
+
+  bench_scan(buf, len, 1,    1, 16 << 20);
+  bench_scan(buf, len, 1024, 1, 16 << 20);
+  bench_scan(buf, len, 1,    4, 16 << 20);
+  bench_scan(buf, len, 1024, 4, 16 << 20);
+
+  /* Odd chunk sizes, so chunk edges fall inside SIMD blocks and lines */
+  bench_scan(buf, len, 7,    1, 1000003);
+  bench_scan(buf, len, 7,    3, 3000017);
+
+  free(buf);
+
+  printf(failed ? "FAILED\n" : "all results match\n");
+
+  return failed;
+}
@@ -0,0 +1,465 @@
+#include "lineindex.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_AVX2_DISPATCH
+#endif
+
+#define BLOCK_ENTRIES 4096
+
+/* Parallel scans only split ranges into parts at least this big */
+#define MIN_PART (1 << 20)
+
+struct block {
+  uint64_t base;
+  size_t   first;  /* index of delta[0] in the whole index */
+  uint32_t n;
+  uint32_t delta[BLOCK_ENTRIES];
+};
+
+struct LineIndex {
+  unsigned int stride;
+  unsigned int phase;  /* line breaks seen since the last kept one */
+  uint64_t breaks;
+  size_t count;
+
+  struct block **blocks;
+  size_t nblocks, blocks_cap;
+  struct block *cur;
+};
+
+LineIndex *lineindex_new(unsigned int stride)
+{
+  LineIndex *li = malloc(sizeof(LineIndex));
+  if(!li)
+    return NULL;
+
+  li->stride = stride ? stride : 1;
+  li->phase  = 0;
+  li->breaks = 0;
+  li->count  = 0;
+
+  li->blocks = NULL;
+  li->nblocks = li->blocks_cap = 0;
+  li->cur = NULL;
+
+  return li;
+}
+
+void lineindex_destroy(LineIndex *li)
+{
+  for(size_t i = 0; i < li->nblocks; i++)
+    free(li->blocks[i]);
+
+  free(li->blocks);
+  free(li);
+}
+
+static int append_block(LineIndex *li, struct block *b)
+{
+  if(li->nblocks == li->blocks_cap) {
+    size_t cap = li->blocks_cap ? li->blocks_cap * 2 : 16;
+    struct block **new = realloc(li->blocks, cap * sizeof(struct block *));
+    if(!new)
+      return -1;
+
+    li->blocks = new;
+    li->blocks_cap = cap;
+  }
+
+  b->first = li->count;
+  li->blocks[li->nblocks++] = b;
+  li->cur = b;
+
+  return 0;
+}
+
+static int new_block(LineIndex *li, uint64_t off)
+{
+  struct block *b = malloc(sizeof(struct block));
+  if(!b)
+    return -1;
+
+  b->base = off;
+  b->n = 0;
+
+  if(append_block(li, b) < 0) {
+    free(b);
+    return -1;
+  }
+
+  return 0;
+}
+
+static inline int push(LineIndex *li, uint64_t off)
+{
+  struct block *b = li->cur;
+
+  if(!b || b->n == BLOCK_ENTRIES || off - b->base > UINT32_MAX) {
+    if(new_block(li, off) < 0)
+      return -1;
+    b = li->cur;
+  }
+
+  b->delta[b->n++] = (uint32_t)(off - b->base);
+  li->count++;
+
+  return 0;
+}
+
+/* Records the line breaks flagged in a 64-bit mask of the bytes from `base` */
+static inline int emit_mask(LineIndex *li, uint64_t m, uint64_t base)
+{
+  unsigned int n = __builtin_popcountll(m);
+
+  li->breaks += n;
+
+  if(li->stride == 1) {
+    struct block *b = li->cur;
+
+    if(b && b->n + 64 <= BLOCK_ENTRIES && base + 64 - b->base <= UINT32_MAX) {
+      /* Room for any mask, so no checks per line break */
+      uint32_t *d = b->delta + b->n, rel = (uint32_t)(base - b->base) + 1;
+
+      b->n += n;
+      li->count += n;
+
+      for(; m; m &= m - 1)
+        *d++ = rel + __builtin_ctzll(m);
+
+      return 0;
+    }
+
+    for(; m; m &= m - 1)
+      if(push(li, base + __builtin_ctzll(m) + 1) < 0)
+        return -1;
+
+    return 0;
+  }
+
+  if(li->phase + n < li->stride) {
+    li->phase += n;
+    return 0;
+  }
+
+  for(; m; m &= m - 1)
+    if(++li->phase == li->stride) {
+      li->phase = 0;
+      if(push(li, base + __builtin_ctzll(m) + 1) < 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+static int scan_tail(LineIndex *li, const unsigned char *p, size_t len, uint64_t offset)
+{
+  uint64_t m = 0;
+
+  for(size_t i = 0; i < len; i++)
+    if(p[i] == '\n')
+      m |= (uint64_t)1 << i;
+
+  return m ? emit_mask(li, m, offset) : 0;
+}
+
+static int scan_generic(LineIndex *li, const unsigned char *p, size_t len, uint64_t offset)
+{
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  for(; i + 64 <= len; i += 64) {
+    uint64_t m =
+      (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)),      nl))       |
+      (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)), nl)) << 16 |
+      (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)), nl)) << 32 |
+      (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)), nl)) << 48;
+
+    if(emit_mask(li, m, offset + i) < 0)
+      return -1;
+  }
+#else
+  for(; i + 64 <= len; i += 64) {
+    const unsigned char *hit = memchr(p + i, '\n', 64);
+    if(!hit)
+      continue;
+
+    if(scan_tail(li, p + i, 64, offset + i) < 0)
+      return -1;
+  }
+#endif
+
+  return scan_tail(li, p + i, len - i, offset + i);
+}
+
+static size_t count_generic(const unsigned char *p, size_t len)
+{
+  size_t i = 0, total = 0;
+
+#if defined(__SSE2__)
+  const __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+
+  while(i + 16 <= len) {
+    /* Each byte lane counts up to 255 matches before being summed */
+    __m128i acc = zero;
+    size_t end = i + 255 * 16;
+    if(end > len)
+      end = len;
+
+    for(; i + 16 <= end; i += 16)
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+
+    __m128i sum = _mm_sad_epu8(acc, zero);
+    total += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+  }
+#endif
+
+  for(; i < len; i++)
+    total += p[i] == '\n';
+
+  return total;
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static int scan_avx2(LineIndex *li, const unsigned char *p, size_t len, uint64_t offset)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0;
+
+  for(; i + 64 <= len; i += 64) {
+    uint64_t m =
+      (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)),      nl)) |
+      (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i + 32)), nl)) << 32;
+
+    if(emit_mask(li, m, offset + i) < 0)
+      return -1;
+  }
+
+  return scan_tail(li, p + i, len - i, offset + i);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const unsigned char *p, size_t len)
+{
+  const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+  size_t i = 0, total = 0;
+
+  while(i + 32 <= len) {
+    __m256i acc = zero;
+    size_t end = i + 255 * 32;
+    if(end > len)
+      end = len;
+
+    for(; i + 32 <= end; i += 32)
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+
+    __m256i sum = _mm256_sad_epu8(acc, zero);
+    total += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+             _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+  }
+
+  return total + count_generic(p + i, len - i);
+}
+
+static int have_avx2(void)
+{
+  static int supported = -1;
+
+  if(supported < 0) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+
+  return supported;
+}
+#endif
+
+static int scan(LineIndex *li, const unsigned char *p, size_t len, uint64_t offset)
+{
+#ifdef HAVE_AVX2_DISPATCH
+  if(have_avx2())
+    return scan_avx2(li, p, len, offset);
+#endif
+
+  return scan_generic(li, p, len, offset);
+}
+
+int lineindex_scan(LineIndex *li, const char *data, size_t len, uint64_t offset)
+{
+  return scan(li, (const unsigned char *)data, len, offset);
+}
+
+size_t lineindex_count_breaks(const char *data, size_t len)
+{
+#ifdef HAVE_AVX2_DISPATCH
+  if(have_avx2())
+    return count_avx2((const unsigned char *)data, len);
+#endif
+
+  return count_generic((const unsigned char *)data, len);
+}
+
+struct part {
+  const unsigned char *p;
+  size_t len;
+  uint64_t offset;
+  size_t breaks;
+  LineIndex *li;
+  int ret;
+};
+
+static void *count_part(void *data)
+{
+  struct part *part = data;
+  part->breaks = lineindex_count_breaks((const char *)part->p, part->len);
+  return NULL;
+}
+
+static void *scan_part(void *data)
+{
+  struct part *part = data;
+  part->ret = scan(part->li, part->p, part->len, part->offset);
+  return NULL;
+}
+
+/* Runs fn on every part, the first on this thread and the others on threads
+ * of their own, or on this one too if those cannot be started. */
+static void run_parts(struct part *parts, int nparts, void *(*fn)(void *))
+{
+  pthread_t threads[nparts];
+  int started[nparts];
+
+  for(int i = 1; i < nparts; i++)
+    started[i] = pthread_create(&threads[i], NULL, fn, &parts[i]) == 0;
+
+  fn(&parts[0]);
+
+  for(int i = 1; i < nparts; i++)
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    else
+      fn(&parts[i]);
+}
+
+int lineindex_scan_parallel(LineIndex *li, const char *data, size_t len, uint64_t offset, int nthreads)
+{
+  int nparts = nthreads;
+
+  if(nparts > (int)(len / MIN_PART))
+    nparts = len / MIN_PART;
+
+  if(nparts <= 1)
+    return lineindex_scan(li, data, len, offset);
+
+  struct part parts[nparts];
+  size_t each = len / nparts;
+
+  for(int i = 0; i < nparts; i++) {
+    parts[i].p = (const unsigned char *)data + i * each;
+    parts[i].len = i == nparts - 1 ? len - i * each : each;
+    parts[i].offset = offset + i * each;
+    parts[i].li = NULL;
+    parts[i].ret = 0;
+  }
+
+  /* Which line breaks each part keeps depends on how many come before it,
+   * so they are all counted first. */
+  run_parts(parts, nparts, count_part);
+
+  unsigned int phase = li->phase;
+  int ret = 0;
+
+  for(int i = 0; i < nparts; i++) {
+    parts[i].li = lineindex_new(li->stride);
+    if(!parts[i].li) {
+      ret = -1;
+      goto out;
+    }
+
+    parts[i].li->phase = phase;
+    phase = (phase + parts[i].breaks) % li->stride;
+  }
+
+  run_parts(parts, nparts, scan_part);
+
+  /* The blocks of each part are moved over as they are */
+  for(int i = 0; i < nparts && ret == 0; i++) {
+    LineIndex *part = parts[i].li;
+
+    if(parts[i].ret < 0) {
+      ret = -1;
+      break;
+    }
+
+    for(size_t b = 0; b < part->nblocks; b++) {
+      if(append_block(li, part->blocks[b]) < 0) {
+        /* Whatever was not moved is freed with the part */
+        memmove(part->blocks, part->blocks + b, (part->nblocks - b) * sizeof(struct block *));
+        part->nblocks -= b;
+        ret = -1;
+        break;
+      }
+
+      li->count += part->blocks[b]->n;
+    }
+
+    if(ret == 0)
+      part->nblocks = 0;
+
+    li->breaks += part->breaks;
+    li->phase = part->phase;
+  }
+
+out:
+  for(int i = 0; i < nparts; i++)
+    if(parts[i].li)
+      lineindex_destroy(parts[i].li);
+
+  return ret;
+}
+
+uint64_t lineindex_breaks(const LineIndex *li)
+{
+  return li->breaks;
+}
+
+size_t lineindex_count(const LineIndex *li)
+{
+  return li->count;
+}
+
+uint64_t lineindex_get(const LineIndex *li, size_t i)
+{
+  /* Blocks are only ever short after a parallel scan or a gap of over 4GiB,
+   * so the block is usually found right away. */
+  size_t lo = 0, hi = li->nblocks;
+  size_t guess = i / BLOCK_ENTRIES;
+
+  if(guess < hi && li->blocks[guess]->first <= i && i - li->blocks[guess]->first < li->blocks[guess]->n)
+    lo = guess;
+  else {
+    while(hi - lo > 1) {
+      size_t mid = (lo + hi) / 2;
+
+      if(li->blocks[mid]->first <= i)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  }
+
+  struct block *b = li->blocks[lo];
+
+  return b->base + b->delta[i - b->first];
+}
@@ -0,0 +1,34 @@
+#ifndef __LINEINDEX_H__
+#define __LINEINDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Finds line starts in byte ranges, typically consecutive chunks of a mapped
+ * file, and keeps their offsets as blocks of 32-bit deltas from a 64-bit
+ * block base. A stride above 1 keeps only every stride-th line start, for a
+ * sparse index; every line break is still counted.
+ */
+
+typedef struct LineIndex LineIndex;
+
+LineIndex *lineindex_new(unsigned int stride);
+void       lineindex_destroy(LineIndex *li);
+
+/* Scans len bytes found at absolute offset `offset`, which must not be below
+ * the end of the previously scanned range. Records the offset following each
+ * kept line break. Returns -1 if memory ran out, 0 otherwise. */
+int  lineindex_scan(LineIndex *li, const char *data, size_t len, uint64_t offset);
+
+/* The same, splitting the range over up to nthreads threads. Falls back to
+ * scanning on the calling thread if threads cannot be started. */
+int  lineindex_scan_parallel(LineIndex *li, const char *data, size_t len, uint64_t offset, int nthreads);
+
+uint64_t lineindex_breaks(const LineIndex *li);
+size_t   lineindex_count(const LineIndex *li);
+uint64_t lineindex_get(const LineIndex *li, size_t i);
+
+/* Number of line breaks in a range, without recording anything */
+size_t lineindex_count_breaks(const char *data, size_t len);
+
+#endif
@@ -0,0 +1,387 @@
+--[[
+    Copyright (c) 2017 Alexandru-Mihai Maftei. All rights reserved.
+
+
+    Developed by: Alexandru-Mihai Maftei
+    aka Vercas
+    http://vercas.com | https://github.com/vercas/Vandal
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal with the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimers.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimers in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the names of Alexandru-Mihai Maftei, Vercas, nor the names of
+        its contributors may be used to endorse or promote products derived from
+        this Software without specific prior written permission.
+
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    WITH THE SOFTWARE.
+
+    ---
+
+    You may also find the text of this license in "LICENSE.md".
+]]
+
+local classes = require "vandal/classes"
+local types = require "vandal/utils/types"
+local ffi = require "ffi"
+require "vandal/ffi/misc"
+
+local C = ffi.C
+
+--  Text is kept in buffers which never change once written: one holding the
+--  initial contents, and an append-only one for everything inserted since.
+--  The document is the in-order sequence of pieces (spans of those buffers)
+--  held in a treap keyed implicitly by byte length. Every node also counts
+--  the line breaks in its subtree, which makes it the line index as well, so
+--  edits and line lookups are O(log n) regardless of line length.
+--  Nodes are never modified after creation, so copying a table only means
+--  sharing its root.
+
+local const_char_ptr = ffi.typeof "const char *"
+local char_arr = ffi.typeof "char[?]"
+local double_arr = ffi.typeof "double[?]"
+
+local random = math.random
+
+--  Buffers
+
+--  Offsets of line breaks are recorded as the buffer is filled, so the number
+--  of breaks in any span of it is two binary searches away.
+local function push_break(b, off)
+    local cnt = b.breaks_count
+
+    if cnt == b.breaks_cap then
+        local new = double_arr(cnt * 2)
+        ffi.copy(new, b.breaks, cnt * ffi.sizeof "double")
+
+        b.breaks, b.breaks_cap = new, cnt * 2
+    end
+
+    b.breaks[cnt] = off
+    b.breaks_count = cnt + 1
+end
+
+--  Returns the number of line breaks in the given range of the buffer, and
+--  the offset of the last one.
+local function index_breaks(b, from, to)
+    local data, cnt, last = b.data, 0
+
+    while from < to do
+        local hit = C.memchr(data + from, 10, to - from)
+
+        if hit == nil then
+            break
+        end
+
+        last = tonumber(ffi.cast(const_char_ptr, hit) - data)
+        push_break(b, last)
+
+        cnt, from = cnt + 1, last + 1
+    end
+
+    return cnt, last
+end
+
+--  How many line breaks precede the given offset in the buffer.
+local function breaks_before(b, off)
+    local brk, lo, hi = b.breaks, 0, b.breaks_count
+
+    while lo < hi do
+        local mid = math.floor((lo + hi) / 2)
+
+        if brk[mid] < off then
+            lo = mid + 1
+        else
+            hi = mid
+        end
+    end
+
+    return lo
+end
+
+local function new_buffer(str)
+    local b = { breaks = double_arr(16), breaks_cap = 16, breaks_count = 0 }
+
+    if str then
+        --  The string itself is kept around for its bytes.
+        b.str, b.data, b.size, b.cap = str, ffi.cast(const_char_ptr, str), #str, #str
+
+        index_breaks(b, 0, #str)
+    else
+        b.data, b.size, b.cap = char_arr(256), 0, 256
+    end
+
+    return b
+end
+
+--  Appends to an add buffer, returning what `index_breaks` does for the new
+--  bytes.
+local function append(b, str)
+    local len, size = #str, b.size
+
+    if size + len > b.cap then
+        local cap = b.cap
+
+        repeat cap = cap * 2 until cap >= size + len
+
+        local new = char_arr(cap)
+        ffi.copy(new, b.data, size)
+
+        b.data, b.cap = new, cap
+    end
+
+    ffi.copy(b.data + size, str, len)
+    b.size = size + len
+
+    return index_breaks(b, size, size + len)
+end
+
+--  Treap
+
+local function new_node(b, s, n, lf, l, r, p)
+    local tn, tlf = n, lf
+
+    if l then tn, tlf = tn + l.tn, tlf + l.tlf end
+    if r then tn, tlf = tn + r.tn, tlf + r.tlf end
+
+    return { b = b, s = s, n = n, lf = lf, l = l, r = r, p = p or random(), tn = tn, tlf = tlf }
+end
+
+local function with_children(x, l, r)
+    return new_node(x.b, x.s, x.n, x.lf, l, r, x.p)
+end
+
+local function merge(a, b)
+    if not a then return b end
+    if not b then return a end
+
+    if a.p > b.p then
+        return with_children(a, a.l, merge(a.r, b))
+    else
+        return with_children(b, merge(a, b.l), b.r)
+    end
+end
+
+--  Splits into the first `k` bytes and the rest, cutting a piece in two if
+--  it straddles the offset.
+local function split(x, k)
+    if not x then
+        return nil, nil
+    end
+
+    local ln = x.l and x.l.tn or 0
+
+    if k <= ln then
+        local a, b = split(x.l, k)
+
+        return a, with_children(x, b, x.r)
+    elseif k >= ln + x.n then
+        local a, b = split(x.r, k - ln - x.n)
+
+        return with_children(x, x.l, a), b
+    else
+        local buf, d = x.b, k - ln
+        local lf = breaks_before(buf, x.s + d) - breaks_before(buf, x.s)
+
+        --  Both halves keep the priority, so the heap order still holds.
+        return new_node(buf, x.s, d, lf, x.l, nil, x.p), new_node(buf, x.s + d, x.n - d, x.lf - lf, nil, x.r, x.p)
+    end
+end
+
+local function rightmost(x)
+    while x and x.r do
+        x = x.r
+    end
+
+    return x
+end
+
+--  Lengthens the last piece, for text appended right behind it in the add
+--  buffer, which is what typing does.
+local function extend_last(x, n, lf)
+    if x.r then
+        return with_children(x, x.l, extend_last(x.r, n, lf))
+    else
+        return new_node(x.b, x.s, x.n + n, x.lf + lf, x.l, nil, x.p)
+    end
+end
+
+--  Offset of the byte following the `k`th line break, `k` > 0.
+local function after_break(x, k)
+    local pos = 0
+
+    while x do
+        local l = x.l
+        local llf = l and l.tlf or 0
+
+        if k <= llf then
+            x = l
+        else
+            k = k - llf
+
+            local ln = l and l.tn or 0
+
+            if k <= x.lf then
+                local b = x.b
+
+                return pos + ln + b.breaks[breaks_before(b, x.s) + k - 1] - x.s + 1
+            end
+
+            k, pos, x = k - x.lf, pos + ln + x.n, x.r
+        end
+    end
+
+    error "Vandal internal error: Line break index out of range."
+end
+
+local function collect(x, base, from, to, out)
+    local ln = x.l and x.l.tn or 0
+    local s = base + ln
+    local e = s + x.n
+
+    if from < s and x.l then
+        collect(x.l, base, from, math.min(to, s), out)
+    end
+
+    if from < e and to > s then
+        local a, z = math.max(from, s), math.min(to, e)
+
+        out[#out + 1] = ffi.string(x.b.data + x.s + a - s, z - a)
+    end
+
+    if to > e and x.r then
+        collect(x.r, e, math.max(from, e), to, out)
+    end
+end
+
+local cl = {
+    Name = "PieceTable",
+
+    read_only = false,
+}
+
+function cl:__init(text)
+    self:set(text or "")
+end
+
+--  Replaces all the contents.
+function cl:set(text)
+    types.assert("string", text, "text")
+
+    local orig = new_buffer(text)
+
+    self.add = new_buffer()
+    self.root = #text > 0 and new_node(orig, 0, #text, orig.breaks_count) or nil
+end
+
+--  Copies the table in constant time. Both copies can be edited
+--  independently afterwards.
+function cl:clone()
+    local res = self.__class()
+
+    res.add, res.root = self.add, self.root
+
+    return res
+end
+
+function cl:length()
+    return self.root and self.root.tn or 0
+end
+
+function cl:line_count()
+    return (self.root and self.root.tlf or 0) + 1
+end
+
+--  Offset at which the given line (1-based) starts.
+function cl:line_start(line)
+    if line <= 1 then
+        return 0
+    end
+
+    return after_break(self.root, line - 1)
+end
+
+--  Offset and length, not counting the line break, of the given line.
+function cl:line_range(line)
+    local start = self:line_start(line)
+
+    if line >= self:line_count() then
+        return start, self:length() - start
+    end
+
+    return start, after_break(self.root, line) - 1 - start
+end
+
+--  Returns `len` bytes from the given offset, or fewer at the end.
+function cl:sub(off, len)
+    local to = math.min(off + len, self:length())
+
+    if off >= to then
+        return ""
+    end
+
+    local out = { }
+
+    collect(self.root, 0, off, to, out)
+
+    return out[2] and table.concat(out) or out[1]
+end
+
+function cl:text()
+    return self:sub(0, self:length())
+end
+
+--  Inserts text at the given offset. Returns the number of line breaks in
+--  it, and if there are any, the number of bytes after the last one.
+function cl:insert(off, text)
+    local len = #text
+
+    if len == 0 then
+        return 0
+    end
+
+    local add = self.add
+    local start = add.size
+    local lf, last = append(add, text)
+    local a, b = split(self.root, off)
+    local prev = rightmost(a)
+
+    if prev and prev.b == add and prev.s + prev.n == start then
+        a = extend_last(a, len, lf)
+    else
+        a = merge(a, new_node(add, start, len, lf))
+    end
+
+    self.root = merge(a, b)
+
+    return lf, last and start + len - last - 1
+end
+
+--  Removes `len` bytes from the given offset.
+function cl:delete(off, len)
+    if len <= 0 then
+        return
+    end
+
+    local a, b = split(self.root, off)
+    local _, c = split(b, len)
+
+    self.root = merge(a, c)
+end
+
+return classes.create(cl)
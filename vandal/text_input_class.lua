@@ -37,7 +37,10 @@
 ]]
 
 local classes = require "vandal/classes"
+local column_cache = require "vandal/column_cache_class"
+local piece_table = require "vandal/piece_table_class"
 local types = require "vandal/utils/types"
+local undo_journal = require "vandal/undo_journal_class"
 local unicode = require "vandal/utils/unicode"
 require "vandal/logging"
 
@@ -48,10 +51,145 @@ local cl = {
     scroll_up_glyph     = UNIC "↑|^",
     scroll_down_glyph   = UNIC "↓|v",
     scroll_either_glyph = UNIC "↕|X",
-    scroll_left_glyph   = UNIC "|<",
-    scroll_right_glyph  = UNIC "|>",
+    scroll_left_glyph   = UNIC "|<",
+    scroll_right_glyph  = UNIC "|>",
+
+    line_count = {
+        get = function(self)
+            return self.buffer:line_count()
+        end,
+    },
 }
 
+--  The contents live in a piece table, which makes edits cost the same
+--  regardless of how long the line is. Horizontal scrolling is per line, and
+--  only lines which are scrolled have an entry in `scrolls`.
+--  The caret and scrolling are in display columns, which the `ColumnCache`
+--  of the buffer turns into byte offsets, so neither drawing nor moving
+--  around depends on the length of the line.
+
+local function get_scroll(self, line)
+    return self.scrolls[line] or 0
+end
+
+local function set_scroll(self, line, val)
+    self.scrolls[line] = val > 0 and val or nil
+end
+
+local function columns(self)
+    local cache = self.columns
+
+    if not cache or cache.buffer ~= self.buffer then
+        cache = column_cache(self.buffer)
+        self.columns = cache
+    end
+
+    return cache
+end
+
+--  Renumbers the scroll entries after `cnt` lines were inserted after the
+--  given one, or removed after it when negative. The given line changed too.
+local function shift_lines(self, line, cnt)
+    columns(self):shift(line, cnt)
+
+    local new = { }
+
+    for l, s in pairs(self.scrolls) do
+        if l <= line then
+            new[l] = s
+        elseif l > line - cnt then
+            new[l + cnt] = s
+        end
+    end
+
+    self.scrolls = new
+end
+
+local function line_length(self, line)
+    return columns(self):width(line)
+end
+
+--  The column of the nearest character start at or before the given column.
+local function snap(self, line, col)
+    local _, res = columns(self):byte(line, col)
+
+    return res
+end
+
+local function watermark_width(self)
+    return self.watermark and columns(self):column(1, #self.watermark) or 0
+end
+
+local function caret_offset(self)
+    local byte = columns(self):byte(self.cur_line, self.cur_column)
+
+    return self.buffer:line_start(self.cur_line) + byte, byte
+end
+
+--  Moves the rows from `y` down by `cnt`, or up when negative, to follow the
+--  lines shown on them, so only the rows which are uncovered get drawn again.
+--  The scroll glyphs in the last column move along and are redrawn.
+local function shift_rows(self, y, cnt)
+    local h = self._h - y
+
+    if h <= 0 or cnt == 0 then
+        return
+    end
+
+    if math.abs(cnt) >= h or not self:scroll_rows(y, h, -cnt) then
+        self:invalidate(y, h)
+
+        return
+    end
+
+    if cnt > 0 then
+        self:invalidate(self._h - 1)
+    else
+        self:invalidate(self._h - 1 + cnt)
+    end
+
+    if y == 0 then
+        self:invalidate(math.max(cnt, 0))
+    end
+end
+
+local INSERT, DELETE = undo_journal.INSERT, undo_journal.DELETE
+
+--  Notes an edit in the journal, once the caret is where it ends up.
+local function record(self, kind, line, byte, text, beforeLine, beforeColumn, typing)
+    self.journal:record(kind, line, byte, text, beforeLine, beforeColumn, self.cur_line, self.cur_column, typing)
+end
+
+--  Applies an edit from the journal and puts the caret where it says.
+local function replay(self, kind, line, byte, text, caretLine, caretColumn)
+    if not kind then
+        return false
+    end
+
+    local start = self.buffer:line_start(line)
+    local _, lf = text:gsub("\n", "")
+
+    if kind == INSERT then
+        self.buffer:insert(start + byte, text)
+    else
+        self.buffer:delete(start + byte, #text)
+        lf = -lf
+    end
+
+    if lf == 0 then
+        columns(self):edit(line, byte, kind == DELETE and #text or 0, kind == INSERT and #text or 0)
+    else
+        shift_lines(self, line, lf)
+    end
+
+    self:set_caret(caretColumn, caretLine, false, true)
+    self:invalidate()
+
+    self:do_on_contents_change()
+
+    return true
+end
+
 function cl:do_on_newline(mod)
     local fnc = self.on_newline
 
@@ -100,7 +238,9 @@ function cl:__init(win, x, y, w, h)
 
     __super(self, han, true, x, y, w, h)
 
-    self.lines = { { str = "", scroll = 0 } }
+    self.buffer = piece_table()
+    self.journal = undo_journal()
+    self.scrolls = { }
     self.cur_line = 1
     self.cur_column = 0
     self.cur_scroll = 1
@@ -109,133 +249,190 @@ end
 
 cl._state = {
     get = function(self)
-        return { lines = table.deepcopy(self.lines), cur_line = self.cur_line, cur_column = self.cur_column, cur_scroll = self.cur_scroll, watermark = self.watermark }
+        return { buffer = self.buffer:clone(), scrolls = table.shallowcopy(self.scrolls), cur_line = self.cur_line, cur_column = self.cur_column, cur_scroll = self.cur_scroll, watermark = self.watermark }
     end,
 
     set = function(self, val)
-        self.lines, self.cur_line, self.cur_column, self.cur_scroll, self.watermark = val.lines, val.cur_line, val.cur_column, val.cur_scroll, val.watermark
+        self.buffer, self.scrolls = val.buffer:clone(), table.shallowcopy(val.scrolls)
+        self.journal = undo_journal()
+        self.cur_line, self.cur_column, self.cur_scroll, self.watermark = val.cur_line, val.cur_column, val.cur_scroll, val.watermark
     end,
 }
 
 function cl:process_key(ev)
     local key, char, mod = ev.key, ev.char, ev.modifiers
-    local line = self.lines[self.cur_line]
+    local editable = not self.buffer.read_only
+    local line, column = self.cur_line, self.cur_column
 
-    if key == vandal.ui.KEY_CODEPOINT then
+    if key ~= vandal.ui.KEY_CODEPOINT and key ~= vandal.ui.KEY_BACKSPACE and key ~= vandal.ui.KEY_DELETE then
+        --  Typing somewhere else starts a new undo step.
+        self.journal:seal()
+    end
+
+    if key == vandal.ui.KEY_CODEPOINT and mod == vandal.ui.MOD_NONE and editable then
         --  Usual printable character.
 
-        if self.cur_column == #line.str then
-            line.str = line.str .. char
-            self.cur_column = self.cur_column + 1
+        local cache = columns(self)
+        local off, byte = caret_offset(self)
+        local _, len = self.buffer:line_range(self.cur_line)
+
+        self.buffer:insert(off, char)
+        cache:edit(self.cur_line, byte, 0, #char)
+
+        local col = cache:column(self.cur_line, byte + #char)
 
-            if line.scroll < self.cur_column - self._w + 1 then
-                line.scroll = self.cur_column - self._w + 1
+        if byte == len then
+            self.cur_column = col
+
+            if get_scroll(self, self.cur_line) < self.cur_column - self._w + 1 then
+                set_scroll(self, self.cur_line, self.cur_column - self._w + 1)
             end
         elseif self.cur_column > 0 then
-            line.str = line.str:sub(1, self.cur_column) .. char .. line.str:sub(self.cur_column + 1)
-
-            self:move_caret_right(false, true)  --  Won't invalidate the line unless scrolled, but it just changed.
+            if col > self.cur_column then
+                self:move_caret_right(false, true)  --  Won't invalidate the line unless scrolled, but it just changed.
+            end
         else
-            line.str = char .. line.str
-            self.cur_column = self.cur_column + 1
+            self.cur_column = col
 
             --  No chance that this needs scrolling.
         end
 
+        record(self, INSERT, line, byte, char, line, column, true)
+
         self:invalidate(self.cur_line - self.cur_scroll)
 
         self:do_on_contents_change()
+    elseif key == vandal.ui.KEY_CODEPOINT and mod == vandal.ui.MOD_CONTROL and (char == "z" or char == "y") then
+        if char == "z" then
+            self:undo()
+        else
+            self:redo()
+        end
     elseif key == vandal.ui.KEY_ENTER then
         --  Enter key.
 
         if self:do_on_newline(mod) then
             --  Do nothing. When the hook returns true, it means it did its own thing-a-magic.
+        elseif not editable then
+            --  Nor when there is nothing that could be changed.
         else
-            local oldLine, newLine = self.lines[self.cur_line], { scroll = 0 }
-            self.cur_line = self.cur_line + 1
-
-            table.insert(self.lines, self.cur_line, newLine)
+            local off, byte = caret_offset(self)
 
             if mod == vandal.ui.MOD_NONE then
-                newLine.str = oldLine.str:sub(self.cur_column + 1)
-                oldLine.str = oldLine.str:sub(1, self.cur_column)
+                self.buffer:insert(off, "\n")
 
-                oldLine.scroll = math.max(0, #oldLine.str - self._w + 1)
+                shift_lines(self, self.cur_line, 1)
+                set_scroll(self, self.cur_line, self.cur_column - self._w + 1)
             else
-                newLine.str = ""
+                local start, len = self.buffer:line_range(self.cur_line)
+
+                self.buffer:insert(start + len, "\n")
+                byte = len
+
+                shift_lines(self, self.cur_line, 1)
             end
 
+            self.cur_line = self.cur_line + 1
             self.cur_column = 0
 
-            if self.cur_line - self.cur_scroll >= self._h then
+            record(self, INSERT, line, byte, "\n", line, column)
+
+            local row = self.cur_line - self.cur_scroll
+
+            if row >= self._h then
+                --  The view follows the new line, so everything moves up.
                 self.cur_scroll = self.cur_scroll + 1
 
-                self:invalidate()
+                shift_rows(self, 0, -1)
+                self:invalidate(self._h - 2, 2)
             else
-                self:invalidate(self.cur_line - self.cur_scroll - 1, self._h)
+                --  Only the rows below make room for it.
+                shift_rows(self, row, 1)
+                self:invalidate(row - 1, 2)
             end
 
             self:do_on_contents_change()
         end
-    elseif key == vandal.ui.KEY_BACKSPACE then
+    elseif key == vandal.ui.KEY_BACKSPACE and editable then
         --  Erase previous character.
 
-        if self.watermark and self.cur_line == 1 and self.cur_column <= #self.watermark then
+        if self.watermark and self.cur_line == 1 and self.cur_column <= watermark_width(self) then
             --  Invalid.
         elseif self.cur_column > 0 then
-            local line = self.lines[self.cur_line]
+            local cache = columns(self)
+            local off, byte = caret_offset(self)
+            local prev, col = cache:byte(self.cur_line, self.cur_column - 1)
+            local text = self.buffer:sub(off - byte + prev, byte - prev)
 
-            line.str = line.str:sub(1, self.cur_column - 1) .. line.str:sub(self.cur_column + 1)
-            self.cur_column = self.cur_column - 1
+            self.buffer:delete(off - byte + prev, byte - prev)
+            cache:edit(self.cur_line, prev, byte - prev, 0)
+            self.cur_column = col
 
-            if line.scroll > 0 then
-                if self.cur_column == line.scroll then
-                    line.scroll = math.max(0, line.scroll - 2)
-                elseif self.cur_column == line.scroll + 1 then
-                    line.scroll = line.scroll - 1
-                end
+            record(self, DELETE, line, prev, text, line, column, true)
+
+            local scroll = get_scroll(self, self.cur_line)
+
+            if scroll > 0 and self.cur_column <= scroll + 1 then
+                set_scroll(self, self.cur_line, self.cur_column - 2)
             end
 
             self:invalidate(self.cur_line - self.cur_scroll)
 
             self:do_on_contents_change()
         elseif self.cur_line > 1 then
-            local oldLine, newLine = self.lines[self.cur_line], self.lines[self.cur_line - 1]
+            local prev = self.cur_line - 1
+            local start, len = self.buffer:line_range(prev)
+
+            self.cur_column = line_length(self, prev)
 
-            self.cur_column = #newLine.str
-            newLine.str = newLine.str .. oldLine.str
-            newLine.scroll = math.max(0, math.min(math.floor(self.cur_column - (self._w - 3) / 2), #newLine.str - self._w + 1))
+            self.buffer:delete(start + len, 1)
+            shift_lines(self, prev, -1)
 
-            table.remove(self.lines, self.cur_line)
-            self.cur_line = self.cur_line - 1
+            set_scroll(self, prev, math.min(math.floor(self.cur_column - (self._w - 3) / 2), line_length(self, prev) - self._w + 1))
+            self.cur_line = prev
+
+            record(self, DELETE, prev, len, "\n", line, column)
 
             if self.cur_scroll > self.cur_line then
+                --  The joined line takes the top row, the others stay put.
                 self.cur_scroll = self.cur_scroll - 1
 
-                self:invalidate()
+                self:invalidate(0)
             else
-                self:invalidate(self.cur_line - self.cur_scroll, self._h)
+                shift_rows(self, self.cur_line - self.cur_scroll + 1, -1)
+                self:invalidate(self.cur_line - self.cur_scroll)
             end
 
             self:do_on_contents_change()
         end
-    elseif key == vandal.ui.KEY_DELETE then
+    elseif key == vandal.ui.KEY_DELETE and editable then
         --  Erase next character.
 
-        local line = self.lines[self.cur_line]
+        local start, len = self.buffer:line_range(self.cur_line)
+        local cache = columns(self)
+        local byte = cache:byte(self.cur_line, self.cur_column)
+
+        if byte < len then
+            local nxt = cache:next(self.cur_line, byte)
+            local text = self.buffer:sub(start + byte, nxt - byte)
+
+            self.buffer:delete(start + byte, nxt - byte)
+            cache:edit(self.cur_line, byte, nxt - byte, 0)
 
-        if self.cur_column < #line.str then
-            line.str = line.str:sub(1, self.cur_column) .. line.str:sub(self.cur_column + 2)
+            record(self, DELETE, line, byte, text, line, column, true)
 
             self:invalidate(self.cur_line - self.cur_scroll)
 
             self:do_on_contents_change()
-        elseif self.cur_line < #self.lines then
-            line.str = line.str .. self.lines[self.cur_line + 1].str
+        elseif self.cur_line < self.buffer:line_count() then
+            self.buffer:delete(start + len, 1)
 
-            table.remove(self.lines, self.cur_line + 1)
+            shift_lines(self, self.cur_line, -1)
 
-            self:invalidate(self.cur_line - self.cur_scroll, self._h)
+            record(self, DELETE, line, len, "\n", line, column)
+
+            shift_rows(self, self.cur_line - self.cur_scroll + 1, -1)
+            self:invalidate(self.cur_line - self.cur_scroll)
 
             self:do_on_contents_change()
         end
@@ -253,18 +450,18 @@ function cl:process_key(ev)
         self:scroll_down()
     elseif key == vandal.ui.KEY_HOME then
         --  Move caret to start of line, then scroll to beginning.
-        local startX = (self.watermark and self.cur_line == 1) and #self.watermark or 0
+        local startX = self.cur_line == 1 and watermark_width(self) or 0
 
         if self.cur_column > startX then
-            local line = self.lines[self.cur_line]
+            local scroll = get_scroll(self, self.cur_line)
 
-            if self.cur_column > line.scroll + 1 and line.scroll > 0 then
-                self.cur_column = line.scroll + 1
+            if self.cur_column > scroll + 1 and scroll > 0 then
+                self.cur_column = snap(self, self.cur_line, scroll + 1)
             else
                 self.cur_column = startX
 
-                if line.scroll > 0 then
-                    line.scroll = 0
+                if scroll > 0 then
+                    set_scroll(self, self.cur_line, 0)
                     self:invalidate(self.cur_line - self.cur_scroll)
                 end
             end
@@ -274,21 +471,21 @@ function cl:process_key(ev)
     elseif key == vandal.ui.KEY_END then
         --  Move caret to end of line, then scroll to end.
 
-        local line = self.lines[self.cur_line]
+        local len = line_length(self, self.cur_line)
 
-        if self.cur_column < #line.str then
-            local lspw = line.scroll + self._w
+        if self.cur_column < len then
+            local lspw = get_scroll(self, self.cur_line) + self._w
             --  Line Scroll Plus Width...
 
-            if self.cur_column < lspw - 3 and #line.str > lspw - 1 then
-                self.cur_column = lspw - 3
+            if self.cur_column < lspw - 3 and len > lspw - 1 then
+                self.cur_column = snap(self, self.cur_line, lspw - 3)
             else
-                self.cur_column = #line.str
+                self.cur_column = len
 
-                local newS = math.max(0, #line.str - self._w + 1)
+                local newS = math.max(0, len - self._w + 1)
 
-                if line.scroll ~= newS then
-                    line.scroll = newS
+                if get_scroll(self, self.cur_line) ~= newS then
+                    set_scroll(self, self.cur_line, newS)
                     self:invalidate(self.cur_line - self.cur_scroll)
                 end
             end
@@ -301,14 +498,79 @@ function cl:process_key(ev)
         return true
     end
 
-    self:_set_cursor(self.cur_column - self.lines[self.cur_line].scroll, self.cur_line - self.cur_scroll)
+    self:_set_cursor(self.cur_column - get_scroll(self, self.cur_line), self.cur_line - self.cur_scroll)
 
     return true
 end
 
+--  Inserts a whole block of text at the caret, e.g. a paste. Line breaks in
+--  it split lines like an unmodified Enter would, minus the newline hook. The
+--  work is linear in the size of the text, unlike feeding it key by key.
+function cl:insert_text(text)
+    types.assert("string", text, "text")
+
+    if #text == 0 or self.buffer.read_only then
+        return
+    end
+
+    text = text:gsub("\r\n?", "\n")
+
+    local line, column = self.cur_line, self.cur_column
+    local off, byte = caret_offset(self)
+    local lf, tail = self.buffer:insert(off, text)
+
+    if lf == 0 then
+        columns(self):edit(self.cur_line, byte, 0, #text)
+        self.cur_column = columns(self):column(self.cur_line, byte + #text)
+
+        if get_scroll(self, self.cur_line) < self.cur_column - self._w + 1 then
+            set_scroll(self, self.cur_line, self.cur_column - self._w + 1)
+        end
+
+        self:invalidate(self.cur_line - self.cur_scroll)
+    else
+        shift_lines(self, self.cur_line, lf)
+
+        self.cur_line = self.cur_line + lf
+        self.cur_column = columns(self):column(self.cur_line, tail)
+
+        set_scroll(self, self.cur_line, self.cur_column - self._w + 1)
+
+        if self.cur_line - self.cur_scroll >= self._h then
+            self.cur_scroll = self.cur_line - self._h + 1
+
+            self:invalidate()
+        else
+            shift_rows(self, line - self.cur_scroll + 1, lf)
+            self:invalidate(line - self.cur_scroll, lf + 1)
+        end
+    end
+
+    self.journal:seal()
+    record(self, INSERT, line, byte, text, line, column)
+
+    self:do_on_contents_change()
+
+    self:_set_cursor(self.cur_column - get_scroll(self, self.cur_line), self.cur_line - self.cur_scroll)
+end
+
+--  Reverts the last edit, or the last run of typing. Returns whether there
+--  was anything to revert.
+function cl:undo()
+    return replay(self, self.journal:undo())
+end
+
+function cl:redo()
+    return replay(self, self.journal:redo())
+end
+
 function cl:process_event(ev)
     if ev.type == IET_KB then
         return self:process_key(ev)
+    elseif ev.type == IET_PASTE then
+        self:insert_text(ev.text)
+
+        return true
     else
         --  TODO: Mouse support?
         return false
@@ -318,11 +580,14 @@ end
 function cl:on_draw(x, y, w, h)
     self:_clear(x, y, w, h)
 
-    for i = y, math.min(y + h - 1, #self.lines - self.cur_scroll) do
-        local line = self.lines[self.cur_scroll + i]
-        local gL, gR = line.scroll > 0, #line.str - line.scroll > self._w - 1
+    local buffer, cache = self.buffer, columns(self)
+    local count = buffer:line_count()
+
+    for i = y, math.min(y + h - 1, count - self.cur_scroll) do
+        local line = self.cur_scroll + i
+        local scroll = get_scroll(self, line)
+        local gL, gR = scroll > 0, cache:exceeds(line, scroll + self._w - 1)
         local tStart, tEnd = math.max(x, gL and 1 or 0), math.min(x + w, self._w - (gR and 2 or 1))
-        local tLen = tEnd - tStart
 
         if gL and x == 0 then
             self:_print_xy(0, i, self.scroll_left_glyph)
@@ -332,7 +597,19 @@ function cl:on_draw(x, y, w, h)
             self:_print_xy(self._w - 2, i, self.scroll_right_glyph)
         end
 
-        self:_print_xy_lim(tStart, i, tLen, line.str:sub(line.scroll + 1 + tStart, line.scroll + tEnd))
+        --  Only the visible part of the line is ever turned into a string. A
+        --  wide character cut by the left edge is left out.
+        local first, col = cache:byte(line, scroll + tStart)
+
+        if col < scroll + tStart then
+            first, col = cache:next(line, first)
+        end
+
+        local last = cache:byte(line, scroll + tEnd)
+
+        if last > first then
+            self:_print_xy_lim(col - scroll, i, last - first, buffer:sub(buffer:line_start(line) + first, last - first))
+        end
     end
 
     if x + w >= self._w then
@@ -343,17 +620,17 @@ function cl:on_draw(x, y, w, h)
                 self:_print_xy(self._w - 1, 0, self.scroll_up_glyph)
             end
 
-            if y + h >= self._h and #self.lines - self.cur_scroll - self._h >= 0 then
+            if y + h >= self._h and count - self.cur_scroll - self._h >= 0 then
                 self:_print_xy(self._w - 1, self._h - 1, self.scroll_down_glyph)
             end
-        elseif #self.lines > 1 then
+        elseif count > 1 then
             --  Only one line, means no other line could've been invalidated.
 
             local glyph
 
             if self.cur_scroll == 1 then
                 glyph = self.scroll_down_glyph
-            elseif self.cur_scroll == #self.lines then
+            elseif self.cur_scroll == count then
                 glyph = self.scroll_up_glyph
             else
                 glyph = self.scroll_either_glyph
@@ -365,19 +642,19 @@ function cl:on_draw(x, y, w, h)
 end
 
 function cl:on_geometry_change(x, y, w, h)
-    if #self.lines - self.cur_scroll < h - 1 then
-        self.cur_scroll = #self.lines - h + 1
-    end
+    local count = self.buffer:line_count()
 
-    local line = self.lines[self.cur_line]
+    if count - self.cur_scroll < h - 1 then
+        self.cur_scroll = count - h + 1
+    end
 
-    if self.cur_column > line.scroll + w - 3 then
-        line.scroll = self.cur_column - w + 3
+    if self.cur_column > get_scroll(self, self.cur_line) + w - 3 then
+        set_scroll(self, self.cur_line, self.cur_column - w + 3)
     end
 end
 
 function cl:get_caret_position()
-    return self.cur_column - self.lines[self.cur_line].scroll, self.cur_line - self.cur_scroll
+    return self.cur_column - get_scroll(self, self.cur_line), self.cur_line - self.cur_scroll
 end
 
 function cl:get_caret()
@@ -385,30 +662,32 @@ function cl:get_caret()
 end
 
 function cl:set_caret(x, y, skipScroll, skipRedraw)
-    self.cur_line = math.clamp(1, y, #self.lines)
-    self.cur_column = math.clamp((self.watermark and y == 1) and #self.watermark or 0, x, #self.lines[self.cur_line].str)
+    self.journal:seal()
+
+    self.cur_line = math.clamp(1, y, self.buffer:line_count())
+    self.cur_column = snap(self, self.cur_line, math.clamp(self.cur_line == 1 and watermark_width(self) or 0, x, line_length(self, self.cur_line)))
 
     if not skipScroll then
         self:scroll_to_caret(true, true, skipRedraw)
     end
 
-    self:_set_cursor(self.cur_column - self.lines[self.cur_line].scroll, self.cur_line - self.cur_scroll)
+    self:_set_cursor(self.cur_column - get_scroll(self, self.cur_line), self.cur_line - self.cur_scroll)
 
     self:do_on_caret_move(self.cur_column, self.cur_line)
 end
 
 function cl:move_caret_left(skipScroll, skipRedraw)
-    if self.cur_column <= ((self.watermark and self.cur_line == 1) and #self.watermark or 0) then
+    if self.cur_column <= (self.cur_line == 1 and watermark_width(self) or 0) then
         return false
     end
 
-    local line = self.lines[self.cur_line]
+    local scroll = get_scroll(self, self.cur_line)
 
-    self.cur_column = self.cur_column - 1
+    self.cur_column = snap(self, self.cur_line, self.cur_column - 1)
 
-    if self.cur_column <= line.scroll and line.scroll > 0 and not skipScroll then
+    if self.cur_column <= scroll and scroll > 0 and not skipScroll then
         --  Should scroll left.
-        line.scroll = self.cur_column - 1
+        set_scroll(self, self.cur_line, self.cur_column - 1)
 
         if not skipRedraw then
             self:invalidate(self.cur_line - self.cur_scroll)
@@ -421,18 +700,19 @@ function cl:move_caret_left(skipScroll, skipRedraw)
 end
 
 function cl:move_caret_right(skipScroll, skipRedraw)
-    local line = self.lines[self.cur_line]
+    local cache = columns(self)
+    local _, col = cache:next(self.cur_line, cache:byte(self.cur_line, self.cur_column))
 
-    if self.cur_column == #line.str then
+    if col == self.cur_column then
         return false
     end
 
-    self.cur_column = self.cur_column + 1
+    self.cur_column = col
 
-    if line.scroll < self.cur_column - self._w + 3 and self.cur_column < #line.str - 1 and not skipScroll then
+    if get_scroll(self, self.cur_line) < self.cur_column - self._w + 3 and cache:exceeds(self.cur_line, self.cur_column + 1) and not skipScroll then
         --  Note that the position was incremented at this point, that's why there's a `2` at the end. If it wasn't, it would be a `3`.
 
-        line.scroll = self.cur_column - self._w + 3
+        set_scroll(self, self.cur_line, self.cur_column - self._w + 3)
 
         if not skipRedraw then
             self:invalidate(self.cur_line - self.cur_scroll)
@@ -444,34 +724,41 @@ function cl:move_caret_right(skipScroll, skipRedraw)
     return true
 end
 
-function cl:move_caret_up(skipScroll, skipRedraw)
-    if self.cur_line > 1 then
-        local oldLine = self.lines[self.cur_line]
-        self.cur_line = self.cur_line - 1
-        local newLine = self.lines[self.cur_line]
+--  Moves the caret to the line above or below, keeping it in the same place
+--  on screen where possible. Returns whether the new line needs redrawing.
+local function move_caret_vertically(self, newLine)
+    local oldLen, oldScroll = line_length(self, self.cur_line), get_scroll(self, self.cur_line)
+    local newLen, newScroll = line_length(self, newLine), get_scroll(self, newLine)
 
-        local inval = false
+    self.cur_line = newLine
 
-        if self.cur_column == 0 then
-            if newLine.scroll > 0 then
-                newLine.scroll = 0
-                inval = true
-            end
-        elseif self.cur_column == #oldLine.str then
-            self.cur_column = #newLine.str
+    if self.cur_column == 0 then
+        if newScroll > 0 then
+            set_scroll(self, newLine, 0)
+            return true
+        end
+    elseif self.cur_column == oldLen then
+        self.cur_column = newLen
 
-            local newS = math.max(0, self.cur_column - self._w + 2)
+        local newS = math.max(0, self.cur_column - self._w + 2)
 
-            if newLine.scroll ~= newS then
-                newLine.scroll = newS
-                inval = true
-            end
-        else
-            self.cur_column = newLine.scroll + math.min(self.cur_column - oldLine.scroll, #newLine.str - newLine.scroll)
+        if newScroll ~= newS then
+            set_scroll(self, newLine, newS)
+            return true
         end
+    else
+        self.cur_column = snap(self, newLine, newScroll + math.min(self.cur_column - oldScroll, newLen - newScroll))
+    end
+
+    return false
+end
 
-        if self.watermark and self.cur_line == 1 and self.cur_column < #self.watermark then
-            self.cur_column = #self.watermark
+function cl:move_caret_up(skipScroll, skipRedraw)
+    if self.cur_line > 1 then
+        local inval = move_caret_vertically(self, self.cur_line - 1)
+
+        if self.watermark and self.cur_line == 1 and self.cur_column < watermark_width(self) then
+            self.cur_column = watermark_width(self)
         end
 
         if (skipScroll or not self:scroll_to_caret(true, false, skipRedraw)) and inval and not skipRedraw then
@@ -486,30 +773,8 @@ function cl:move_caret_up(skipScroll, skipRedraw)
 end
 
 function cl:move_caret_down(skipScroll, skipRedraw)
-    if self.cur_line < #self.lines then
-        local oldLine = self.lines[self.cur_line]
-        self.cur_line = self.cur_line + 1
-        local newLine = self.lines[self.cur_line]
-
-        local inval = false
-
-        if self.cur_column == 0 then
-            if newLine.scroll > 0 then
-                newLine.scroll = 0
-                inval = true
-            end
-        elseif self.cur_column == #oldLine.str then
-            self.cur_column = #newLine.str
-
-            local newS = math.max(0, self.cur_column - self._w + 2)
-
-            if newLine.scroll ~= newS then
-                newLine.scroll = newS
-                inval = true
-            end
-        else
-            self.cur_column = newLine.scroll + math.min(self.cur_column - oldLine.scroll, #newLine.str - newLine.scroll)
-        end
+    if self.cur_line < self.buffer:line_count() then
+        local inval = move_caret_vertically(self, self.cur_line + 1)
 
         if (skipScroll or not self:scroll_to_caret(true, false, skipRedraw)) and inval and not skipRedraw then
             self:invalidate(self.cur_line - self.cur_scroll)
@@ -520,7 +785,7 @@ function cl:move_caret_down(skipScroll, skipRedraw)
 end
 
 function cl:scroll_to_caret(includeVertical, includeHorizontal, skipRedraw)
-    local hasScrolled = 0
+    local hasScrolled, oldScroll = 0, self.cur_scroll
 
     if includeVertical then
         if self.cur_scroll > self.cur_line then
@@ -537,20 +802,21 @@ function cl:scroll_to_caret(includeVertical, includeHorizontal, skipRedraw)
     end
 
     if includeHorizontal then
-        local line, newS = self.lines[self.cur_line]
+        local scroll = get_scroll(self, self.cur_line)
 
-        if line.scroll > 0 and line.scroll >= self.cur_column then
-            line.scroll = self.cur_column - 1
+        if scroll > 0 and scroll >= self.cur_column then
+            set_scroll(self, self.cur_line, self.cur_column - 1)
             hasScrolled = hasScrolled + 1
-        elseif line.scroll < self.cur_column - self._w + 3 and self.cur_column < #line.str - 1 then
-            line.scroll = self.cur_column - self._w + 3
+        elseif scroll < self.cur_column - self._w + 3 and columns(self):exceeds(self.cur_line, self.cur_column + 1) then
+            set_scroll(self, self.cur_line, self.cur_column - self._w + 3)
             hasScrolled = hasScrolled + 1
         end
     end
 
     if not skipRedraw then
         if hasScrolled >= 2 then
-            self:invalidate()   --  All of it, because it's scrolling vertically.
+            shift_rows(self, 0, oldScroll - self.cur_scroll)
+            self:invalidate(self.cur_line - self.cur_scroll)
         elseif hasScrolled == 1 then
             self:invalidate(self.cur_line - self.cur_scroll)
         end
@@ -563,12 +829,12 @@ function cl:scroll_up(skipRedraw)
     if self.cur_scroll > 1 then
         self.cur_scroll = self.cur_scroll - 1
 
-        if self.cur_scroll <= self.cur_line - self._h then
-            self:move_caret_up(true, true)
+        if not skipRedraw then
+            shift_rows(self, 0, 1)
         end
 
-        if not skipRedraw then
-            self:invalidate()
+        if self.cur_scroll <= self.cur_line - self._h then
+            self:move_caret_up(true, skipRedraw)
         end
 
         return true
@@ -578,15 +844,15 @@ function cl:scroll_up(skipRedraw)
 end
 
 function cl:scroll_down(skipRedraw)
-    if self.cur_scroll <= #self.lines - self._h then
+    if self.cur_scroll <= self.buffer:line_count() - self._h then
         self.cur_scroll = self.cur_scroll + 1
 
-        if self.cur_scroll > self.cur_line then
-            self:move_caret_down(true, true)
+        if not skipRedraw then
+            shift_rows(self, 0, -1)
         end
 
-        if not skipRedraw then
-            self:invalidate()
+        if self.cur_scroll > self.cur_line then
+            self:move_caret_down(true, skipRedraw)
         end
 
         return true
@@ -603,18 +869,39 @@ local contentsMetatable = {
     end,
 }
 
+--  A read-only buffer may map a file much larger than memory, so only the
+--  lines on screen are ever copied out of it, and at most this many bytes.
+local read_only_text_limit = 64 * 1024
+
+local function visible_text(self)
+    local buffer = self.buffer
+    local first = math.min(self.cur_scroll, buffer:line_count())
+    local last = math.min(first + (self._h or 1) - 1, buffer:line_count())
+    local start = buffer:line_start(first)
+    local lastStart, lastLen = buffer:line_range(last)
+
+    return buffer:sub(start, math.min(lastStart + lastLen - start, read_only_text_limit))
+end
+
 function cl:get_contents(includeNav)
-    local text = { }
+    if self.buffer.read_only then
+        local text = visible_text(self)
 
-    for i = 1, #self.lines do
-        text[i] = self.lines[i].str
-    end
+        if includeNav then
+            --  The buffer itself is kept; `set_contents` shows it again.
+            local cont = setmetatable({ text = text, buffer = self.buffer }, contentsMetatable)
+
+            cont.caret_x, cont.caret_y = self:get_caret()
+            cont.scroll_vertical = self.cur_scroll
 
-    if self.watermark then
-        text[1] = text[1]:sub(#self.watermark + 1)
+            return cont
+        else
+            return text
+        end
     end
 
-    text = table.concat(text, "\n")
+    local skip = self.watermark and #self.watermark or 0
+    local text = self.buffer:sub(skip, self.buffer:length() - skip)
 
     if includeNav then
         local cont = setmetatable({ text = text, watermark = self.watermark }, contentsMetatable)
@@ -622,8 +909,11 @@ function cl:get_contents(includeNav)
         cont.caret_x, cont.caret_y = self:get_caret()
         cont.scroll_vertical = self.cur_scroll
 
+        --  Only good for this very text; `set_contents` takes it back then.
+        cont.undo = { journal = self.journal, text = text }
+
         if self.watermark and cont.caret_y == 1 then
-            cont.caret_x = cont.caret_x - #self.watermark
+            cont.caret_x = cont.caret_x - watermark_width(self)
         end
 
         return cont
@@ -636,24 +926,33 @@ function cl:set_contents(cont)
     local cType = types.assert({"table", "string"}, cont, "contents")
     local text = cont
 
-    if cType == "table" then
+    if cType == "table" and cont.buffer then
+        self:set_buffer(cont.buffer)
+        self.cur_scroll = cont.scroll_vertical or 1
+        self:set_caret(cont.caret_x or 0, cont.caret_y or 1, false, true)
+        self:invalidate()
+
+        return
+    elseif cType == "table" then
         text = cont.text
     end
 
-    self.lines = { }
+    if cType == "table" then
+        self.watermark = cont.watermark or false
+    end
 
-    for line in text:iteratesplit("\r?\n\r?", false) do
-        table.insert(self.lines, { str = line, scroll = 0 })
+    if cType == "table" and cont.undo and cont.undo.text == text then
+        self.journal, cont.undo = cont.undo.journal, nil
+    else
+        self.journal = undo_journal()
     end
 
-    if cType == "table" then
-        if cont.watermark then
-            self.watermark = cont.watermark
-            self.lines[1].str = self.watermark .. self.lines[1].str
-        else
-            self.watermark = false
-        end
+    text = text:gsub("\r?\n\r?", "\n")
 
+    self.buffer = piece_table(self.watermark and self.watermark .. text or text)
+    self.scrolls = { }
+
+    if cType == "table" then
         if cont.scroll_vertical then
             self.cur_scroll = cont.scroll_vertical
         else
@@ -664,7 +963,7 @@ function cl:set_contents(cont)
             local x = cont.caret_x
 
             if cont.watermark and cont.caret_y == 1 then
-                x = x + #cont.watermark
+                x = x + watermark_width(self)
             end
 
             self:set_caret(x, cont.caret_y, false, true) --  Needs to redraw everything anyway, so it skips redraw. But it adjusts scrolling.
@@ -672,10 +971,6 @@ function cl:set_contents(cont)
             self:set_caret(0, 1, true, true)    --  No scroll, no redraw.
         end
     else
-        if self.watermark then
-            self.lines[1].str = self.watermark .. self.lines[1].str
-        end
-
         self.cur_scroll = 1
         self:set_caret(0, 1, true, true)    --  Accounts for watermark if present.
     end
@@ -683,13 +978,38 @@ function cl:set_contents(cont)
     self:invalidate()
 end
 
+--  Shows the given buffer instead of the current contents, e.g. a read-only
+--  `MappedFile`, which can be indexed while it is already on screen.
+function cl:set_buffer(buffer)
+    types.assert({ "PieceTable", "MappedFile" }, buffer, "buffer")
+
+    self.buffer = buffer
+    self.journal = undo_journal()
+    self.scrolls = { }
+    self.watermark = false
+    self.cur_scroll = 1
+    self:set_caret(0, 1, true, true)
+    self:invalidate()
+
+    if buffer.index_in_background then
+        buffer:index_in_background(function()
+            if self.buffer == buffer then
+                --  Only the scroll indicator can change.
+                self:invalidate(self._h - 1)
+            end
+        end)
+    end
+end
+
 function cl:clear_contents(watermark)
     if types.assert({"nil", "string"}, watermark, "watermark") == "string" and #watermark == 0 then
         watermark = nil
     end
 
     self.watermark = watermark or false
-    self.lines = { { str = watermark or "", scroll = 0 } }
+    self.buffer = piece_table(watermark or "")
+    self.journal = undo_journal()
+    self.scrolls = { }
     self.cur_scroll = 1
     self:set_caret(0, 1, true, true)
     self:invalidate()
@@ -47,10 +47,127 @@ local ffi = require "ffi"
 require "vandal/ffi/misc"
 require "vandal/logging"
 local c, C = tk.C, ffi.C
+local band = bit.band
 
 tickit.window = window
 
-local registry, evq = { }, { }
+local registry = { }
+local watches, next_watch = { }, 1
+
+--  Pending input events live in a ring buffer; its capacity is always a power
+--  of two, and doubles whenever it fills up.
+local evq, evq_cap, evq_head, evq_count = { }, 64, 0, 0
+
+--  Events are recycled once the caller is done with them, which is on the
+--  next poll. Only so many are kept around.
+local evpool, evpool_count, evpool_max = { }, 0, 256
+local lent = false
+
+local function new_event(typ, a, b, c)
+    if evpool_count > 0 then
+        local ev = evpool[evpool_count]
+        evpool[evpool_count] = nil
+        evpool_count = evpool_count - 1
+
+        ev:_reset(typ, a, b, c)
+
+        return ev
+    end
+
+    return inev(typ, a, b, c)
+end
+
+local function push_event(ev)
+    if evq_count == evq_cap then
+        local new = { }
+
+        for i = 0, evq_count - 1 do
+            new[i] = evq[band(evq_head + i, evq_cap - 1)]
+        end
+
+        evq, evq_cap, evq_head = new, evq_cap * 2, 0
+    end
+
+    evq[band(evq_head + evq_count, evq_cap - 1)] = ev
+    evq_count = evq_count + 1
+end
+
+--  Keys pressed with modifiers are named, like "C-Left" or "C-z". The ones
+--  which are not special keys are characters.
+local function key_event(name, mod)
+    local key = tickit.key_translate[name]
+
+    if key then
+        return new_event(IET_KB, key, nil, mod)
+    end
+
+    local char = name:match("^[CMS%-]*%-(.[\128-\191]*)$")
+
+    return new_event(IET_KB, char and vandal.ui.KEY_CODEPOINT, char, mod)
+end
+
+local function pop_event()
+    if evq_count == 0 then
+        return false
+    end
+
+    local ev = evq[evq_head]
+    evq[evq_head] = nil
+    evq_head = band(evq_head + 1, evq_cap - 1)
+    evq_count = evq_count - 1
+
+    lent = ev
+
+    return ev
+end
+
+--  Terminal input is queued in libtickit and drained here in batches, rather
+--  than called back into for every key.
+local evbuf_size = 64
+local evbuf = ffi.new("TickitTermEvent[?]", evbuf_size)
+
+--  Text keys are interned by codepoint, so repeated characters don't need a
+--  new Lua string each. Injected text has no codepoint and is never cached.
+local text_cache = { }
+
+local function drain_term_events()
+    local n
+
+    repeat
+        n = tonumber(c.tickit_term_get_events(tickit.tt, evbuf, evbuf_size))
+
+        for i = 0, n - 1 do
+            local e = evbuf[i]
+
+            if e.ev == c.TICKIT_EV_KEY then
+                local key = e.info.key
+
+                if key.type == c.TICKIT_KEYEV_TEXT then
+                    local cp = tonumber(key.codepoint)
+                    local str = text_cache[cp]
+
+                    if not str then
+                        str = ffi.string(key.str)
+
+                        if cp >= 0 then
+                            text_cache[cp] = str
+                        end
+                    end
+
+                    push_event(new_event(IET_KB, vandal.ui.KEY_CODEPOINT, str, vandal.ui.MOD_NONE))
+                else
+                    push_event(key_event(ffi.string(key.str), tickit.mod_translate[key.mod]))
+                end
+            elseif e.ev == c.TICKIT_EV_PASTE then
+                push_event(new_event(IET_PASTE, ffi.string(e.info.paste.str, e.info.paste.len)))
+            elseif e.ev == c.TICKIT_EV_RESIZE then
+                push_event(new_event(IET_RESIZE, e.info.resize.cols, e.info.resize.lines))
+            end
+
+            --  Mouse events are queued as well, but not acted upon yet.
+        end
+    until n < evbuf_size
+end
 
 function tickit.initialize(ui)
     if ui.initialized then
@@ -74,24 +191,43 @@ function tickit.initialize(ui)
 
     c.tickit_term_setctl_int(tickit.tt, c.TICKIT_TERMCTL_ALTSCREEN, 1)
     c.tickit_term_setctl_int(tickit.tt, c.TICKIT_TERMCTL_KEYPAD_APP, 1)
+    c.tickit_term_setctl_int(tickit.tt, c.TICKIT_TERMCTL_BRACKETED_PASTE, 1)
 
     c.tickit_term_clear(tickit.tt)
     ERR "Terminal cleared."
 
+    tickit.loop = c.tickit_loop_new()
+
+    if tickit.loop == nil then
+        error("Vandal error: Failed to create tickit event loop: " .. ffi.errno())
+    end
+
+    c.tickit_loop_set_term(tickit.loop, tickit.tt)
+    ERR "Event loop created."
+
     tickit.win_callback = ffi.cast("TickitWindowEventFn*", tickit.on_event)
-    tickit.term_callback = ffi.cast("TickitTermEventFn*", tickit.on_event)
-    ERR "Events set up."
+    tickit.loop_callback = ffi.cast("TickitLoopWatchFn*", tickit.on_watch)
 
-    tickit._ev = c.tickit_term_bind_event(tickit.tt, bit.bor(c.TICKIT_EV_RESIZE, c.TICKIT_EV_CHANGE, c.TICKIT_EV_KEY, c.TICKIT_EV_MOUSE), 0, tickit.term_callback, nil)
+    --  Keys, mouse, pastes and resizes are collected by `poll` from the
+    --  terminal's queue instead of through a term callback.
+    c.tickit_term_set_event_queue(tickit.tt, true)
+    ERR "Events set up."
 
     ui.main_window = window(c.tickit_window_new_root(tickit.tt), false)
     ERR "Main window created."
+    --  Not handed to the loop; Vandal's frame scheduler decides when to flush.
 
     c.tickit_window_take_focus(ui.main_window._handle)
     ERR "Root window given focus."
 end
 
 function tickit.finalize(ui)
+    if tickit.loop then
+        --  Drops its references on the terminal and root window, and unbinds
+        --  any remaining watches.
+        c.tickit_loop_destroy(tickit.loop)
+    end
+
     if ui.main_window and ui.main_window.valid then
         ui.main_window:destroy()
     end
@@ -104,8 +240,8 @@ function tickit.finalize(ui)
         tickit.win_callback:free()
     end
 
-    if tickit.term_callback then
-        tickit.term_callback:free()
+    if tickit.loop_callback then
+        tickit.loop_callback:free()
     end
 end
 
@@ -120,26 +256,34 @@ function tickit.poll(ui, timeout)
         timeout = (timeout ~= false) and -1 or 0
     end
 
-    if #evq > 0 then
-        --  There is an enqueued event? Then return it!
+    if lent then
+        --  The event returned last time is no longer in use.
 
-        local ev = evq[1]
-        table.remove(evq, 1)
-        return ev
-    end
+        if evpool_count < evpool_max then
+            evpool_count = evpool_count + 1
+            evpool[evpool_count] = lent
+        end
 
-    c.tickit_window_flush(ui.main_window._handle)
-    c.tickit_term_input_wait_msec(tickit.tt, timeout)
+        lent = false
+    end
 
-    if #evq > 0 then
+    if evq_count > 0 then
         --  There is an enqueued event? Then return it!
 
-        local ev = evq[1]
-        table.remove(evq, 1)
-        return ev
-    else
-        return false
+        return pop_event()
     end
+
+    --  Sleeps until input, a watch or a timer needs attention. Drawing is left
+    --  to `flush`.
+    c.tickit_loop_run_once(tickit.loop, timeout)
+    drain_term_events()
+
+    return pop_event()
+end
+
+function tickit.flush(ui)
+    c.tickit_window_flush(ui.main_window._handle)
+    c.tickit_term_flush(tickit.tt)
 end
 
 function tickit.on_event(han, ev, info, user)
@@ -161,13 +305,13 @@ function tickit.on_event(han, ev, info, user)
         ERR(info.type == c.TICKIT_KEYEV_KEY and "KEY: " or "TEXT: ", info.mod, "; ", ffi.string(info.str))
 
         if info.type == c.TICKIT_KEYEV_TEXT then
-            evq[#evq + 1] = inev(IET_KB, vandal.ui.KEY_CODEPOINT, ffi.string(info.str), vandal.ui.MOD_NONE)
+            push_event(new_event(IET_KB, vandal.ui.KEY_CODEPOINT, ffi.string(info.str), vandal.ui.MOD_NONE))
         else
-            evq[#evq + 1] = inev(IET_KB, tickit.key_translate[ffi.string(info.str)], nil, tickit.mod_translate[info.mod])
+            push_event(key_event(ffi.string(info.str), tickit.mod_translate[info.mod]))
         end
     elseif ev == c.TICKIT_EV_RESIZE then
         info = ffi.cast("TickitResizeEventInfo*", info)
-        evq[#evq + 1] = inev(IET_RESIZE, info.cols, info.lines)
+        push_event(new_event(IET_RESIZE, info.cols, info.lines))
     elseif ev == c.TICKIT_EV_GEOMCHANGE then
         info = ffi.cast("TickitGeomchangeEventInfo*", info)
 
@@ -183,6 +327,67 @@ function tickit.on_event(han, ev, info, user)
     return 1
 end
 
+function tickit.on_watch(loop, flags, user)
+    local key = tonumber(ffi.cast("intptr_t", user))
+    local fn = watches[key]
+
+    if bit.band(flags, c.TICKIT_LOOP_UNBIND) ~= 0 then
+        watches[key] = nil
+    end
+
+    if fn and bit.band(flags, c.TICKIT_LOOP_FIRE) ~= 0 then
+        fn(flags)
+    end
+
+    return 1
+end
+
+local function add_watch(fn)
+    local key = next_watch
+    next_watch = key + 1
+
+    watches[key] = fn
+
+    return ffi.cast("void*", key)
+end
+
+local function check_watch(id, user)
+    if id < 0 then
+        watches[tonumber(ffi.cast("intptr_t", user))] = nil
+
+        error("Vandal error: Failed to add tickit loop watch: " .. ffi.errno())
+    end
+
+    return id
+end
+
+function tickit.later(ui, fn)
+    types.assert("function", fn, "fn")
+
+    local user = add_watch(fn)
+    return check_watch(c.tickit_loop_watch_later(tickit.loop, tickit.loop_callback, user), user)
+end
+
+function tickit.timer(ui, msec, fn)
+    types.assert("number", msec, "msec")
+    types.assert("function", fn, "fn")
+
+    local user = add_watch(fn)
+    return check_watch(c.tickit_loop_watch_timer_msec(tickit.loop, msec, tickit.loop_callback, user), user)
+end
+
+function tickit.watch_fd(ui, fd, fn)
+    types.assert("number", fd, "fd")
+    types.assert("function", fn, "fn")
+
+    local user = add_watch(fn)
+    return check_watch(c.tickit_loop_watch_io(tickit.loop, fd, c.TICKIT_LOOP_IN, tickit.loop_callback, user), user)
+end
+
+function tickit.cancel(ui, id)
+    c.tickit_loop_cancel(tickit.loop, id)
+end
+
 function tickit.register_window(win)
     local key = tonumber(ffi.cast("size_t", win._handle))
     registry[key] = win
@@ -434,6 +434,26 @@ function cl:invalidate(y, h)
     end
 end
 
+--  Moves rows `y` through `y + h - 1` up by `downward` rows, or down when it is
+--  negative, on the terminal itself. Only the rows which are uncovered get
+--  exposed. Returns false when the terminal could not do it, in which case
+--  the whole area was exposed instead.
+function cl:scroll_rows(y, h, downward)
+    self:assert_valid()
+
+    if type(y) ~= "number" or not types.is_integer(y) then error "Vandal error: First argument to `Window:scroll_rows` must be an integer." end
+    if type(h) ~= "number" or not types.is_integer(h) then error "Vandal error: Second argument to `Window:scroll_rows` must be an integer." end
+    if type(downward) ~= "number" or not types.is_integer(downward) then error "Vandal error: Third argument to `Window:scroll_rows` must be an integer." end
+
+    local area = ffi.new "TickitRect[1]"
+    area[0] = c.tickit_window_get_geometry(self._handle)
+    area[0].top = y
+    area[0].left = 0
+    area[0].lines = h
+
+    return c.tickit_window_scrollrect(self._handle, area, downward, 0, nil)
+end
+
 function cl:_set_cursor(x, y)
     c.tickit_window_set_cursor_position(self._handle, y, x)
 end
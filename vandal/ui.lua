@@ -57,6 +57,8 @@ function ui.finalize()
     return ui.kit.finalize(ui)
 end
 
+--  The returned event may be recycled by the UI kit once `poll` is called
+--  again, so it must not be kept around past that.
 function ui.poll(timeout)
     local ev = ui.kit.poll(ui, timeout)
 
@@ -65,6 +67,30 @@ function ui.poll(timeout)
     return ev
 end
 
+function ui.flush()
+    return ui.kit.flush(ui)
+end
+
+--  Deferred work, run by the UI kit's event loop between polls. Each returns
+--  an ID that can be given to `ui.cancel`. Callbacks that change what is on
+--  screen should request a frame from `vandal.frames`.
+
+function ui.later(fn)
+    return ui.kit.later(ui, fn)
+end
+
+function ui.timer(msec, fn)
+    return ui.kit.timer(ui, msec, fn)
+end
+
+function ui.watch_fd(fd, fn)
+    return ui.kit.watch_fd(ui, fd, fn)
+end
+
+function ui.cancel(id)
+    return ui.kit.cancel(ui, id)
+end
+
 ui.KEYS = [[
 CODEPOINT NONE UNKNOWN
 ESC/ESCAPE TAB ENTER BACKSPACE DEL/DELETE
@@ -0,0 +1,271 @@
+--[[
+    Copyright (c) 2017 Alexandru-Mihai Maftei. All rights reserved.
+
+
+    Developed by: Alexandru-Mihai Maftei
+    aka Vercas
+    http://vercas.com | https://github.com/vercas/Vandal
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal with the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimers.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimers in the
+        documentation and/or other materials provided with the distribution.
+      * Neither the names of Alexandru-Mihai Maftei, Vercas, nor the names of
+        its contributors may be used to endorse or promote products derived from
+        this Software without specific prior written permission.
+
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    WITH THE SOFTWARE.
+
+    ---
+
+    You may also find the text of this license in "LICENSE.md".
+]]
+
+local classes = require "vandal/classes"
+local ffi = require "ffi"
+require "vandal/ffi/misc"
+
+local C = ffi.C
+
+--  Edit history for undo and redo. Every step is one insertion or deletion,
+--  stored with its text in a single byte array: a header, the text, and the
+--  size of the whole step again at the end, so the array can be walked both
+--  ways. Undoing or redoing a step only reads that step, so it costs as much
+--  as the edit did. Steps before the undo position can be undone, the ones
+--  after it redone, and recording a new step forgets the latter.
+--  Typing extends the last step instead of adding one, as long as it carries
+--  on where that step left off. When the history grows past `byte_limit`,
+--  the oldest steps are forgotten.
+
+ffi.cdef [[
+typedef struct VandalUndoStep {
+    double   byte;          //  Where in the line the edit was.
+    int32_t  line;
+    int32_t  before_line, before_column, after_line, after_column;
+    uint32_t len;           //  Of the text, which follows.
+    uint32_t size;          //  Of the whole step.
+    uint8_t  kind;
+    uint8_t  open;          //  Whether typing can still extend it.
+} VandalUndoStep;
+]]
+
+local step_ptr = ffi.typeof "VandalUndoStep *"
+local uint32_ptr = ffi.typeof "uint32_t *"
+local uint8_arr = ffi.typeof "uint8_t[?]"
+
+local header_size = ffi.sizeof "VandalUndoStep"
+local trailer_size = 8
+local initial_capacity = 4096
+
+local INSERT, DELETE = 1, 2
+
+local cl = {
+    Name = "UndoJournal",
+
+    INSERT = INSERT,
+    DELETE = DELETE,
+
+    byte_limit = 1024 * 1024,
+
+    size = {
+        get = function(self)
+            return self.tail - self.head
+        end,
+    },
+}
+
+local function step_size(len)
+    return header_size + len + (-len % 8) + trailer_size
+end
+
+local function step_at(self, at)
+    return ffi.cast(step_ptr, self.data + at)
+end
+
+local function set_trailer(self, at, size)
+    ffi.cast(uint32_ptr, self.data + at + size - trailer_size)[0] = size
+end
+
+--  Makes room for `need` more bytes at the end, forgetting the oldest steps
+--  if the history would outgrow the limit, but never the one starting at
+--  `keep`. Returns false if that is not enough.
+local function reserve(self, need, keep)
+    while self.tail - self.head + need > self.byte_limit do
+        if self.head == self.tail or self.head == keep then
+            return false
+        end
+
+        self.head = self.head + step_at(self, self.head).size
+    end
+
+    if self.tail + need > self.capacity then
+        local used = self.tail - self.head
+
+        if used + need > self.capacity then
+            local cap = math.max(self.capacity * 2, initial_capacity)
+
+            while cap < used + need do
+                cap = cap * 2
+            end
+
+            local data = uint8_arr(math.min(cap, self.byte_limit))
+
+            if used > 0 then
+                ffi.copy(data, self.data + self.head, used)
+            end
+
+            self.data, self.capacity = data, ffi.sizeof(data)
+        elseif used > 0 then
+            C.memmove(self.data, self.data + self.head, used)
+        end
+
+        self.cur, self.tail, self.head = self.cur - self.head, self.tail - self.head, 0
+    end
+
+    return true
+end
+
+--  Where the step before the undo position starts.
+local function last_at(self)
+    return self.cur - ffi.cast(uint32_ptr, self.data + self.cur - trailer_size)[0]
+end
+
+--  Adds text to the last step, before or after what it has.
+local function extend(self, text, before, line, column)
+    local at = last_at(self)
+    local len = step_at(self, at).len + #text
+
+    if not reserve(self, step_size(len) - step_at(self, at).size, at) then
+        return self:clear()
+    end
+
+    at = last_at(self)  --  It may have been moved.
+
+    local step = step_at(self, at)
+    local txt = self.data + at + header_size
+
+    if before then
+        C.memmove(txt + #text, txt, step.len)
+        ffi.copy(txt, text, #text)
+        step.byte = step.byte - #text
+    else
+        ffi.copy(txt + step.len, text, #text)
+    end
+
+    step.len, step.size = len, step_size(len)
+    step.after_line, step.after_column = line, column
+
+    set_trailer(self, at, step.size)
+    self.tail = at + step.size
+    self.cur = self.tail
+end
+
+function cl:__init(limit)
+    if limit then
+        self.byte_limit = limit
+    end
+
+    self.data, self.capacity = nil, 0
+    self.head, self.cur, self.tail = 0, 0, 0
+end
+
+function cl:clear()
+    self.head, self.cur, self.tail = 0, 0, 0
+end
+
+--  Stops typing from extending the last step.
+function cl:seal()
+    if self.cur > self.head then
+        step_at(self, last_at(self)).open = 0
+    end
+end
+
+--  Records that `text` was inserted or deleted at the given byte of a line,
+--  with the caret moving between the given positions. Typing passes `typing`,
+--  which lets the step merge with the last one.
+function cl:record(kind, line, byte, text, beforeLine, beforeColumn, afterLine, afterColumn, typing)
+    self.tail = self.cur
+
+    if typing and self.cur > self.head and not text:find("\n", 1, true) then
+        local last = step_at(self, last_at(self))
+
+        if last.open == 1 and last.kind == kind and last.line == line then
+            if (kind == INSERT and last.byte + last.len == byte) or (kind == DELETE and last.byte == byte) then
+                return extend(self, text, false, afterLine, afterColumn)
+            elseif kind == DELETE and byte + #text == last.byte then
+                return extend(self, text, true, afterLine, afterColumn)
+            end
+        end
+    end
+
+    self:seal()
+
+    local size = step_size(#text)
+
+    if not reserve(self, size) then
+        --  Too big to keep, and nothing before it can be undone without it.
+        return self:clear()
+    end
+
+    local at = self.tail
+    local step = step_at(self, at)
+
+    step.byte, step.line, step.len, step.size = byte, line, #text, size
+    step.before_line, step.before_column = beforeLine, beforeColumn
+    step.after_line, step.after_column = afterLine, afterColumn
+    step.kind, step.open = kind, typing and 1 or 0
+
+    ffi.copy(self.data + at + header_size, text, #text)
+    set_trailer(self, at, size)
+
+    self.tail = at + size
+    self.cur = self.tail
+end
+
+--  Steps back. Returns the edit which reverts the last step: its kind, line,
+--  byte and text, and where the caret was before the step. Nothing if there
+--  is nothing to undo.
+function cl:undo()
+    if self.cur == self.head then
+        return
+    end
+
+    self.cur = last_at(self)
+
+    local step = step_at(self, self.cur)
+
+    step.open = 0
+
+    return INSERT + DELETE - step.kind, step.line, step.byte, ffi.string(self.data + self.cur + header_size, step.len), step.before_line, step.before_column
+end
+
+--  Steps forward again. Returns the edit of the step which was undone last,
+--  like `undo` does, and where the caret was after it.
+function cl:redo()
+    if self.cur == self.tail then
+        return
+    end
+
+    local step = step_at(self, self.cur)
+
+    self.cur = self.cur + step.size
+
+    return step.kind, step.line, step.byte, ffi.string(self.data + self.cur - step.size + header_size, step.len), step.after_line, step.after_column
+end
+
+return classes.create(cl)